@@ -7,5 +7,12 @@
 # in the app
 COMPONENT_SRCDIRS := src
 COMPONENT_ADD_INCLUDEDIRS := include
+# the web UI is served from SPIFFS only with CONFIG_HTTP_APP_UI_NO_EMBED
+ifndef CONFIG_HTTP_APP_UI_NO_EMBED
+ifdef CONFIG_HTTP_APP_UI_BUNDLE
+COMPONENT_EMBED_FILES := ui/bundle/index.html
+else
 COMPONENT_EMBED_FILES := ui/style.css ui/code.js ui/index.html ui/favicon.ico
+endif
+endif
 # COMPONENT_EMBED_FILES := vue/style.css vue/code.js vue/index.html vue/favicon.ico
\ No newline at end of file
@@ -0,0 +1,97 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CBOR_CONTENT_TYPE	"application/cbor"
+#define CBOR_MAX_DEPTH		16
+#define CBOR_OUTPUT_LEN		64
+
+/**
+ * @brief Converts a JSON document to CBOR (RFC 8949): objects and arrays as indefinite length maps and arrays,
+ * integers as integers, other numbers as single or double precision floats.
+ * @return the CBOR size, 0 if the JSON is invalid, has a string or key longer than
+ * CONFIG_JSON_STREAM_MAX_VALUE or the result does not fit in out_size bytes.
+ */
+size_t cbor_from_json(const char* json, size_t len, uint8_t* out, size_t out_size);
+
+typedef void (*cbor_sink_t)(const char* json, size_t len, void* arg);
+
+typedef struct _cbor_frame_t {
+	bool		map;
+	bool		indefinite;
+	uint32_t	count;		/* items of a definite container, map keys and values counted apart */
+	uint32_t	index;		/* items done */
+}cbor_frame_t;
+
+/**
+ * @brief Incremental CBOR to JSON text decoder, of fixed size. The pieces of the document may split items anywhere.
+ * Byte strings become hex strings, tags are dropped, integer map keys are quoted.
+ */
+typedef struct _cbor_decoder_t {
+	uint8_t			state;
+	uint8_t			header[9];
+	uint8_t			header_len;
+	uint8_t			header_need;
+	uint8_t			string_major;	/* major type of the string being copied */
+	bool			string_chunks;	/* inside an indefinite length string */
+	bool			quote;			/* the current item is a map key to quote */
+	uint64_t		remaining;		/* bytes of the string being copied */
+	uint8_t			depth;
+	cbor_frame_t	frames[CBOR_MAX_DEPTH];
+	size_t			out_len;
+	char			out[CBOR_OUTPUT_LEN];
+	cbor_sink_t		sink;
+	void*			arg;
+}cbor_decoder_t;
+
+/**
+ * @brief Resets the decoder for a new document, the JSON text is passed to sink in pieces.
+ */
+void cbor_decoder_init(cbor_decoder_t* decoder, cbor_sink_t sink, void* arg);
+
+/**
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on malformed or unsupported input, further input is then ignored.
+ */
+esp_err_t cbor_decoder_feed(cbor_decoder_t* decoder, const uint8_t* data, size_t len);
+
+/**
+ * @brief Passes the rest of the JSON text to the sink.
+ * @return ESP_OK if a complete data item was decoded.
+ */
+esp_err_t cbor_decoder_finish(cbor_decoder_t* decoder);
+
+#ifdef __cplusplus
+}
+
+#endif
+
+/**@}*/
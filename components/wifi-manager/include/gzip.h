@@ -0,0 +1,116 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GZIP_HEADER_LEN		10
+#define GZIP_TRAILER_LEN	8
+
+/**
+ * @brief CRC-32 as used by gzip and zip, crc is 0 for the first piece, the previous result for the next ones.
+ */
+uint32_t gzip_crc32(uint32_t crc, const uint8_t* data, size_t len);
+
+/**
+ * @brief Compresses data into a gzip member: one deflate block with the fixed Huffman codes,
+ * matches searched with a single probe hash within CONFIG_GZIP_WINDOW_SIZE bytes.
+ * Needs no buffer besides out and a hash table of (1 << CONFIG_GZIP_HASH_BITS) 16 bit entries, allocated for the call.
+ * @return the compressed size, 0 if it would not fit in out_size bytes, len is above 65534 or out of memory.
+ */
+size_t gzip_compress(const uint8_t* data, size_t len, uint8_t* out, size_t out_size);
+
+#define GZIP_INFLATE_MAX_WINDOW_BITS	15
+
+/**
+ * @brief Receives the decompressed data, an error stops the decompression.
+ */
+typedef esp_err_t (*gzip_inflate_out_t)(void* arg, const uint8_t* data, size_t len);
+
+/**
+ * @brief Streaming decompressor of zlib streams (RFC 1950, deflate with the Adler-32 trailer).
+ * Its size is fixed besides the window, which is the history the stream was compressed with.
+ */
+typedef struct _gzip_inflate_t {
+	uint8_t				state;
+	uint8_t				last;			/* the block is the final one */
+	uint8_t				window_bits;
+	uint8_t				count;			/* bits in buffer */
+	uint8_t				used;			/* bits of buffer taken by the step being decoded */
+	uint64_t			buffer;
+	uint16_t			stored;			/* bytes left of a stored block */
+	uint16_t			hlit;
+	uint16_t			hdist;
+	uint16_t			hclen;
+	uint16_t			index;			/* code lengths read of the dynamic header */
+	uint32_t			adler;
+	uint32_t			pos;			/* in window */
+	uint32_t			flushed;		/* window bytes already passed to out */
+	uint32_t			total;			/* bytes decompressed */
+	esp_err_t			err;
+	uint8_t				lens[320];
+	uint16_t			lit_count[16];
+	uint16_t			lit_symbol[288];
+	uint16_t			dist_count[16];
+	uint16_t			dist_symbol[30];
+	gzip_inflate_out_t	out;
+	void*				arg;
+	uint8_t*			window;
+}gzip_inflate_t;
+
+/**
+ * @brief Tells if data starts with a zlib header.
+ */
+bool gzip_inflate_is_zlib(const uint8_t* data, size_t len);
+
+/**
+ * @brief Prepares to decompress a stream compressed with a window of at most 2^window_bits bytes.
+ * @return ESP_ERR_NO_MEM if the window could not be allocated.
+ */
+esp_err_t gzip_inflate_init(gzip_inflate_t* gz, uint8_t window_bits, gzip_inflate_out_t out, void* arg);
+
+/**
+ * @brief Decompresses the next piece of the stream, pieces may split it anywhere.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a malformed stream or one with a larger window, or the error of out.
+ */
+esp_err_t gzip_inflate_feed(gzip_inflate_t* gz, const uint8_t* data, size_t len);
+
+/**
+ * @brief Ends the stream and frees the window.
+ * @return ESP_OK if the stream was complete and its checksum matched.
+ */
+esp_err_t gzip_inflate_finish(gzip_inflate_t* gz);
+
+#ifdef __cplusplus
+}
+
+#endif
+
+/**@}*/
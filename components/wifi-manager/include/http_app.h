@@ -26,6 +26,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <esp_err.h>
 #include <esp_http_server.h>
 
@@ -42,6 +43,50 @@ extern "C" {
  */
 #define WEBAPP_LOCATION 					CONFIG_WEBAPP_LOCATION
 
+/**
+ * @brief Route classes used by the per-client rate limiter.
+ * Each client IP owns one token bucket per class.
+ */
+typedef enum http_app_route_class_t {
+	HTTP_APP_ROUTE_STATIC = 0,		/* index, scripts, styles, captive redirects */
+	HTTP_APP_ROUTE_JSON = 1,		/* /ap.json, triggers a wifi scan */
+	HTTP_APP_ROUTE_ACTION = 2,		/* setup POSTs and /connect */
+	HTTP_APP_ROUTE_CLASS_COUNT = 3 	/* important for the counters array */
+}http_app_route_class_t;
+
+/**
+ * @brief Counters of one route class.
+ * Latency percentiles are upper bounds of power of two histogram buckets.
+ */
+typedef struct _http_app_class_stats_t {
+	uint32_t	requests;			/* served since the last reset */
+	uint32_t	rejected;			/* answered with 429 since the last reset */
+	uint32_t	p50_ms;
+	uint32_t	p99_ms;
+	uint32_t	max_ms;
+}http_app_class_stats_t;
+
+/**
+ * @brief Server statistics, also served as /stats.json in the STA diagnostics group.
+ * Requests per second of a class are requests * 1000 / elapsed_ms.
+ */
+typedef struct _http_app_stats_t {
+	uint32_t				elapsed_ms;		/* since the last reset */
+	uint32_t				free_heap;
+	uint32_t				min_free_heap;	/* heap low-water mark since boot */
+	http_app_class_stats_t	classes[HTTP_APP_ROUTE_CLASS_COUNT];
+}http_app_stats_t;
+
+/**
+ * @brief Groups of routes enabled on the running server.
+ * The server is started once, mode changes only switch the groups served.
+ */
+typedef enum http_app_routes_t {
+	HTTP_APP_ROUTES_NONE = 0,
+	HTTP_APP_ROUTES_PORTAL = 1,		/* web UI, setup endpoints and captive portal redirect */
+	HTTP_APP_ROUTES_STATUS = 2,		/* STA diagnostics: /status.json, /stats.json, in client mode with CONFIG_HTTP_APP_STA_DIAGNOSTICS */
+	HTTP_APP_ROUTES_ALL = 3
+}http_app_routes_t;
 
 /** 
  * @brief spawns the http server 
@@ -53,12 +98,37 @@ void http_app_start(bool lru_purge_enable);
  */
 void http_app_stop();
 
+/**
+ * @brief switches the route groups served by the running http server.
+ * Requests to a disabled group get a 404, sockets and open connections are kept.
+ */
+void http_app_set_routes(http_app_routes_t routes);
+
 /** 
  * @brief sets a hook into the wifi manager URI handlers. Setting the handler to NULL disables the hook.
  * @return ESP_OK in case of success, ESP_ERR_INVALID_ARG if the method is unsupported.
  */
 esp_err_t http_app_set_handler_hook( httpd_method_t method,  esp_err_t (*handler)(httpd_req_t *r)  );
 
+/**
+ * @brief number of requests of a route class rejected with 429 since boot,
+ * or since the last http_app_reset_stats() with CONFIG_HTTP_APP_STATS.
+ * @return 0 if rate limiting is disabled.
+ */
+uint32_t http_app_get_rejected_count(http_app_route_class_t route_class);
+
+#ifdef CONFIG_HTTP_APP_STATS
+/**
+ * @brief fills the request counters, latencies and heap usage of the server.
+ */
+void http_app_get_stats(http_app_stats_t* stats);
+
+/**
+ * @brief clears the request counters and restarts the measurement window.
+ */
+void http_app_reset_stats();
+#endif
+
 
 #ifdef __cplusplus
 }
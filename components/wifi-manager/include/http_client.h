@@ -23,12 +23,11 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <esp_err.h>
 #include <esp_http_client.h>
 #include "freertos/event_groups.h"
-
-#define MAX_HTTP_URI_LEN       	64
-#define MAX_REQUEST_DATA_LEN	1024
+#include "json_stream.h"
 
 #define HC_STATUS_OK  	  BIT0	// Set if http connection established
 #define HC_WIFI_OK		    BIT1	// Set if wifi connection established
@@ -49,12 +48,46 @@ typedef enum order_code_t {
 
 
 /**
- * @brief Structure used to store one message in the queue.
+ * @brief Priority lanes of the send queue.
+ * Workers serve the lanes by weighted round robin, see CONFIG_HTTP_CLIENT_LANE_*_WEIGHT.
+ */
+typedef enum http_client_lane_t {
+	HC_LANE_CONTROL = 0,	/* commands and their acknowledgements */
+	HC_LANE_NORMAL = 1,		/* application requests */
+	HC_LANE_BULK = 2,		/* logs, telemetry backlog, outbox replay */
+	HC_LANE_COUNT = 3		/* important for the lanes array */
+}http_client_lane_t;
+
+/**
+ * @brief Outcome of one request, valid only during the completion callback.
+ */
+typedef struct _http_client_result_t {
+	uint32_t	id;			/* returned when the request was queued */
+	esp_err_t	err;		/* ESP_OK if a response was received, whatever its status */
+	int			status;		/* http status code, 0 without response */
+	uint32_t	latency_ms;	/* from queuing to completion, retries included */
+	const char*	body;		/* zero terminated, truncated to CONFIG_HTTP_CLIENT_MAX_RESPONSE_LEN, NULL if empty */
+	int			body_len;
+	bool		retry;		/* failed, but may be sent again: it did not reach the server or is idempotent */
+}http_client_result_t;
+
+typedef void (*http_client_done_cb_t)(const http_client_result_t* result, void* arg);
+
+/**
+ * @brief One request, allocated in a single block sized to its uri and body.
+ * The queue only carries the pointer, the send task frees the request once sent.
  */
 typedef struct _http_client_request_t {
 	uint16_t 	method;
-	char 		uri[MAX_HTTP_URI_LEN];
-	char 		data[MAX_REQUEST_DATA_LEN];
+	TickType_t	deadline;	/* tick count after which the request is not sent or retried any more */
+	size_t		data_len;
+	char*		data;		/* body, NULL for none; points into buf or to a buffer handed over by the caller */
+	bool		data_owned;	/* data is a separate heap buffer to free with the request */
+	uint32_t	id;
+	TickType_t	queued;		/* tick count when the request was created */
+	http_client_done_cb_t done;	/* completion callback, NULL for fire and forget */
+	void*		done_arg;
+	char 		uri[];		/* zero terminated, followed by the copied body if any */
 }http_client_request_t;
 
 
@@ -65,9 +98,27 @@ void http_client_initialize();
 
 /**
  * @brief Register a callback to a custom function when specific event response happens.
+ * Requests run on CONFIG_HTTP_CLIENT_POOL_SIZE connections, the callback may be called from any send task.
+ * It is not called again for a GET answered 304 Not Modified, see CONFIG_HTTP_CLIENT_CACHE.
+ * The body is buffered, longer than CONFIG_HTTP_CLIENT_MAX_RESPONSE_LEN it is truncated;
+ * prefer http_client_set_stream_callback() for large responses.
  */
 void http_client_set_response_callback( void (*func_ptr)(const char*, int) );
 
+/**
+ * @brief Register a callback receiving every JSON token of the backend responses while they arrive.
+ * Bodies of any size and chunked responses are parsed in constant RAM, nothing is buffered.
+ * Like the response callback it may be called from any send task.
+ */
+void http_client_set_stream_callback(json_stream_cb_t cb, void* arg);
+
+/**
+ * @brief Register a callback for the value of every response member named key, see json_stream_on_key().
+ * @param key must stay valid, it is not copied.
+ * @return ESP_ERR_NO_MEM if CONFIG_JSON_STREAM_MAX_HANDLERS are already registered.
+ */
+esp_err_t http_client_on_response_key(const char* key, json_stream_cb_t cb, void* arg);
+
 /**
  * @brief Register a callback to a custom function when specific event ready happens.
  */
@@ -78,12 +129,143 @@ void http_client_set_ready_callback(void (*func_ptr)(void*) );
  */
 void http_client_set_not_ready_callback(void (*func_ptr)(void*) );
 
+/**
+ * @brief Queue a request in a lane, the uri and data are copied.
+ * Never blocks longer than ticks_to_wait, a full lane is reported so the caller can shed or defer load.
+ * @return ESP_OK if queued (or stored to the outbox while offline), ESP_ERR_TIMEOUT if the lane is full,
+ * ESP_ERR_NO_MEM, ESP_ERR_INVALID_STATE while offline without outbox.
+ */
+esp_err_t http_client_send(http_client_lane_t lane, uint16_t method, const char* uri, const char* data, TickType_t ticks_to_wait);
+
+/**
+ * @brief Same as http_client_send() with a heap body of len bytes taken over, freed by the client in any case.
+ */
+esp_err_t http_client_send_owned(http_client_lane_t lane, uint16_t method, const char* uri, char* data, size_t len, TickType_t ticks_to_wait);
+
+/**
+ * @brief Free places in a lane, lets producers skip building a request which would be rejected.
+ */
+UBaseType_t http_client_lane_free(http_client_lane_t lane);
+
+/**
+ * @brief Queue a request whose outcome is reported to its own callback, called once from a send task.
+ * The response goes to the callback only, the global response callback is not called for it.
+ * Such requests are neither batched nor stored to the outbox: while offline or when the lane stays full
+ * they are rejected and the callback is not called.
+ * A GET answered 304 Not Modified, see CONFIG_HTTP_CLIENT_CACHE, is reported with status 304 and no body.
+ * @param id if not NULL, receives the id reported in the result.
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the lane is full, ESP_ERR_NO_MEM, ESP_ERR_INVALID_STATE while offline.
+ */
+esp_err_t http_client_request(http_client_lane_t lane, uint16_t method, const char* uri, const char* data,
+	http_client_done_cb_t done, void* arg, TickType_t ticks_to_wait, uint32_t* id);
+
+/**
+ * @brief Queue a request and wait for its outcome, the blocking form of http_client_request().
+ * @param body if not NULL, receives the response body truncated to body_size - 1 bytes and zero terminated;
+ * result->body then points to it.
+ * @param ticks_to_wait for queuing and completion together.
+ * @return the error of the request, ESP_ERR_TIMEOUT if it did not complete in time.
+ */
+esp_err_t http_client_request_wait(http_client_lane_t lane, uint16_t method, const char* uri, const char* data,
+	http_client_result_t* result, char* body, size_t body_size, TickType_t ticks_to_wait);
+
 /**
  * @brief Send http request
+ * The uri and data are copied, a request costs only its own size. to_front uses the control lane,
+ * the others the normal lane. They wait at most CONFIG_HTTP_CLIENT_SEND_TIMEOUT_MS for a free place,
+ * then store the request to the outbox if enabled, or fail.
  */
 BaseType_t http_client_send_message_to_front(uint16_t method, const char* uri, const char* data);
 BaseType_t http_client_send_message(uint16_t method, const char* uri, const char* data);
 
+/**
+ * @brief Send http request with a body taken over without copy.
+ * @param data heap buffer of len bytes, freed by the client in any case, also when pdFALSE is returned.
+ */
+BaseType_t http_client_send_buffer(uint16_t method, const char* uri, char* data, size_t len);
+
+#ifdef CONFIG_HTTP_CLIENT_BATCH
+/**
+ * @brief Batching counters since boot.
+ * Saved requests are records - requests, saved bytes are estimated from the per-request overhead.
+ */
+typedef struct _http_client_batch_stats_t {
+	uint32_t	records;		/* records posted to batched URIs */
+	uint32_t	record_bytes;	/* their total size */
+	uint32_t	requests;		/* batches sent */
+	uint32_t	bytes;			/* total size of the batch bodies */
+}http_client_batch_stats_t;
+
+/**
+ * @brief Gather POST requests to an URI into one JSON array body.
+ * A batch is sent when it reaches max_bytes or linger_ms after its first record.
+ * A POST to a batched URI waits at most its ticks_to_wait for a full batch to be queued,
+ * then fails with ESP_ERR_TIMEOUT or is stored to the outbox like one finding its lane full.
+ * @param max_bytes body size limit, 0 sends the pending batch and disables batching for the URI.
+ * @param ticks_to_wait for queuing the pending batch, the settings are kept if it stays full.
+ * @return ESP_OK, ESP_ERR_NO_MEM if all CONFIG_HTTP_CLIENT_BATCH_URIS slots are used,
+ * ESP_ERR_TIMEOUT if the pending batch could not be queued, ESP_ERR_INVALID_STATE before http_client_initialize().
+ */
+esp_err_t http_client_set_batching(const char* uri, size_t max_bytes, uint32_t linger_ms, TickType_t ticks_to_wait);
+
+void http_client_get_batch_stats(http_client_batch_stats_t* stats);
+#endif
+
+/**
+ * @brief Cost of the backend connections. Every connect includes the TLS handshake over SSL,
+ * requests minus connects is the number of requests run on a kept alive connection.
+ */
+typedef struct _http_client_conn_stats_t {
+	uint32_t	connects;
+	uint32_t	connect_ms;		/* total time from the start of a request to the connection set up */
+	uint32_t	connect_max_ms;
+	uint32_t	requests;
+}http_client_conn_stats_t;
+
+void http_client_get_conn_stats(http_client_conn_stats_t* stats);
+
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+/**
+ * @brief Effect and cost of the request body compression.
+ */
+typedef struct _http_client_gzip_stats_t {
+	uint32_t	requests;	/* bodies sent compressed */
+	uint32_t	skipped;	/* bodies above the minimal size which did not compress */
+	uint32_t	bytes_in;	/* size of the compressed bodies before compression */
+	uint32_t	bytes_out;	/* and after */
+	uint32_t	time_us;	/* spent compressing, skipped bodies included */
+}http_client_gzip_stats_t;
+
+void http_client_get_gzip_stats(http_client_gzip_stats_t* stats);
+#endif
+
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+/**
+ * @brief Conditional GET: responses answered 304 Not Modified skip the body and the callbacks.
+ */
+typedef struct _http_client_cache_stats_t {
+	uint32_t	lookups;	/* GET requests checked against the cache */
+	uint32_t	hits;		/* answered 304 */
+	uint32_t	stores;		/* validators kept from full responses */
+}http_client_cache_stats_t;
+
+void http_client_get_cache_stats(http_client_cache_stats_t* stats);
+#endif
+
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+/**
+ * @brief Use of the CBOR wire format.
+ */
+typedef struct _http_client_cbor_stats_t {
+	uint32_t	bodies;		/* request bodies sent as CBOR */
+	uint32_t	json_bytes;	/* their size as JSON */
+	uint32_t	cbor_bytes;	/* and as CBOR */
+	uint32_t	responses;	/* responses received as CBOR */
+}http_client_cbor_stats_t;
+
+void http_client_get_cbor_stats(http_client_cbor_stats_t* stats);
+#endif
+
 #ifdef __cplusplus
 }
 
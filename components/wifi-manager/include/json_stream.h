@@ -0,0 +1,131 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_STREAM_MAX_DEPTH		32
+#define JSON_STREAM_MAX_KEY			CONFIG_JSON_STREAM_MAX_KEY
+#define JSON_STREAM_MAX_VALUE		CONFIG_JSON_STREAM_MAX_VALUE
+#define JSON_STREAM_MAX_HANDLERS	CONFIG_JSON_STREAM_MAX_HANDLERS
+
+typedef enum json_stream_event_t {
+	JSON_STREAM_OBJECT_START = 0,
+	JSON_STREAM_OBJECT_END = 1,
+	JSON_STREAM_ARRAY_START = 2,
+	JSON_STREAM_ARRAY_END = 3,
+	JSON_STREAM_STRING = 4,
+	JSON_STREAM_NUMBER = 5,
+	JSON_STREAM_TRUE = 6,
+	JSON_STREAM_FALSE = 7,
+	JSON_STREAM_NULL = 8,
+	JSON_STREAM_EVENT_COUNT = 9
+}json_stream_event_t;
+
+/**
+ * @brief One token reported by the tokenizer, valid only during the callback.
+ */
+typedef struct _json_stream_token_t {
+	json_stream_event_t	type;
+	const char*			key;		/* member name, NULL in arrays, at top level and for *_END */
+	const char*			value;		/* zero terminated text of strings (unescaped) and numbers, NULL otherwise */
+	size_t				len;		/* length of value in the buffer */
+	uint8_t				depth;		/* number of enclosing objects and arrays */
+	bool				truncated;	/* the value was longer than the configured buffer */
+}json_stream_token_t;
+
+typedef void (*json_stream_cb_t)(const json_stream_token_t* token, void* arg);
+
+typedef struct _json_stream_handler_t {
+	const char*			key;
+	json_stream_cb_t	cb;
+	void*				arg;
+	uint8_t				active;		/* depth + 1 of the container value being reported, 0 if none */
+}json_stream_handler_t;
+
+/**
+ * @brief Incremental JSON tokenizer. Its size is fixed: documents of any length are parsed in
+ * constant RAM, only keys and scalar values longer than the buffers are truncated.
+ */
+typedef struct _json_stream_t {
+	uint8_t					state;
+	uint8_t					depth;
+	uint32_t				objects;	/* bit n set if the container at depth n is an object */
+	uint8_t					escape;		/* 0, 1 after a backslash, 2..5 reading \uXXXX */
+	uint16_t				unicode;
+	uint16_t				surrogate;	/* high surrogate waiting for the low one, 0 if none */
+	uint8_t					literal;	/* position in true/false/null */
+	bool					is_key;
+	bool					has_key;
+	bool					truncated;
+	size_t					len;
+	char					key[JSON_STREAM_MAX_KEY];
+	char					value[JSON_STREAM_MAX_VALUE];
+	json_stream_cb_t		cb;
+	void*					arg;
+	json_stream_handler_t	handlers[JSON_STREAM_MAX_HANDLERS];
+}json_stream_t;
+
+/**
+ * @brief Resets the tokenizer for a new document, the registered key handlers are kept.
+ * @param cb called for every token, may be NULL.
+ */
+void json_stream_init(json_stream_t* js, json_stream_cb_t cb, void* arg);
+
+/**
+ * @brief Registers a callback for the value of every member named key, at any depth.
+ * An object or array value is reported with all tokens inside it, up to its end.
+ * @return ESP_ERR_NO_MEM if all CONFIG_JSON_STREAM_MAX_HANDLERS are used.
+ */
+esp_err_t json_stream_on_key(json_stream_t* js, const char* key, json_stream_cb_t cb, void* arg);
+
+/**
+ * @brief Removes all key handlers.
+ */
+void json_stream_clear_handlers(json_stream_t* js);
+
+/**
+ * @brief Parses the next piece of the document, pieces may split tokens anywhere.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a syntax error, further input is then ignored.
+ */
+esp_err_t json_stream_feed(json_stream_t* js, const char* data, size_t len);
+
+/**
+ * @brief Ends the document.
+ * @return ESP_OK if a complete JSON value was parsed.
+ */
+esp_err_t json_stream_finish(json_stream_t* js);
+
+#ifdef __cplusplus
+}
+
+#endif
+
+/**@}*/
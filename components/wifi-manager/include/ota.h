@@ -23,18 +23,65 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <esp_err.h>
-
+#include <cJSON.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Upgrade progress, reported at every flash sector written and once when the image is complete.
+ */
+typedef struct _ota_progress_t {
+	uint32_t	written;	/* image bytes written */
+	uint32_t	total;		/* image size, 0 if not known */
+	uint32_t	received;	/* bytes downloaded, fewer than written for a patch */
+	uint32_t	elapsed_ms;
+	uint32_t	rate;		/* downloaded bytes per second */
+	bool		done;
+}ota_progress_t;
+
+typedef void (*ota_progress_cb_t)(const ota_progress_t* progress, void* arg);
+
 bool ota(const char* data, int size);
 
-void firmware_upgrade( void (*func_ptr)(bool) );
+/**
+ * @brief Takes the firmware of the orders: the member <esp_json_key> and its attributes <esp_json_key><suffix>,
+ * see ota_set_attribute(). The attributes of earlier orders are forgotten.
+ * @return false if the orders name no firmware.
+ */
+bool ota_set_orders(const cJSON* root);
+
+/**
+ * @brief Sets the firmware file downloaded by the next firmware_upgrade().
+ * @return true if the name is not empty.
+ */
+bool ota_set_file(const char* name);
 
-// void get_sha256_of_partitions(void);
+/**
+ * @brief Sets a patch from the running firmware to the one set by ota_set_file().
+ * The next firmware_upgrade() tries the patch first and falls back to the full image.
+ * @return false if the name is empty or delta updates are disabled.
+ */
+bool ota_set_delta_file(const char* name);
+
+/**
+ * @brief Sets an attribute of the firmware from the member <esp_json_key><suffix> of the orders:
+ * CONFIG_OTA_DELTA_KEY_SUFFIX the patch file, "_sha256" the image SHA-256 in hex,
+ * "_sig" the DER ECDSA signature of that SHA-256 in hex.
+ * The attributes are used by the next firmware_upgrade() only.
+ * @return false for an unknown suffix or an invalid value.
+ */
+bool ota_set_attribute(const char* suffix, const char* value);
+
+/**
+ * @brief Replaces the progress log with a callback, called from the upgrade or the OTA writer task.
+ */
+void ota_set_progress_callback(ota_progress_cb_t func_ptr, void* arg);
+
+void firmware_upgrade( void (*func_ptr)(bool) );
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,85 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#include "ota_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Patch format, made by tools/ota_delta.py, integers little endian:
+ *   header  "WMD1", source size (u32), target size (u32), target SHA-256 (32 bytes)
+ *   ops     0x01 COPY   offset (u32), length (u32)   bytes of the running image
+ *           0x02 INSERT length (u32), the bytes
+ *           0x00 END
+ * The ops produce the target image in order, so the patch is applied while it is downloaded.
+ */
+#define OTA_DELTA_MAGIC			"WMD1"
+#define OTA_DELTA_HEADER_LEN	44
+#define OTA_DELTA_COPY_BUF		256
+
+typedef struct _ota_delta_t {
+	uint8_t					state;
+	uint8_t					op;
+	uint8_t					field[OTA_DELTA_HEADER_LEN];	/* header or arguments being read */
+	uint8_t					field_len;
+	uint32_t				remaining;		/* bytes of the running INSERT */
+	uint32_t				source_size;
+	uint32_t				target_size;
+	uint8_t					target_sha256[OTA_SHA256_LEN];
+	const esp_partition_t*	source;
+	ota_writer_t*			writer;
+	bool					started;		/* the writer was begun */
+	uint8_t					buffer[OTA_DELTA_COPY_BUF];
+}ota_delta_t;
+
+/**
+ * @brief Prepares to apply a patch against the running partition, the writer is begun once the header is read.
+ */
+void ota_delta_begin(ota_delta_t* delta, ota_writer_t* writer);
+
+/**
+ * @brief Applies the next piece of the patch, pieces may split the header and the ops anywhere.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a malformed patch or one for another image, or a writer error.
+ */
+esp_err_t ota_delta_feed(ota_delta_t* delta, const uint8_t* data, size_t len);
+
+/**
+ * @brief Ends the patch and the update: the image is verified against the SHA-256 of the patch header.
+ * The writer is aborted on any failure.
+ */
+esp_err_t ota_delta_finish(ota_delta_t* delta);
+
+#ifdef __cplusplus
+}
+
+#endif
+
+/**@}*/
@@ -0,0 +1,111 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_SHA256_LEN	32
+#define OTA_IMAGE_MAGIC	0xE9	/* first byte of an application image */
+
+struct _ota_writer_t;
+
+/**
+ * @brief Called each time the image written so far ends at a sector boundary.
+ */
+typedef void (*ota_writer_checkpoint_t)(struct _ota_writer_t* writer, void* arg);
+
+/**
+ * @brief Called by ota_writer_finish() with the SHA-256 of the whole image, before the partition is selected.
+ * @return ESP_OK to accept the image.
+ */
+typedef esp_err_t (*ota_writer_verify_t)(struct _ota_writer_t* writer, const uint8_t* digest, void* arg);
+
+/**
+ * @brief Writes a firmware image to the update partition and hashes it on the way.
+ * Sectors are erased just before they are written, so a write may be resumed at any sector boundary.
+ * The image is hashed as it is written, it is never read back.
+ * The hooks are set before ota_writer_begin() or ota_writer_resume(), which keep them.
+ */
+typedef struct _ota_writer_t {
+	const esp_partition_t*	partition;
+	size_t					size;		/* announced image size, OTA_SIZE_UNKNOWN if not known */
+	size_t					written;
+	size_t					erased;		/* end of the erased sectors */
+	mbedtls_sha256_context	sha;
+	ota_writer_checkpoint_t	checkpoint;
+	ota_writer_verify_t		verify;
+	void*					arg;		/* of the hooks */
+}ota_writer_t;
+
+/**
+ * @brief Starts an update of the partition next to the running one.
+ */
+esp_err_t ota_writer_begin(ota_writer_t* writer, size_t image_size);
+
+/**
+ * @brief Continues an update stopped at a checkpoint.
+ * @param written the offset of the checkpoint, a sector boundary.
+ * @param sha the hash state at the checkpoint.
+ * @return ESP_ERR_INVALID_ARG if the checkpoint is not for the update partition.
+ */
+esp_err_t ota_writer_resume(ota_writer_t* writer, uint32_t address, size_t image_size, size_t written,
+		const mbedtls_sha256_context* sha);
+
+esp_err_t ota_writer_write(ota_writer_t* writer, const void* data, size_t len);
+
+/**
+ * @brief Erases the next sector not yet erased, if it is within sectors of the written end of the image.
+ * Meant for the time the writer waits for data, so that ota_writer_write() finds the sectors erased.
+ * @return true if a sector was erased.
+ */
+bool ota_writer_erase_ahead(ota_writer_t* writer, size_t sectors);
+
+/**
+ * @brief Ends the update, the partition is booted next if the image is valid.
+ * @param sha256 if not NULL, the expected SHA-256 of the image, checked before the partition is selected.
+ * @return ESP_OK, ESP_ERR_INVALID_CRC on a hash mismatch, ESP_ERR_INVALID_SIZE if the image is incomplete,
+ * or the error of esp_ota_set_boot_partition().
+ */
+esp_err_t ota_writer_finish(ota_writer_t* writer, const uint8_t* sha256);
+
+/**
+ * @brief Gives up the update, the boot partition is unchanged.
+ * The writer has to be begun again before it is used.
+ */
+void ota_writer_abort(ota_writer_t* writer);
+
+#ifdef __cplusplus
+}
+
+#endif
+
+/**@}*/
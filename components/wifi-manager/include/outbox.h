@@ -0,0 +1,81 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+
+#include "http_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Outbox state, kept in the storage partition with the records.
+ */
+typedef struct _outbox_stats_t {
+	uint32_t	records;	/* waiting for replay */
+	uint32_t	bytes;		/* size of the waiting records */
+	uint32_t	dropped;	/* records lost to the drop policy or the replay limit since the outbox was created */
+}outbox_stats_t;
+
+/**
+ * @brief Loads the outbox state, the storage partition must be mounted.
+ */
+esp_err_t outbox_init();
+
+/**
+ * @brief Persists a request as the newest record.
+ * When the outbox is full the oldest record or the new one is dropped, depending on the configured policy.
+ * @return ESP_OK, ESP_ERR_NO_MEM if the record was dropped, ESP_FAIL on a file error.
+ */
+esp_err_t outbox_push(uint16_t method, const char* uri, const char* data, size_t data_len);
+
+/**
+ * @brief Reads the oldest record without removing it.
+ * @param number set to the number of the record, to remove it with outbox_remove().
+ * @return a request allocated as one block, to be freed by the caller, NULL if the outbox is empty.
+ */
+http_client_request_t* outbox_peek(uint32_t* number);
+
+/**
+ * @brief Removes the record read by outbox_peek(), if the drop policy did not remove it meanwhile.
+ */
+void outbox_remove(uint32_t number);
+
+/**
+ * @brief Counts a failed replay of the record read by outbox_peek(), it stays the oldest record.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if it failed CONFIG_HTTP_CLIENT_OUTBOX_MAX_REPLAYS replays
+ * and was dropped, ESP_ERR_NOT_FOUND if the drop policy removed it meanwhile.
+ */
+esp_err_t outbox_replay_failed(uint32_t number);
+
+void outbox_get_stats(outbox_stats_t* stats);
+
+#ifdef __cplusplus
+}
+
+#endif
+
+/**@}*/
@@ -215,6 +215,16 @@ esp_err_t wifi_manager_save_http_crt(const char* json_string);
  */
 esp_err_t wifi_manager_save_http_key(const char* json_string);
 
+/**
+ * @brief saves all configuration sections at once.
+ * The json object holds one member per setup endpoint (wifi_setup, ipv4_setup, http_setup,
+ * wifi_ca, wifi_crt, wifi_key, client_ca, client_crt, client_key) with the document that endpoint accepts.
+ * The bundle is validated first, then committed as a single transaction: either all sections are
+ * replaced or none, even across a reset.
+ * @return ESP_ERR_INVALID_ARG if a section or a key is missing, ESP_OK in case of success.
+ */
+esp_err_t wifi_manager_save_config_bundle(const char* json_string);
+
 /**
  * @brief fetch a previously config in the flash ram storage.
  */
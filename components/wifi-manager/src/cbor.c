@@ -0,0 +1,539 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#include <sys/param.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "json_stream.h"
+#include "cbor.h"
+
+#define CBOR_UINT       0
+#define CBOR_NEGINT     1
+#define CBOR_BYTES      2
+#define CBOR_TEXT       3
+#define CBOR_ARRAY      4
+#define CBOR_MAP        5
+#define CBOR_TAG        6
+#define CBOR_SIMPLE     7
+
+#define CBOR_INDEFINITE 31
+#define CBOR_BREAK      0xFF
+
+/**
+ * @brief Decoder states.
+ */
+typedef enum cbor_state_t {
+    CBOR_STATE_HEADER = 0,  /* reading the head of an item */
+    CBOR_STATE_STRING = 1,  /* copying string bytes */
+    CBOR_STATE_DONE = 2,
+    CBOR_STATE_ERROR = 3
+}cbor_state_t;
+
+/* ----------------------------------------------------------------------------------------------------
+ * JSON to CBOR
+ */
+
+typedef struct _cbor_writer_t {
+    uint8_t*    out;
+    size_t      size;
+    size_t      len;
+    bool        failed;
+}cbor_writer_t;
+
+static void cbor_put(cbor_writer_t* writer, const void* data, size_t len) {
+    if (writer->failed || writer->len + len > writer->size) {
+        writer->failed = true;
+        return;
+    }
+    memcpy(writer->out + writer->len, data, len);
+    writer->len += len;
+}
+
+static void cbor_put_head(cbor_writer_t* writer, uint8_t major, uint64_t value) {
+    uint8_t head[9];
+    size_t len;
+
+    head[0] = major << 5;
+    if (value < 24) {
+        head[0] |= value;
+        len = 1;
+    }else if (value <= UINT8_MAX) {
+        head[0] |= 24;
+        len = 2;
+    }else if (value <= UINT16_MAX) {
+        head[0] |= 25;
+        len = 3;
+    }else if (value <= UINT32_MAX) {
+        head[0] |= 26;
+        len = 5;
+    }else {
+        head[0] |= 27;
+        len = 9;
+    }
+    for (size_t i = 1; i < len; i++) {
+        head[i] = (uint8_t)(value >> (8 * (len - 1 - i)));
+    }
+    cbor_put(writer, head, len);
+}
+
+static void cbor_put_number(cbor_writer_t* writer, const char* text) {
+    char* end;
+
+    if (strpbrk(text, ".eE") == NULL) {
+        errno = 0;
+        long long value = strtoll(text, &end, 10);
+        if (errno == 0 && *end == '\0') {
+            if (value >= 0) {
+                cbor_put_head(writer, CBOR_UINT, (uint64_t)value);
+            }else {
+                cbor_put_head(writer, CBOR_NEGINT, (uint64_t)(-1 - value));
+            }
+            return;
+        }
+    }
+
+    double value = strtod(text, &end);
+    float single = (float)value;
+    uint8_t buf[9];
+    if ((double)single == value) {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        buf[0] = (CBOR_SIMPLE << 5) | 26;
+        for (int i = 0; i < 4; i++) {
+            buf[1 + i] = (uint8_t)(bits >> (24 - 8 * i));
+        }
+        cbor_put(writer, buf, 5);
+    }else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        buf[0] = (CBOR_SIMPLE << 5) | 27;
+        for (int i = 0; i < 8; i++) {
+            buf[1 + i] = (uint8_t)(bits >> (56 - 8 * i));
+        }
+        cbor_put(writer, buf, 9);
+    }
+}
+
+static void cbor_json_cb(const json_stream_token_t* token, void* arg) {
+    cbor_writer_t* writer = (cbor_writer_t*)arg;
+    uint8_t simple;
+
+    if (token->truncated) {
+        writer->failed = true;
+        return;
+    }
+    if (token->key && token->type != JSON_STREAM_OBJECT_END && token->type != JSON_STREAM_ARRAY_END) {
+        size_t key_len = strlen(token->key);
+        if (key_len >= JSON_STREAM_MAX_KEY - 1) {
+            /* the key may have been cut */
+            writer->failed = true;
+            return;
+        }
+        cbor_put_head(writer, CBOR_TEXT, key_len);
+        cbor_put(writer, token->key, key_len);
+    }
+    switch (token->type) {
+    case JSON_STREAM_OBJECT_START:
+        simple = (CBOR_MAP << 5) | CBOR_INDEFINITE;
+        cbor_put(writer, &simple, 1);
+        break;
+    case JSON_STREAM_ARRAY_START:
+        simple = (CBOR_ARRAY << 5) | CBOR_INDEFINITE;
+        cbor_put(writer, &simple, 1);
+        break;
+    case JSON_STREAM_OBJECT_END:
+    case JSON_STREAM_ARRAY_END:
+        simple = CBOR_BREAK;
+        cbor_put(writer, &simple, 1);
+        break;
+    case JSON_STREAM_STRING:
+        cbor_put_head(writer, CBOR_TEXT, token->len);
+        cbor_put(writer, token->value, token->len);
+        break;
+    case JSON_STREAM_NUMBER:
+        cbor_put_number(writer, token->value);
+        break;
+    case JSON_STREAM_FALSE:
+        cbor_put_head(writer, CBOR_SIMPLE, 20);
+        break;
+    case JSON_STREAM_TRUE:
+        cbor_put_head(writer, CBOR_SIMPLE, 21);
+        break;
+    default:
+        cbor_put_head(writer, CBOR_SIMPLE, 22);
+        break;
+    }
+}
+
+size_t cbor_from_json(const char* json, size_t len, uint8_t* out, size_t out_size) {
+    cbor_writer_t writer = {
+        .out = out,
+        .size = out_size,
+        .len = 0,
+        .failed = false,
+    };
+    /* a few hundred bytes, too many for the stack of the send tasks */
+    json_stream_t* js = (json_stream_t*)calloc(1, sizeof(json_stream_t));
+
+    if (js == NULL) {
+        return 0;
+    }
+    json_stream_init(js, cbor_json_cb, &writer);
+    if (json_stream_feed(js, json, len) != ESP_OK || json_stream_finish(js) != ESP_OK) {
+        writer.failed = true;
+    }
+    free(js);
+    return (writer.failed) ? 0 : writer.len;
+}
+
+/* ----------------------------------------------------------------------------------------------------
+ * CBOR to JSON
+ */
+
+static void cbor_emit(cbor_decoder_t* decoder, const char* text, size_t len) {
+    while (len) {
+        size_t copy = MIN(len, CBOR_OUTPUT_LEN - decoder->out_len);
+        memcpy(decoder->out + decoder->out_len, text, copy);
+        decoder->out_len += copy;
+        text += copy;
+        len -= copy;
+        if (decoder->out_len == CBOR_OUTPUT_LEN) {
+            decoder->sink(decoder->out, decoder->out_len, decoder->arg);
+            decoder->out_len = 0;
+        }
+    }
+}
+
+static void cbor_emit_char(cbor_decoder_t* decoder, char c) {
+    cbor_emit(decoder, &c, 1);
+}
+
+static void cbor_emit_text(cbor_decoder_t* decoder, const uint8_t* data, size_t len) {
+    char escaped[7];
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)data[i];
+        if (c == '"' || c == '\\') {
+            cbor_emit_char(decoder, '\\');
+            cbor_emit_char(decoder, c);
+        }else if ((uint8_t)c < 0x20) {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8_t)c);
+            cbor_emit(decoder, escaped, 6);
+        }else {
+            cbor_emit_char(decoder, c);
+        }
+    }
+}
+
+static void cbor_emit_bytes(cbor_decoder_t* decoder, const uint8_t* data, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        cbor_emit_char(decoder, hex[data[i] >> 4]);
+        cbor_emit_char(decoder, hex[data[i] & 0x0F]);
+    }
+}
+
+static void cbor_emit_u64(cbor_decoder_t* decoder, uint64_t value) {
+    char text[21];
+    int pos = sizeof(text);
+    do {
+        text[--pos] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    cbor_emit(decoder, text + pos, sizeof(text) - pos);
+}
+
+static void cbor_emit_double(cbor_decoder_t* decoder, double value, bool single) {
+    char text[32];
+    if (isnan(value) || isinf(value)) {
+        cbor_emit(decoder, "null", 4);
+        return;
+    }
+    int len = snprintf(text, sizeof(text), single ? "%.9g" : "%.17g", value);
+    cbor_emit(decoder, text, len);
+}
+
+static double cbor_half(uint16_t half) {
+    int exponent = (half >> 10) & 0x1F;
+    int mantissa = half & 0x3FF;
+    double value;
+
+    if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+    }else if (exponent != 31) {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    }else {
+        value = (mantissa == 0) ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+/**
+ * @brief writes the separator before a new item and tells whether the item is a map key.
+ */
+static bool cbor_begin_item(cbor_decoder_t* decoder) {
+    if (decoder->depth == 0) {
+        return false;
+    }
+    cbor_frame_t* frame = &decoder->frames[decoder->depth - 1];
+    if (frame->map && (frame->index & 1)) {
+        cbor_emit_char(decoder, ':');
+        return false;
+    }
+    if (frame->index) {
+        cbor_emit_char(decoder, ',');
+    }
+    return frame->map;
+}
+
+/**
+ * @brief counts a finished item, closing the definite containers it completes.
+ */
+static void cbor_end_item(cbor_decoder_t* decoder) {
+    while (decoder->depth) {
+        cbor_frame_t* frame = &decoder->frames[decoder->depth - 1];
+        frame->index++;
+        if (frame->indefinite || frame->index < frame->count) {
+            return;
+        }
+        cbor_emit_char(decoder, frame->map ? '}' : ']');
+        decoder->depth--;
+    }
+    decoder->state = CBOR_STATE_DONE;
+}
+
+static bool cbor_open(cbor_decoder_t* decoder, bool map, bool indefinite, uint64_t count) {
+    if (decoder->depth >= CBOR_MAX_DEPTH || (map && count > UINT32_MAX / 2) || count > UINT32_MAX) {
+        return false;
+    }
+    cbor_frame_t* frame = &decoder->frames[decoder->depth++];
+    frame->map = map;
+    frame->indefinite = indefinite;
+    frame->count = (map) ? count * 2 : count;
+    frame->index = 0;
+    cbor_emit_char(decoder, map ? '{' : '[');
+    if (!indefinite && count == 0) {
+        cbor_emit_char(decoder, map ? '}' : ']');
+        decoder->depth--;
+        cbor_end_item(decoder);
+    }
+    return true;
+}
+
+static bool cbor_break(cbor_decoder_t* decoder) {
+    if (decoder->string_chunks) {
+        decoder->string_chunks = false;
+        cbor_emit_char(decoder, '"');
+        cbor_end_item(decoder);
+        return true;
+    }
+    if (decoder->depth == 0) {
+        return false;
+    }
+    cbor_frame_t* frame = &decoder->frames[decoder->depth - 1];
+    if (!frame->indefinite || (frame->map && (frame->index & 1))) {
+        return false;
+    }
+    cbor_emit_char(decoder, frame->map ? '}' : ']');
+    decoder->depth--;
+    cbor_end_item(decoder);
+    return true;
+}
+
+/**
+ * @brief processes a complete item head.
+ * @return false on malformed or unsupported input
+ */
+static bool cbor_head(cbor_decoder_t* decoder) {
+    uint8_t major = decoder->header[0] >> 5;
+    uint8_t info = decoder->header[0] & 0x1F;
+    uint64_t value = info;
+
+    if (decoder->header[0] == CBOR_BREAK) {
+        return cbor_break(decoder);
+    }
+    if (info >= 24 && info <= 27) {
+        value = 0;
+        for (int i = 1; i < decoder->header_need; i++) {
+            value = (value << 8) | decoder->header[i];
+        }
+    }else if (info > 27 && (info != CBOR_INDEFINITE || major < CBOR_BYTES || major == CBOR_TAG)) {
+        return false;
+    }
+
+    if (decoder->string_chunks) {
+        /* only definite strings of the same type inside an indefinite one */
+        if (major != decoder->string_major || info == CBOR_INDEFINITE) {
+            return false;
+        }
+        decoder->remaining = value;
+        decoder->state = (value) ? CBOR_STATE_STRING : CBOR_STATE_HEADER;
+        return true;
+    }
+    if (major == CBOR_TAG) {
+        /* the tagged item follows, the tag is dropped */
+        return true;
+    }
+
+    bool key = cbor_begin_item(decoder);
+    if (key && major != CBOR_TEXT && major != CBOR_UINT && major != CBOR_NEGINT) {
+        return false;
+    }
+    decoder->quote = key && major != CBOR_TEXT;
+
+    switch (major) {
+    case CBOR_UINT:
+    case CBOR_NEGINT:
+        if (decoder->quote) cbor_emit_char(decoder, '"');
+        if (major == CBOR_NEGINT) {
+            /* -1 - value, without overflow for the largest value */
+            cbor_emit_char(decoder, '-');
+            if (value == UINT64_MAX) {
+                cbor_emit(decoder, "18446744073709551616", 20);
+            }else {
+                cbor_emit_u64(decoder, value + 1);
+            }
+        }else {
+            cbor_emit_u64(decoder, value);
+        }
+        if (decoder->quote) cbor_emit_char(decoder, '"');
+        cbor_end_item(decoder);
+        return true;
+    case CBOR_BYTES:
+    case CBOR_TEXT:
+        cbor_emit_char(decoder, '"');
+        decoder->string_major = major;
+        if (info == CBOR_INDEFINITE) {
+            decoder->string_chunks = true;
+        }else if (value) {
+            decoder->remaining = value;
+            decoder->state = CBOR_STATE_STRING;
+        }else {
+            cbor_emit_char(decoder, '"');
+            cbor_end_item(decoder);
+        }
+        return true;
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+        return cbor_open(decoder, major == CBOR_MAP, info == CBOR_INDEFINITE, value);
+    default:
+        break;
+    }
+
+    /* simple values and floats */
+    switch (info) {
+    case 20:
+        cbor_emit(decoder, "false", 5);
+        break;
+    case 21:
+        cbor_emit(decoder, "true", 4);
+        break;
+    case 25:
+        cbor_emit_double(decoder, cbor_half((uint16_t)value), true);
+        break;
+    case 26: {
+        uint32_t bits = (uint32_t)value;
+        float single;
+        memcpy(&single, &bits, sizeof(single));
+        cbor_emit_double(decoder, single, true);
+        break;
+    }
+    case 27: {
+        double number;
+        memcpy(&number, &value, sizeof(number));
+        cbor_emit_double(decoder, number, false);
+        break;
+    }
+    default:
+        /* null, undefined and the other simple values */
+        cbor_emit(decoder, "null", 4);
+        break;
+    }
+    cbor_end_item(decoder);
+    return true;
+}
+
+void cbor_decoder_init(cbor_decoder_t* decoder, cbor_sink_t sink, void* arg) {
+    memset(decoder, 0x00, sizeof(cbor_decoder_t));
+    decoder->state = CBOR_STATE_HEADER;
+    decoder->sink = sink;
+    decoder->arg = arg;
+}
+
+esp_err_t cbor_decoder_feed(cbor_decoder_t* decoder, const uint8_t* data, size_t len) {
+    size_t i = 0;
+
+    while (i < len && decoder->state != CBOR_STATE_ERROR) {
+        if (decoder->state == CBOR_STATE_STRING) {
+            size_t copy = (size_t)MIN((uint64_t)(len - i), decoder->remaining);
+            if (decoder->string_major == CBOR_TEXT) {
+                cbor_emit_text(decoder, data + i, copy);
+            }else {
+                cbor_emit_bytes(decoder, data + i, copy);
+            }
+            i += copy;
+            decoder->remaining -= copy;
+            if (decoder->remaining == 0) {
+                decoder->state = CBOR_STATE_HEADER;
+                if (!decoder->string_chunks) {
+                    cbor_emit_char(decoder, '"');
+                    cbor_end_item(decoder);
+                }
+            }
+            continue;
+        }
+        if (decoder->state == CBOR_STATE_DONE) {
+            /* one data item per document */
+            decoder->state = CBOR_STATE_ERROR;
+            break;
+        }
+
+        uint8_t c = data[i++];
+        if (decoder->header_len == 0) {
+            uint8_t info = c & 0x1F;
+            decoder->header_need = 1 + ((info >= 24 && info <= 27) ? (1 << (info - 24)) : 0);
+        }
+        decoder->header[decoder->header_len++] = c;
+        if (decoder->header_len == decoder->header_need) {
+            decoder->header_len = 0;
+            if (!cbor_head(decoder)) {
+                decoder->state = CBOR_STATE_ERROR;
+            }
+        }
+    }
+    if (decoder->out_len) {
+        decoder->sink(decoder->out, decoder->out_len, decoder->arg);
+        decoder->out_len = 0;
+    }
+    return (decoder->state == CBOR_STATE_ERROR) ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t cbor_decoder_finish(cbor_decoder_t* decoder) {
+    if (decoder->out_len) {
+        decoder->sink(decoder->out, decoder->out_len, decoder->arg);
+        decoder->out_len = 0;
+    }
+    return (decoder->state == CBOR_STATE_DONE) ? ESP_OK : ESP_FAIL;
+}
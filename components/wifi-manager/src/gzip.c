@@ -0,0 +1,612 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#include <sys/param.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "gzip.h"
+
+#define GZIP_MIN_MATCH      3
+#define GZIP_MAX_MATCH      258
+#define GZIP_HASH_SIZE      (1 << CONFIG_GZIP_HASH_BITS)
+
+/**
+ * @brief bit writer of the deflate stream, bits are packed from the least significant one.
+ */
+typedef struct _gzip_bits_t {
+    uint8_t*    out;
+    size_t      size;
+    size_t      pos;
+    uint32_t    acc;
+    uint8_t     count;
+    bool        overflow;
+}gzip_bits_t;
+
+/* base lengths and extra bits of the length codes 257..285 */
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+/* base distances and extra bits of the distance codes 0..29 */
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+uint32_t gzip_crc32(uint32_t crc, const uint8_t* data, size_t len) {
+    /* half byte table, 64 bytes of flash instead of 1 KB */
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+/* the compressor, its window and hash table are configured with the request compression */
+static void gzip_put_bits(gzip_bits_t* bits, uint32_t value, uint8_t count) {
+    bits->acc |= value << bits->count;
+    bits->count += count;
+    while (bits->count >= 8) {
+        if (bits->pos < bits->size) {
+            bits->out[bits->pos++] = (uint8_t)bits->acc;
+        }else {
+            bits->overflow = true;
+        }
+        bits->acc >>= 8;
+        bits->count -= 8;
+    }
+}
+
+/* @brief Huffman codes are sent from the most significant bit */
+static void gzip_put_code(gzip_bits_t* bits, uint32_t code, uint8_t count) {
+    uint32_t reversed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    gzip_put_bits(bits, reversed, count);
+}
+
+/* @brief symbol 0..287 of the fixed literal/length code */
+static void gzip_put_symbol(gzip_bits_t* bits, uint16_t symbol) {
+    if (symbol < 144) {
+        gzip_put_code(bits, 0x30 + symbol, 8);
+    }else if (symbol < 256) {
+        gzip_put_code(bits, 0x190 + symbol - 144, 9);
+    }else if (symbol < 280) {
+        gzip_put_code(bits, symbol - 256, 7);
+    }else {
+        gzip_put_code(bits, 0xC0 + symbol - 280, 8);
+    }
+}
+
+static void gzip_put_match(gzip_bits_t* bits, uint16_t length, uint16_t distance) {
+    uint8_t code = 0;
+    while (code < 28 && length_base[code + 1] <= length) {
+        code++;
+    }
+    gzip_put_symbol(bits, 257 + code);
+    gzip_put_bits(bits, length - length_base[code], length_extra[code]);
+
+    code = 0;
+    while (code < 29 && dist_base[code + 1] <= distance) {
+        code++;
+    }
+    gzip_put_code(bits, code, 5);
+    gzip_put_bits(bits, distance - dist_base[code], dist_extra[code]);
+}
+
+static uint16_t gzip_hash(const uint8_t* p) {
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (uint16_t)((v * 2654435761U) >> (32 - CONFIG_GZIP_HASH_BITS));
+}
+
+static void gzip_put_u32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+size_t gzip_compress(const uint8_t* data, size_t len, uint8_t* out, size_t out_size) {
+    /* positions + 1, 0 for none; on the heap, the send tasks have small stacks */
+    uint16_t* head;
+    gzip_bits_t bits = {0};
+    size_t pos = 0;
+
+    if (len > UINT16_MAX - 1 || out_size < GZIP_HEADER_LEN + GZIP_TRAILER_LEN + 2) {
+        return 0;
+    }
+    head = (uint16_t*)calloc(GZIP_HASH_SIZE, sizeof(uint16_t));
+    if (head == NULL) {
+        return 0;
+    }
+
+    /* magic, deflate, no flags, no time, no extra flags, unknown OS */
+    static const uint8_t header[GZIP_HEADER_LEN] = {0x1f, 0x8b, 0x08, 0, 0, 0, 0, 0, 0, 0xff};
+    memcpy(out, header, GZIP_HEADER_LEN);
+    bits.out = out + GZIP_HEADER_LEN;
+    bits.size = out_size - GZIP_HEADER_LEN - GZIP_TRAILER_LEN;
+
+    /* last block, fixed Huffman codes */
+    gzip_put_bits(&bits, 0x03, 3);
+    while (pos < len && !bits.overflow) {
+        uint16_t length = 0;
+        size_t distance = 0;
+        if (pos + GZIP_MIN_MATCH <= len) {
+            uint16_t hash = gzip_hash(data + pos);
+            size_t candidate = head[hash];
+            head[hash] = pos + 1;
+            if (candidate) {
+                candidate--;
+                distance = pos - candidate;
+                if (distance <= CONFIG_GZIP_WINDOW_SIZE) {
+                    size_t max = MIN(len - pos, GZIP_MAX_MATCH);
+                    while (length < max && data[candidate + length] == data[pos + length]) {
+                        length++;
+                    }
+                }
+            }
+        }
+        if (length >= GZIP_MIN_MATCH) {
+            gzip_put_match(&bits, length, distance);
+            /* index the matched bytes too, later data often repeats from inside a match */
+            for (size_t i = pos + 1; i < pos + length && i + GZIP_MIN_MATCH <= len; i++) {
+                head[gzip_hash(data + i)] = i + 1;
+            }
+            pos += length;
+        }else {
+            gzip_put_symbol(&bits, data[pos]);
+            pos++;
+        }
+    }
+    gzip_put_symbol(&bits, 256);
+    gzip_put_bits(&bits, 0, 7);     /* flush the last byte */
+    free(head);
+    if (bits.overflow) {
+        return 0;
+    }
+
+    size_t size = GZIP_HEADER_LEN + bits.pos;
+    gzip_put_u32(out + size, gzip_crc32(0, data, len));
+    gzip_put_u32(out + size + 4, len);
+    return size + GZIP_TRAILER_LEN;
+}
+#endif
+
+/**
+ * @brief Decompressor states, the next step of the stream.
+ */
+typedef enum gzip_inflate_state_t {
+    GZ_HEADER = 0,
+    GZ_BLOCK = 1,       /* block header */
+    GZ_STORED_LEN = 2,
+    GZ_STORED = 3,
+    GZ_DYNAMIC = 4,     /* counts of the dynamic header */
+    GZ_CODE_LENS = 5,   /* lengths of the code length code */
+    GZ_LENS = 6,        /* literal/length and distance code lengths */
+    GZ_CODES = 7,
+    GZ_TRAILER = 8,
+    GZ_DONE = 9,
+    GZ_ERROR = 10
+}gzip_inflate_state_t;
+
+/**
+ * @brief Result of one step: steps take their bits only if they complete.
+ */
+typedef enum gzip_step_t {
+    GZ_STEP_OK = 0,
+    GZ_STEP_MORE = 1,   /* the input ended inside the step */
+    GZ_STEP_ERROR = 2
+}gzip_step_t;
+
+/* order of the code length code lengths */
+static const uint8_t clen_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+#define ADLER_BASE  65521
+
+/* input of the call being processed */
+typedef struct _gzip_input_t {
+    const uint8_t*  data;
+    size_t          len;
+    size_t          pos;
+}gzip_input_t;
+
+/* @brief the next n bits of the step, the input is moved into the bit buffer as needed */
+static bool gzip_bits(gzip_inflate_t* gz, gzip_input_t* in, uint8_t n, uint32_t* value) {
+    while (gz->count < gz->used + n) {
+        if (in->pos == in->len) {
+            return false;
+        }
+        gz->buffer |= (uint64_t)in->data[in->pos++] << gz->count;
+        gz->count += 8;
+    }
+    *value = (uint32_t)(gz->buffer >> gz->used) & ((1UL << n) - 1);
+    gz->used += n;
+    return true;
+}
+
+/* @brief takes the bits of a completed step */
+static void gzip_commit(gzip_inflate_t* gz) {
+    gz->buffer >>= gz->used;
+    gz->count -= gz->used;
+    gz->used = 0;
+}
+
+/* @brief canonical Huffman table from code lengths, false if the lengths are over-subscribed */
+static bool gzip_build(uint16_t* count, uint16_t* symbol, const uint8_t* lens, uint16_t n) {
+    uint16_t offs[16];
+    int left = 1;
+
+    memset(count, 0x00, 16 * sizeof(uint16_t));
+    for (uint16_t i = 0; i < n; i++) {
+        count[lens[i]]++;
+    }
+    for (int len = 1; len < 16; len++) {
+        left = (left << 1) - count[len];
+        if (left < 0) {
+            return false;
+        }
+    }
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++) {
+        offs[len + 1] = offs[len] + count[len];
+    }
+    for (uint16_t i = 0; i < n; i++) {
+        if (lens[i]) {
+            symbol[offs[lens[i]]++] = i;
+        }
+    }
+    return true;
+}
+
+/* @brief decodes one symbol, -1 if the input ended, -2 if the code is not in the table */
+static int gzip_decode(gzip_inflate_t* gz, gzip_input_t* in, const uint16_t* count, const uint16_t* symbol) {
+    int code = 0, first = 0, index = 0;
+    uint32_t bit;
+
+    for (int len = 1; len < 16; len++) {
+        if (!gzip_bits(gz, in, 1, &bit)) {
+            return -1;
+        }
+        code |= bit;
+        if (code - count[len] < first) {
+            return symbol[index + (code - first)];
+        }
+        index += count[len];
+        first += count[len];
+        first <<= 1;
+        code <<= 1;
+    }
+    return -2;
+}
+
+static void gzip_flush(gzip_inflate_t* gz) {
+    const uint8_t* p = gz->window + gz->flushed;
+    size_t len = gz->pos - gz->flushed;
+    uint32_t a = gz->adler & 0xFFFF, b = gz->adler >> 16;
+
+    if (len == 0) {
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        a += p[i];
+        if (a >= ADLER_BASE) a -= ADLER_BASE;
+        b += a;
+        if (b >= ADLER_BASE) b -= ADLER_BASE;
+    }
+    gz->adler = (b << 16) | a;
+    if (gz->err == ESP_OK) {
+        gz->err = gz->out(gz->arg, p, len);
+    }
+    gz->flushed = gz->pos;
+}
+
+static void gzip_put(gzip_inflate_t* gz, uint8_t c) {
+    gz->window[gz->pos++] = c;
+    gz->total++;
+    if (gz->pos == (1UL << gz->window_bits)) {
+        gzip_flush(gz);
+        gz->pos = 0;
+        gz->flushed = 0;
+    }
+}
+
+static void gzip_fixed(gzip_inflate_t* gz) {
+    for (int i = 0; i < 288; i++) {
+        gz->lens[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+    }
+    for (int i = 0; i < 30; i++) {
+        gz->lens[288 + i] = 5;
+    }
+    gzip_build(gz->lit_count, gz->lit_symbol, gz->lens, 288);
+    gzip_build(gz->dist_count, gz->dist_symbol, gz->lens + 288, 30);
+}
+
+/* @brief one literal or match */
+static gzip_step_t gzip_code(gzip_inflate_t* gz, gzip_input_t* in) {
+    uint32_t extra;
+    int symbol = gzip_decode(gz, in, gz->lit_count, gz->lit_symbol);
+
+    if (symbol < 0) {
+        return (symbol == -1) ? GZ_STEP_MORE : GZ_STEP_ERROR;
+    }
+    if (symbol < 256) {
+        gzip_commit(gz);
+        gzip_put(gz, (uint8_t)symbol);
+        return GZ_STEP_OK;
+    }
+    if (symbol == 256) {
+        gzip_commit(gz);
+        gz->state = (gz->last) ? GZ_TRAILER : GZ_BLOCK;
+        return GZ_STEP_OK;
+    }
+    symbol -= 257;
+    if (symbol >= 29) {
+        return GZ_STEP_ERROR;
+    }
+    if (!gzip_bits(gz, in, length_extra[symbol], &extra)) {
+        return GZ_STEP_MORE;
+    }
+    uint16_t length = length_base[symbol] + extra;
+    symbol = gzip_decode(gz, in, gz->dist_count, gz->dist_symbol);
+    if (symbol < 0) {
+        return (symbol == -1) ? GZ_STEP_MORE : GZ_STEP_ERROR;
+    }
+    if (symbol >= 30 || !gzip_bits(gz, in, dist_extra[symbol], &extra)) {
+        return (symbol >= 30) ? GZ_STEP_ERROR : GZ_STEP_MORE;
+    }
+    uint32_t distance = dist_base[symbol] + extra;
+    if (distance > (1UL << gz->window_bits) || distance > gz->total) {
+        return GZ_STEP_ERROR;
+    }
+    gzip_commit(gz);
+    uint32_t mask = (1UL << gz->window_bits) - 1;
+    while (length--) {
+        gzip_put(gz, gz->window[(gz->pos - distance) & mask]);
+    }
+    return GZ_STEP_OK;
+}
+
+/* @brief one code length of the dynamic header, with its repeats */
+static gzip_step_t gzip_code_len(gzip_inflate_t* gz, gzip_input_t* in) {
+    uint32_t extra;
+    uint8_t value = 0;
+    uint16_t repeat;
+    int symbol = gzip_decode(gz, in, gz->lit_count, gz->lit_symbol);
+
+    if (symbol < 0) {
+        return (symbol == -1) ? GZ_STEP_MORE : GZ_STEP_ERROR;
+    }
+    if (symbol < 16) {
+        value = symbol;
+        repeat = 1;
+    }else if (symbol == 16) {
+        if (gz->index == 0) {
+            return GZ_STEP_ERROR;
+        }
+        value = gz->lens[gz->index - 1];
+        if (!gzip_bits(gz, in, 2, &extra)) {
+            return GZ_STEP_MORE;
+        }
+        repeat = 3 + extra;
+    }else {
+        if (!gzip_bits(gz, in, (symbol == 17) ? 3 : 7, &extra)) {
+            return GZ_STEP_MORE;
+        }
+        repeat = ((symbol == 17) ? 3 : 11) + extra;
+    }
+    if (gz->index + repeat > gz->hlit + gz->hdist) {
+        return GZ_STEP_ERROR;
+    }
+    gzip_commit(gz);
+    while (repeat--) {
+        gz->lens[gz->index++] = value;
+    }
+    if (gz->index == gz->hlit + gz->hdist) {
+        if (gz->lens[256] == 0 ||
+                !gzip_build(gz->lit_count, gz->lit_symbol, gz->lens, gz->hlit) ||
+                !gzip_build(gz->dist_count, gz->dist_symbol, gz->lens + gz->hlit, gz->hdist)) {
+            return GZ_STEP_ERROR;
+        }
+        gz->state = GZ_CODES;
+    }
+    return GZ_STEP_OK;
+}
+
+static gzip_step_t gzip_step(gzip_inflate_t* gz, gzip_input_t* in) {
+    uint32_t a, b, c, d;
+
+    switch (gz->state) {
+    case GZ_HEADER:
+        if (!gzip_bits(gz, in, 8, &a) || !gzip_bits(gz, in, 8, &b)) {
+            return GZ_STEP_MORE;
+        }
+        /* deflate, the window fits, no preset dictionary */
+        if ((a & 0x0F) != 8 || ((a << 8) | b) % 31 || (a >> 4) + 8 > gz->window_bits || (b & 0x20)) {
+            return GZ_STEP_ERROR;
+        }
+        gzip_commit(gz);
+        gz->state = GZ_BLOCK;
+        return GZ_STEP_OK;
+    case GZ_BLOCK:
+        if (!gzip_bits(gz, in, 1, &a) || !gzip_bits(gz, in, 2, &b)) {
+            return GZ_STEP_MORE;
+        }
+        if (b == 3) {
+            return GZ_STEP_ERROR;
+        }
+        gzip_commit(gz);
+        gz->last = a;
+        if (b == 0) {
+            gz->state = GZ_STORED_LEN;
+        }else if (b == 1) {
+            gzip_fixed(gz);
+            gz->state = GZ_CODES;
+        }else {
+            gz->state = GZ_DYNAMIC;
+        }
+        return GZ_STEP_OK;
+    case GZ_STORED_LEN:
+        /* from the next byte boundary */
+        gz->used = gz->count & 7;
+        if (!gzip_bits(gz, in, 16, &a) || !gzip_bits(gz, in, 16, &b)) {
+            return GZ_STEP_MORE;
+        }
+        if (a != (~b & 0xFFFF)) {
+            return GZ_STEP_ERROR;
+        }
+        gzip_commit(gz);
+        gz->stored = a;
+        gz->state = (a) ? GZ_STORED : (gz->last) ? GZ_TRAILER : GZ_BLOCK;
+        return GZ_STEP_OK;
+    case GZ_STORED:
+        if (!gzip_bits(gz, in, 8, &a)) {
+            return GZ_STEP_MORE;
+        }
+        gzip_commit(gz);
+        gzip_put(gz, (uint8_t)a);
+        if (--gz->stored == 0) {
+            gz->state = (gz->last) ? GZ_TRAILER : GZ_BLOCK;
+        }
+        return GZ_STEP_OK;
+    case GZ_DYNAMIC:
+        if (!gzip_bits(gz, in, 5, &a) || !gzip_bits(gz, in, 5, &b) || !gzip_bits(gz, in, 4, &c)) {
+            return GZ_STEP_MORE;
+        }
+        if (a + 257 > 286 || b + 1 > 30) {
+            return GZ_STEP_ERROR;
+        }
+        gzip_commit(gz);
+        gz->hlit = a + 257;
+        gz->hdist = b + 1;
+        gz->hclen = c + 4;
+        gz->index = 0;
+        memset(gz->lens, 0x00, 19);
+        gz->state = GZ_CODE_LENS;
+        return GZ_STEP_OK;
+    case GZ_CODE_LENS:
+        if (!gzip_bits(gz, in, 3, &a)) {
+            return GZ_STEP_MORE;
+        }
+        gzip_commit(gz);
+        gz->lens[clen_order[gz->index++]] = a;
+        if (gz->index == gz->hclen) {
+            /* the code length code is decoded with the literal table */
+            if (!gzip_build(gz->lit_count, gz->lit_symbol, gz->lens, 19)) {
+                return GZ_STEP_ERROR;
+            }
+            gz->index = 0;
+            gz->state = GZ_LENS;
+        }
+        return GZ_STEP_OK;
+    case GZ_LENS:
+        return gzip_code_len(gz, in);
+    case GZ_CODES:
+        return gzip_code(gz, in);
+    case GZ_TRAILER:
+        gz->used = gz->count & 7;
+        if (!gzip_bits(gz, in, 8, &a) || !gzip_bits(gz, in, 8, &b) ||
+                !gzip_bits(gz, in, 8, &c) || !gzip_bits(gz, in, 8, &d)) {
+            return GZ_STEP_MORE;
+        }
+        gzip_commit(gz);
+        gzip_flush(gz);
+        if (((a << 24) | (b << 16) | (c << 8) | d) != gz->adler) {
+            return GZ_STEP_ERROR;
+        }
+        gz->state = GZ_DONE;
+        return GZ_STEP_OK;
+    default:
+        /* nothing may follow the trailer */
+        return GZ_STEP_ERROR;
+    }
+}
+
+bool gzip_inflate_is_zlib(const uint8_t* data, size_t len) {
+    return len >= 2 && (data[0] & 0x0F) == 8 && (data[0] >> 4) <= 7 && ((data[0] << 8) | data[1]) % 31 == 0;
+}
+
+esp_err_t gzip_inflate_init(gzip_inflate_t* gz, uint8_t window_bits, gzip_inflate_out_t out, void* arg) {
+    memset(gz, 0x00, sizeof(gzip_inflate_t));
+    gz->window_bits = MIN(window_bits, GZIP_INFLATE_MAX_WINDOW_BITS);
+    gz->window = (uint8_t*)malloc(1UL << gz->window_bits);
+    if (gz->window == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    gz->state = GZ_HEADER;
+    gz->adler = 1;
+    gz->out = out;
+    gz->arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t gzip_inflate_feed(gzip_inflate_t* gz, const uint8_t* data, size_t len) {
+    gzip_input_t in = {
+        .data = data,
+        .len = len,
+        .pos = 0,
+    };
+    gzip_step_t step = GZ_STEP_OK;
+
+    while (gz->state != GZ_ERROR && gz->err == ESP_OK && step == GZ_STEP_OK) {
+        if (gz->state == GZ_DONE && in.pos == in.len) {
+            break;
+        }
+        step = gzip_step(gz, &in);
+        if (step == GZ_STEP_ERROR) {
+            gz->state = GZ_ERROR;
+        }
+    }
+    /* an incomplete step is taken again with the next piece, its input is kept in the bit buffer */
+    gz->used = 0;
+    if (gz->state != GZ_DONE && gz->state != GZ_ERROR) {
+        gzip_flush(gz);
+    }
+    if (gz->err != ESP_OK) {
+        return gz->err;
+    }
+    return (gz->state == GZ_ERROR) ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t gzip_inflate_finish(gzip_inflate_t* gz) {
+    esp_err_t err = (gz->state == GZ_DONE) ? gz->err : ESP_ERR_INVALID_SIZE;
+    free(gz->window);
+    gz->window = NULL;
+    return err;
+}
@@ -35,7 +35,11 @@
 #include "esp_netif.h"
 #include <esp_vfs.h>
 #include <esp_http_server.h>
+#include <esp_timer.h>
 #include <cJSON.h>
+#ifdef CONFIG_HTTP_APP_RATE_LIMIT
+#include <lwip/sockets.h>
+#endif
 
 #include "manager.h"
 #include "http_app.h"
@@ -46,6 +50,9 @@ static const char TAG[] = "http_app";
 /* @brief the HTTP server handle */
 static httpd_handle_t httpd_handle = NULL;
 
+/* @brief route groups currently served, written by the wifi manager task and read by the httpd task */
+static volatile http_app_routes_t http_app_routes = HTTP_APP_ROUTES_ALL;
+
 /* function pointers to URI handlers that can be user made */
 esp_err_t (*custom_get_httpd_uri_handler)(httpd_req_t *r) = NULL;
 esp_err_t (*custom_post_httpd_uri_handler)(httpd_req_t *r) = NULL;
@@ -70,7 +77,12 @@ static char* http_client_key_url = NULL;
 static char* http_wifi_ca_url = NULL;
 static char* http_wifi_crt_url = NULL;
 static char* http_wifi_key_url = NULL;
+static char* http_setup_url = NULL;
+static char* http_status_url = NULL;
+static char* http_stats_url = NULL;
+static char* http_ui_upload_url = NULL;
 
+#ifndef CONFIG_HTTP_APP_UI_NO_EMBED
 /**
  * @brief embedded binary data.
  * @see file "component.mk"
@@ -78,6 +90,13 @@ static char* http_wifi_key_url = NULL;
  */
 extern const uint8_t index_html_start[] asm("_binary_index_html_start");
 extern const uint8_t index_html_end[] asm("_binary_index_html_end");
+
+#define EMBEDDED_ASSET(name)		(const char*)name##_start, (const char*)name##_end
+
+#ifdef CONFIG_HTTP_APP_UI_BUNDLE
+/* script, style sheet and favicon are inlined into the page */
+#define EMBEDDED_PART(name)			NULL, NULL
+#else
 extern const uint8_t favicon_ico_start[] asm("_binary_favicon_ico_start");
 extern const uint8_t favicon_ico_end[] asm("_binary_favicon_ico_end");
 extern const uint8_t style_css_start[] asm("_binary_style_css_start");
@@ -85,12 +104,34 @@ extern const uint8_t style_css_end[]   asm("_binary_style_css_end");
 extern const uint8_t code_js_start[] asm("_binary_code_js_start");
 extern const uint8_t code_js_end[] asm("_binary_code_js_end");
 
+#define EMBEDDED_PART(name)			EMBEDDED_ASSET(name)
+#endif
+#else
+#define EMBEDDED_ASSET(name)		NULL, NULL
+#define EMBEDDED_PART(name)			NULL, NULL
+#endif
+
+#ifdef CONFIG_HTTP_APP_UI_SPIFFS
+/* @brief directory of the web UI in the storage partition */
+#define UI_BASE_PATH				"/" CONFIG_STORE_MOUNT_POINT "/www"
+#define UI_MAX_PATH					(sizeof(UI_BASE_PATH) + 16)
+
+/* @brief stream files in pieces matching the lwIP send buffer, the POST context is used as buffer */
+#define UI_CHUNK_SIZE				MIN(SCRATCH_BUFSIZE, CONFIG_LWIP_TCP_SND_BUF_DEFAULT)
+#endif
+
+#ifdef CONFIG_HTTP_APP_UI_UPLOAD
+/* @brief the assets which can be replaced */
+static const char* ui_assets[] = {"index.html", "code.js", "style.css", "favicon.ico", NULL};
+#endif
+
 
 /* const httpd related values stored in ROM */
 const static char http_200_hdr[] = "200 OK";
 const static char http_302_hdr[] = "302 Found";
-// const static char http_400_hdr[] = "400 Bad Request";
+const static char http_400_hdr[] = "400 Bad Request";
 const static char http_404_hdr[] = "404 Not Found";
+const static char http_413_hdr[] = "413 Payload Too Large";
 const static char http_503_hdr[] = "503 Service Unavailable";
 const static char http_location_hdr[] = "Location";
 const static char http_content_type_html[] = "text/html";
@@ -103,6 +144,253 @@ const static char http_cache_control_cache[] = "public, max-age=31536000";
 const static char http_pragma_hdr[] = "Pragma";
 const static char http_pragma_no_cache[] = "no-cache";
 
+#ifdef CONFIG_HTTP_APP_RATE_LIMIT
+
+const static char http_429_hdr[] = "429 Too Many Requests";
+const static char http_retry_after_hdr[] = "Retry-After";
+const static char http_retry_after_value[] = "1";
+
+/* one token is worth 1000 milli-tokens, buckets refill by (rate * elapsed ms) milli-tokens */
+#define RATE_LIMIT_TOKEN					1000
+#define RATE_LIMIT_CLIENTS					CONFIG_HTTP_APP_RATE_LIMIT_CLIENTS
+
+/**
+ * @brief token bucket state of one client IP.
+ */
+typedef struct _http_app_client_t {
+	uint32_t	ip;
+	TickType_t	last_seen;
+	TickType_t	last_refill[HTTP_APP_ROUTE_CLASS_COUNT];
+	uint32_t	tokens[HTTP_APP_ROUTE_CLASS_COUNT];
+}http_app_client_t;
+
+/* refill rate (tokens per second) and bucket size of every route class */
+static const uint32_t rate_limit_per_sec[HTTP_APP_ROUTE_CLASS_COUNT] = {
+	CONFIG_HTTP_APP_RATE_STATIC_PER_SEC,
+	CONFIG_HTTP_APP_RATE_JSON_PER_SEC,
+	CONFIG_HTTP_APP_RATE_ACTION_PER_SEC
+};
+static const uint32_t rate_limit_burst[HTTP_APP_ROUTE_CLASS_COUNT] = {
+	CONFIG_HTTP_APP_RATE_STATIC_BURST,
+	CONFIG_HTTP_APP_RATE_JSON_BURST,
+	CONFIG_HTTP_APP_RATE_ACTION_BURST
+};
+
+/* @brief tracked clients. Handlers all run in the httpd task so no locking is needed */
+static http_app_client_t rate_limit_clients[RATE_LIMIT_CLIENTS];
+#endif
+
+/* @brief requests rejected by the rate limiter, per route class */
+static uint32_t http_app_rejected[HTTP_APP_ROUTE_CLASS_COUNT] = {0};
+
+
+#ifdef CONFIG_HTTP_APP_RATE_LIMIT
+/**
+ * @brief returns the IPv4 address of the peer, 0 if unknown.
+ */
+static uint32_t http_app_get_client_ip(httpd_req_t *req){
+	struct sockaddr_in6 addr;
+	socklen_t addr_len = sizeof(addr);
+	int sockfd = httpd_req_to_sockfd(req);
+
+	if(sockfd < 0 || getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) != 0){
+		return 0;
+	}
+	if(addr.sin6_family == AF_INET){
+		return ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
+	}
+	/* IPv4 mapped IPv6 address: the IPv4 part is the last 4 bytes */
+	uint32_t ip;
+	memcpy(&ip, ((uint8_t*)&addr.sin6_addr) + 12, sizeof(ip));
+	return ip;
+}
+
+/**
+ * @brief finds the buckets of a client, recycles the least recently seen slot for a new one.
+ */
+static http_app_client_t* http_app_get_client(uint32_t ip, TickType_t now){
+	http_app_client_t* lru = &rate_limit_clients[0];
+
+	for(int i=0; i<RATE_LIMIT_CLIENTS; i++){
+		http_app_client_t* c = &rate_limit_clients[i];
+		if(c->ip == ip && c->last_seen != 0){
+			return c;
+		}
+		if(c->last_seen == 0 || (lru->last_seen != 0 && (now - c->last_seen) > (now - lru->last_seen))){
+			lru = c;
+		}
+	}
+
+	/* new client: all buckets full */
+	lru->ip = ip;
+	for(int i=0; i<HTTP_APP_ROUTE_CLASS_COUNT; i++){
+		lru->tokens[i] = rate_limit_burst[i] * RATE_LIMIT_TOKEN;
+		lru->last_refill[i] = now;
+	}
+	return lru;
+}
+#endif
+
+/**
+ * @brief takes one token of the route class from the client bucket.
+ * Sends 429 to the client when the bucket is empty.
+ * @return true if the request can be served, false if it was rejected.
+ */
+static bool http_app_admit(httpd_req_t *req, http_app_route_class_t route_class){
+#ifdef CONFIG_HTTP_APP_RATE_LIMIT
+	TickType_t now = xTaskGetTickCount();
+	if(now == 0) now = 1; /* 0 marks a free slot */
+
+	http_app_client_t* c = http_app_get_client(http_app_get_client_ip(req), now);
+	c->last_seen = now;
+
+	/* refill */
+	uint32_t max_tokens = rate_limit_burst[route_class] * RATE_LIMIT_TOKEN;
+	uint32_t elapsed_ms = (now - c->last_refill[route_class]) * portTICK_PERIOD_MS;
+	if(elapsed_ms >= max_tokens / rate_limit_per_sec[route_class]){
+		/* idle long enough to fill the whole bucket, also avoids overflow below */
+		c->tokens[route_class] = max_tokens;
+	}
+	else{
+		uint32_t refill = elapsed_ms * rate_limit_per_sec[route_class];
+		c->tokens[route_class] = (max_tokens - c->tokens[route_class] < refill) ? max_tokens : c->tokens[route_class] + refill;
+	}
+	c->last_refill[route_class] = now;
+
+	if(c->tokens[route_class] >= RATE_LIMIT_TOKEN){
+		c->tokens[route_class] -= RATE_LIMIT_TOKEN;
+		return true;
+	}
+
+	http_app_rejected[route_class]++;
+	ESP_LOGW(TAG, "Rate limit: %s rejected (class %d)", req->uri, route_class);
+	httpd_resp_set_status(req, http_429_hdr);
+	httpd_resp_set_hdr(req, http_retry_after_hdr, http_retry_after_value);
+	httpd_resp_send(req, NULL, 0);
+	return false;
+#else
+	return true;
+#endif
+}
+
+uint32_t http_app_get_rejected_count(http_app_route_class_t route_class){
+	return (route_class < HTTP_APP_ROUTE_CLASS_COUNT) ? http_app_rejected[route_class] : 0;
+}
+
+/**
+ * @brief compares a request URI with a route, ignoring the query string.
+ */
+static bool http_app_uri_match(const char* uri, const char* url){
+	size_t len = strlen(url);
+	return strncmp(uri, url, len) == 0 && (uri[len] == '\0' || uri[len] == '?');
+}
+
+#ifdef CONFIG_HTTP_APP_STATS
+
+/* latency histogram: bucket 0 is under 1 ms, bucket i counts [2^(i-1), 2^i) ms, the last one is open ended */
+#define STATS_LATENCY_BUCKETS				14
+
+/**
+ * @brief served requests and latencies of one route class.
+ */
+typedef struct _http_app_class_counters_t {
+	uint32_t	requests;
+	uint32_t	max_ms;
+	uint32_t	latency[STATS_LATENCY_BUCKETS];
+}http_app_class_counters_t;
+
+/* @brief counters since the last reset. Written by the httpd task only */
+static http_app_class_counters_t http_app_counters[HTTP_APP_ROUTE_CLASS_COUNT];
+static int64_t http_app_stats_since = 0;
+
+static void http_app_record_request(http_app_route_class_t route_class, int64_t start){
+	uint32_t ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+	http_app_class_counters_t* c = &http_app_counters[route_class];
+
+	int bucket = 0;
+	while(bucket < STATS_LATENCY_BUCKETS - 1 && ms >= (1U << bucket)){
+		bucket++;
+	}
+	c->latency[bucket]++;
+	c->requests++;
+	if(ms > c->max_ms){
+		c->max_ms = ms;
+	}
+}
+
+/**
+ * @brief upper bound (ms) of the histogram bucket holding the given percentile.
+ */
+static uint32_t http_app_percentile(const http_app_class_counters_t* c, uint32_t percent){
+	uint32_t rank = (c->requests * percent + 99) / 100;
+	uint32_t seen = 0;
+
+	for(int i=0; i<STATS_LATENCY_BUCKETS; i++){
+		seen += c->latency[i];
+		if(seen >= rank && seen > 0){
+			/* the open ended bucket is bounded by the observed maximum */
+			return (i == STATS_LATENCY_BUCKETS - 1) ? c->max_ms : MIN(1U << i, c->max_ms);
+		}
+	}
+	return 0;
+}
+
+void http_app_get_stats(http_app_stats_t* stats){
+	memset(stats, 0x00, sizeof(http_app_stats_t));
+	stats->elapsed_ms = (uint32_t)((esp_timer_get_time() - http_app_stats_since) / 1000);
+	stats->free_heap = esp_get_free_heap_size();
+	stats->min_free_heap = esp_get_minimum_free_heap_size();
+	for(int i=0; i<HTTP_APP_ROUTE_CLASS_COUNT; i++){
+		stats->classes[i].requests = http_app_counters[i].requests;
+		stats->classes[i].rejected = http_app_rejected[i];
+		stats->classes[i].p50_ms = http_app_percentile(&http_app_counters[i], 50);
+		stats->classes[i].p99_ms = http_app_percentile(&http_app_counters[i], 99);
+		stats->classes[i].max_ms = http_app_counters[i].max_ms;
+	}
+}
+
+void http_app_reset_stats(){
+	memset(http_app_counters, 0x00, sizeof(http_app_counters));
+	memset(http_app_rejected, 0x00, sizeof(http_app_rejected));
+	http_app_stats_since = esp_timer_get_time();
+}
+
+/**
+ * @brief GET /stats.json, "?reset" clears the counters after the read.
+ */
+static esp_err_t http_app_send_stats(httpd_req_t *req){
+	static const char* class_names[HTTP_APP_ROUTE_CLASS_COUNT] = {"static", "json", "action"};
+	http_app_stats_t stats;
+	char buf[128];
+
+	http_app_get_stats(&stats);
+
+	httpd_resp_set_status(req, http_200_hdr);
+	httpd_resp_set_type(req, http_content_type_json);
+	httpd_resp_set_hdr(req, http_cache_control_hdr, http_cache_control_no_cache);
+	httpd_resp_set_hdr(req, http_pragma_hdr, http_pragma_no_cache);
+
+	snprintf(buf, sizeof(buf), "{\"elapsed_ms\":%u,\"free_heap\":%u,\"min_free_heap\":%u",
+		stats.elapsed_ms, stats.free_heap, stats.min_free_heap);
+	httpd_resp_send_chunk(req, buf, strlen(buf));
+	for(int i=0; i<HTTP_APP_ROUTE_CLASS_COUNT; i++){
+		snprintf(buf, sizeof(buf), ",\"%s\":{\"requests\":%u,\"rejected\":%u,\"p50_ms\":%u,\"p99_ms\":%u,\"max_ms\":%u}",
+			class_names[i], stats.classes[i].requests, stats.classes[i].rejected,
+			stats.classes[i].p50_ms, stats.classes[i].p99_ms, stats.classes[i].max_ms);
+		httpd_resp_send_chunk(req, buf, strlen(buf));
+	}
+	httpd_resp_send_chunk(req, "}", 1);
+	httpd_resp_send_chunk(req, NULL, 0);
+
+	if(strstr(req->uri, "?reset")){
+		http_app_reset_stats();
+	}
+	return ESP_OK;
+}
+#else
+static inline void http_app_record_request(http_app_route_class_t route_class, int64_t start){}
+#endif
+
 
 static esp_err_t get_request_buffer(httpd_req_t *req, char* result){
 	char buf[100];
@@ -136,6 +424,33 @@ static esp_err_t get_request_buffer(httpd_req_t *req, char* result){
 	return ESP_OK;
 }
 
+/**
+ * @brief reads the whole request body into a buffer allocated for it.
+ * @return the nul terminated body to be freed by the caller, NULL on error.
+ */
+static char* get_request_body(httpd_req_t *req){
+	int ret, received = 0;
+
+	char* body = malloc(req->content_len + 1);
+	if(!body){
+		ESP_LOGE(TAG, "No memory for request body");
+		return NULL;
+	}
+	while (received < req->content_len) {
+		if ((ret = httpd_req_recv(req, body + received, req->content_len - received)) <= 0) {
+			if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+				/* Retry receiving if timeout occurred */
+				continue;
+			}
+			free(body);
+			return NULL;
+		}
+		received += ret;
+	}
+	body[received] = '\0';
+	return body;
+}
+
 esp_err_t http_app_set_handler_hook( httpd_method_t method,  esp_err_t (*handler)(httpd_req_t *r)  ){
 
 	if(method == HTTP_GET){
@@ -151,11 +466,117 @@ esp_err_t http_app_set_handler_hook( httpd_method_t method,  esp_err_t (*handler
 	}
 }
 
-static esp_err_t http_server_post_handler(httpd_req_t *req){
+/**
+ * @brief sends a web UI asset: the copy in the storage partition when there is one, the embedded one otherwise.
+ * Status and content type must be set by the caller.
+ */
+static esp_err_t http_app_send_asset(httpd_req_t *req, const char* name, const char* start, const char* end){
+#ifdef CONFIG_HTTP_APP_UI_SPIFFS
+	char path[UI_MAX_PATH];
+	snprintf(path, sizeof(path), UI_BASE_PATH "/%s", name);
+
+	FILE* f = fopen(path, "r");
+	if(f){
+		size_t len;
+		esp_err_t ret = ESP_OK;
+		while((len = fread(context, 1, UI_CHUNK_SIZE, f)) > 0){
+			ret = httpd_resp_send_chunk(req, context, len);
+			if(ret != ESP_OK){
+				ESP_LOGE(TAG, "Failed to send %s", path);
+				break;
+			}
+		}
+		fclose(f);
+		if(ret == ESP_OK){
+			/* terminate the chunked response */
+			ret = httpd_resp_send_chunk(req, NULL, 0);
+		}
+		return ret;
+	}
+#endif
+	if(start == NULL){
+		httpd_resp_set_status(req, http_404_hdr);
+		return httpd_resp_send(req, NULL, 0);
+	}
+	return httpd_resp_send(req, start, end - start);
+}
+
+#ifdef CONFIG_HTTP_APP_UI_UPLOAD
+/**
+ * @brief POST /ui_upload?file=<asset> replaces one asset of the web UI in the storage partition.
+ * The body is streamed to a temporary file and renamed once complete.
+ */
+static esp_err_t http_app_upload_asset(httpd_req_t *req){
+	char name[16] = {0};
+	char query[32] = {0};
+	char path[UI_MAX_PATH];
+	char tmp_path[UI_MAX_PATH + 4];
+	int ret, remaining = req->content_len;
+	bool known = false;
+
+	if(httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK){
+		httpd_query_key_value(query, "file", name, sizeof(name));
+	}
+	for(const char** asset = ui_assets; *asset; asset++){
+		known |= (strcmp(*asset, name) == 0);
+	}
+	if(!known){
+		httpd_resp_set_status(req, http_400_hdr);
+		return httpd_resp_send(req, NULL, 0);
+	}
+	if(req->content_len > CONFIG_HTTP_APP_UI_UPLOAD_MAX_SIZE){
+		ESP_LOGE(TAG, "Upload of %s too long: %d", name, (int)req->content_len);
+		httpd_resp_set_status(req, http_413_hdr);
+		return httpd_resp_send(req, NULL, 0);
+	}
+
+	snprintf(path, sizeof(path), UI_BASE_PATH "/%s", name);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	FILE* f = fopen(tmp_path, "w");
+	if(!f){
+		ESP_LOGE(TAG, "Failed to open file %s for writing", tmp_path);
+		return httpd_resp_send_500(req);
+	}
+	while(remaining > 0){
+		if((ret = httpd_req_recv(req, context, MIN(remaining, SCRATCH_BUFSIZE))) <= 0){
+			if(ret == HTTPD_SOCK_ERR_TIMEOUT){
+				continue;
+			}
+			break;
+		}
+		if(fwrite(context, 1, ret, f) != ret){
+			break;
+		}
+		remaining -= ret;
+	}
+	fclose(f);
+
+	if(remaining > 0){
+		ESP_LOGE(TAG, "Upload of %s failed", name);
+		remove(tmp_path);
+		return httpd_resp_send_500(req);
+	}
+	remove(path);
+	if(rename(tmp_path, path) != 0){
+		return httpd_resp_send_500(req);
+	}
+	ESP_LOGI(TAG, "UI asset %s updated: %d bytes", name, (int)req->content_len);
+	httpd_resp_set_status(req, http_200_hdr);
+	return httpd_resp_send(req, NULL, 0);
+}
+#endif
+
+static esp_err_t http_server_post_serve(httpd_req_t *req){
 	esp_err_t ret = ESP_OK;
 
 	ESP_LOGI(TAG, "POST %s", req->uri);
 
+	if(!(http_app_routes & HTTP_APP_ROUTES_PORTAL)){
+		httpd_resp_set_status(req, http_404_hdr);
+		httpd_resp_send(req, NULL, 0);
+		return ESP_OK;
+	}
+
 	/* POST /client_ca.json */
 	if(strcmp(req->uri, http_client_ca_url) == 0){
 		ret = get_request_buffer(req, context);
@@ -252,6 +673,39 @@ static esp_err_t http_server_post_handler(httpd_req_t *req){
 			}
 		}
 	}
+#ifdef CONFIG_HTTP_APP_UI_UPLOAD
+	/* POST /ui_upload */
+	else if(http_app_uri_match(req->uri, http_ui_upload_url)) {
+		ret = http_app_upload_asset(req);
+	}
+#endif
+	/* POST /setup */
+	else if(strcmp(req->uri, http_setup_url) == 0) {
+		if(req->content_len > CONFIG_HTTP_APP_MAX_BUNDLE_SIZE){
+			ESP_LOGE(TAG, "Bundle too long: %d", (int)req->content_len);
+			httpd_resp_set_status(req, http_413_hdr);
+			httpd_resp_send(req, NULL, 0);
+			return ESP_FAIL;
+		}
+		char* bundle = get_request_body(req);
+		if(!bundle) {
+			httpd_resp_send_500(req);
+		} else {
+			ret = wifi_manager_save_config_bundle(bundle);
+			free(bundle);
+			if( ret == ESP_ERR_INVALID_ARG ){
+				/* the body was read, the connection can serve the corrected bundle */
+				httpd_resp_set_status(req, http_400_hdr);
+				ret = httpd_resp_send(req, NULL, 0);
+			}else if( ret != ESP_OK ){
+				ESP_LOGE(TAG, "Bundle write error: %s", esp_err_to_name(ret));
+				httpd_resp_send_500(req);
+			}else {
+				httpd_resp_set_status(req, http_200_hdr);
+				httpd_resp_send(req, NULL, 0);
+			}
+		}
+	}
 	/* POST /http_setup.json */
 	else if(strcmp(req->uri, http_http_url) == 0) {
 		ret = get_request_buffer(req, context);
@@ -316,7 +770,7 @@ static esp_err_t http_server_post_handler(httpd_req_t *req){
 }
 
 
-static esp_err_t http_server_get_handler(httpd_req_t *req){
+static esp_err_t http_server_get_serve(httpd_req_t *req){
 
     char* host = NULL;
     size_t buf_len;
@@ -324,6 +778,39 @@ static esp_err_t http_server_get_handler(httpd_req_t *req){
 
     ESP_LOGD(TAG, "GET %s", req->uri);
 
+#ifdef CONFIG_HTTP_APP_STATS
+	/* GET /stats.json */
+	if((http_app_routes & HTTP_APP_ROUTES_STATUS) && http_app_uri_match(req->uri, http_stats_url)){
+		return http_app_send_stats(req);
+	}
+#endif
+
+	/* GET /status.json */
+	if((http_app_routes & HTTP_APP_ROUTES_STATUS) && strcmp(req->uri, http_status_url) == 0){
+		if(wifi_manager_lock_json_buffer(( TickType_t ) 10)){
+			httpd_resp_set_status(req, http_200_hdr);
+			httpd_resp_set_type(req, http_content_type_json);
+			httpd_resp_set_hdr(req, http_cache_control_hdr, http_cache_control_no_cache);
+			httpd_resp_set_hdr(req, http_pragma_hdr, http_pragma_no_cache);
+			char* ip_info = wifi_manager_get_ip_info_json();
+			httpd_resp_send(req, ip_info, strlen(ip_info));
+			wifi_manager_unlock_json_buffer();
+		}
+		else{
+			httpd_resp_set_status(req, http_503_hdr);
+			httpd_resp_send(req, NULL, 0);
+			ESP_LOGE(TAG, "http_server_netconn_serve: GET /status.json failed to obtain mutex");
+		}
+		return ret;
+	}
+
+	/* everything else belongs to the portal */
+	if(!(http_app_routes & HTTP_APP_ROUTES_PORTAL)){
+		httpd_resp_set_status(req, http_404_hdr);
+		httpd_resp_send(req, NULL, 0);
+		return ret;
+	}
+
     /* Get header value string length and allocate memory for length + 1,
      * extra byte for null termination */
     buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
@@ -356,26 +843,26 @@ static esp_err_t http_server_get_handler(httpd_req_t *req){
 		if(strcmp(req->uri, http_root_url) == 0){
 			httpd_resp_set_status(req, http_200_hdr);
 			httpd_resp_set_type(req, http_content_type_html);
-			httpd_resp_send(req, (char*)index_html_start, index_html_end - index_html_start);
+			http_app_send_asset(req, "index.html", EMBEDDED_ASSET(index_html));
 		}
 		/* GET /favicon.js */
 		else if(strcmp(req->uri, http_favicon_url) == 0){
 			httpd_resp_set_status(req, http_200_hdr);
 			httpd_resp_set_type(req, http_content_type_js);
-			httpd_resp_send(req, (char*)favicon_ico_start, favicon_ico_end - favicon_ico_start);
+			http_app_send_asset(req, "favicon.ico", EMBEDDED_PART(favicon_ico));
 		}
 		/* GET /code.js */
 		else if(strcmp(req->uri, http_js_url) == 0){
 			httpd_resp_set_status(req, http_200_hdr);
 			httpd_resp_set_type(req, http_content_type_js);
-			httpd_resp_send(req, (char*)code_js_start, code_js_end - code_js_start);
+			http_app_send_asset(req, "code.js", EMBEDDED_PART(code_js));
 		}
 		/* GET /style.css */
 		else if(strcmp(req->uri, http_css_url) == 0){
 			httpd_resp_set_status(req, http_200_hdr);
 			httpd_resp_set_type(req, http_content_type_css);
 			httpd_resp_set_hdr(req, http_cache_control_hdr, http_cache_control_cache);
-			httpd_resp_send(req, (char*)style_css_start, style_css_end - style_css_start);
+			http_app_send_asset(req, "style.css", EMBEDDED_PART(style_css));
 		}
 		/* GET /ap.json */
 		else if(strcmp(req->uri, http_ap_url) == 0){
@@ -419,6 +906,37 @@ static esp_err_t http_server_get_handler(httpd_req_t *req){
 
 }
 
+static esp_err_t http_server_post_handler(httpd_req_t *req){
+	int64_t start = esp_timer_get_time();
+
+	if(!http_app_admit(req, HTTP_APP_ROUTE_ACTION)){
+		return ESP_OK;
+	}
+	esp_err_t ret = http_server_post_serve(req);
+	http_app_record_request(HTTP_APP_ROUTE_ACTION, start);
+	return ret;
+}
+
+static esp_err_t http_server_get_handler(httpd_req_t *req){
+	int64_t start = esp_timer_get_time();
+
+	/* the scan and the reconnect are the costly routes, everything else is cheap static content */
+	http_app_route_class_t route_class = HTTP_APP_ROUTE_STATIC;
+	if(strcmp(req->uri, http_ap_url) == 0 || strcmp(req->uri, http_status_url) == 0 || http_app_uri_match(req->uri, http_stats_url)){
+		route_class = HTTP_APP_ROUTE_JSON;
+	}
+	else if(strcmp(req->uri, http_connect_url) == 0){
+		route_class = HTTP_APP_ROUTE_ACTION;
+	}
+
+	if(!http_app_admit(req, route_class)){
+		return ESP_OK;
+	}
+	esp_err_t ret = http_server_get_serve(req);
+	http_app_record_request(route_class, start);
+	return ret;
+}
+
 /* URI wild card for any GET request */
 static const httpd_uri_t http_server_get_index_request = {
     .uri       = "/",
@@ -456,6 +974,20 @@ static const httpd_uri_t http_server_get_connect_request = {
     .handler   = http_server_get_handler
 };
 
+static const httpd_uri_t http_server_get_status_request = {
+    .uri       = "/status.json",
+    .method    = HTTP_GET,
+    .handler   = http_server_get_handler
+};
+
+#ifdef CONFIG_HTTP_APP_STATS
+static const httpd_uri_t http_server_get_stats_request = {
+    .uri       = "/stats.json",
+    .method    = HTTP_GET,
+    .handler   = http_server_get_handler
+};
+#endif
+
 static const httpd_uri_t http_server_post_client_ca_request = {
 		.uri	= "/client_ca",
 		.method = HTTP_POST,
@@ -519,6 +1051,22 @@ static const httpd_uri_t http_server_post_wifi_request = {
 		.user_ctx = NULL
 };					
 
+static const httpd_uri_t http_server_post_setup_request = {
+		.uri	= "/setup",
+		.method = HTTP_POST,
+		.handler = http_server_post_handler,
+		.user_ctx = NULL
+};
+
+#ifdef CONFIG_HTTP_APP_UI_UPLOAD
+static const httpd_uri_t http_server_post_ui_upload_request = {
+		.uri	= "/ui_upload",
+		.method = HTTP_POST,
+		.handler = http_server_post_handler,
+		.user_ctx = NULL
+};
+#endif
+
 void http_app_stop(){
 
 	if(httpd_handle != NULL){
@@ -594,6 +1142,22 @@ void http_app_stop(){
 			free(http_wifi_key_url);
 			http_wifi_key_url = NULL;
 		}
+		if(http_setup_url){
+			free(http_setup_url);
+			http_setup_url = NULL;
+		}
+		if(http_status_url){
+			free(http_status_url);
+			http_status_url = NULL;
+		}
+		if(http_stats_url){
+			free(http_stats_url);
+			http_stats_url = NULL;
+		}
+		if(http_ui_upload_url){
+			free(http_ui_upload_url);
+			http_ui_upload_url = NULL;
+		}
 
 		/* stop server */
 		httpd_stop(httpd_handle);
@@ -602,6 +1166,15 @@ void http_app_stop(){
 }
 
 
+void http_app_set_routes(http_app_routes_t routes){
+	if(routes != http_app_routes){
+		ESP_LOGI(TAG, "Routes: portal %s, status %s",
+			(routes & HTTP_APP_ROUTES_PORTAL) ? "on" : "off",
+			(routes & HTTP_APP_ROUTES_STATUS) ? "on" : "off");
+		http_app_routes = routes;
+	}
+}
+
 /**
  * @brief helper to generate URLs of the wifi manager
  */
@@ -634,7 +1207,7 @@ void http_app_start(bool lru_purge_enable){
 
 		httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 
-		config.max_uri_handlers = 15;
+		config.max_uri_handlers = 19;
 		config.lru_purge_enable = lru_purge_enable;
 
 		/* generate the URLs */
@@ -656,6 +1229,10 @@ void http_app_start(bool lru_purge_enable){
 			const char page_wifi_ca[] = "wifi_ca";
 			const char page_wifi_crt[] = "wifi_crt";
 			const char page_wifi_key[] = "wifi_key";
+			const char page_setup[] = "setup";
+			const char page_status[] = "status.json";
+			const char page_stats[] = "stats.json";
+			const char page_ui_upload[] = "ui_upload";
 
 			/* root url, eg "/"   */
 			const size_t http_root_url_sz = sizeof(char) * (root_len+1);
@@ -692,6 +1269,10 @@ void http_app_start(bool lru_purge_enable){
 			http_wifi_ca_url = http_app_generate_url(page_wifi_ca);
 			http_wifi_crt_url = http_app_generate_url(page_wifi_crt);
 			http_wifi_key_url = http_app_generate_url(page_wifi_key);
+			http_setup_url = http_app_generate_url(page_setup);
+			http_status_url = http_app_generate_url(page_status);
+			http_stats_url = http_app_generate_url(page_stats);
+			http_ui_upload_url = http_app_generate_url(page_ui_upload);
 		}
 
 		err = httpd_start(&httpd_handle, &config);
@@ -704,6 +1285,10 @@ void http_app_start(bool lru_purge_enable){
 	        httpd_register_uri_handler(httpd_handle, &http_server_get_code_request);
 	        httpd_register_uri_handler(httpd_handle, &http_server_get_ap_request);
 	        httpd_register_uri_handler(httpd_handle, &http_server_get_connect_request);
+	        httpd_register_uri_handler(httpd_handle, &http_server_get_status_request);
+#ifdef CONFIG_HTTP_APP_STATS
+	        httpd_register_uri_handler(httpd_handle, &http_server_get_stats_request);
+#endif
 	        httpd_register_uri_handler(httpd_handle, &http_server_post_client_ca_request);
 	        httpd_register_uri_handler(httpd_handle, &http_server_post_client_crt_request);
 	        httpd_register_uri_handler(httpd_handle, &http_server_post_client_key_request);
@@ -713,6 +1298,10 @@ void http_app_start(bool lru_purge_enable){
 	        httpd_register_uri_handler(httpd_handle, &http_server_post_http_request);
 	        httpd_register_uri_handler(httpd_handle, &http_server_post_ipv4_request);
 	        httpd_register_uri_handler(httpd_handle, &http_server_post_wifi_request);
+	        httpd_register_uri_handler(httpd_handle, &http_server_post_setup_request);
+#ifdef CONFIG_HTTP_APP_UI_UPLOAD
+	        httpd_register_uri_handler(httpd_handle, &http_server_post_ui_upload_request);
+#endif
 	    }
 	}
 }
\ No newline at end of file
@@ -21,13 +21,17 @@
 @see https://github.com/vivask/esp8266-wifi-manager
 */
 #include <sys/param.h>
+#include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/timers.h>
 #include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 #include <esp_tls.h>
+#include <esp_system.h>
 #if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
 #include <esp_crt_bundle.h>
 #endif
@@ -35,31 +39,170 @@
 #if CONFIG_USE_OTA
 #include "ota.h"
 #endif
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+#include <esp_timer.h>
+#include "gzip.h"
+#endif
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+#include "cbor.h"
+#endif
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+#include "outbox.h"
+#endif
 
 #include "cb_list.h"
 #include "manager.h"
 #include "flash.h"
 #include "http_client.h"
+#include "json_stream.h"
 
 #define DEFAULT_CACHE_SIZE      CONFIG_HTTP_CLIENT_TASK_CACHE_SIZE
 #define MAX_HTTP_URL_SIZE       CONFIG_HTTP_CLIENT_MAX_URL_LEN
 #define MAX_HTTP_OUTPUT_BUFFER  CONFIG_HTTP_CLIENT_MAX_RESPONSE_LEN
+#define HTTP_CLIENT_POOL_SIZE   CONFIG_HTTP_CLIENT_POOL_SIZE
 
 static const char *TAG = "http_client";
 
-// static char local_response_buffer[MAX_HTTP_OUTPUT_BUFFER] = {0};
-static char *output_buffer;  // Buffer to store response of http request from event handler
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+#define HTTP_CLIENT_CACHE_ETAG_LEN  48
+#define HTTP_CLIENT_CACHE_DATE_LEN  32
+
+/**
+ * @brief Validators of the last response to a GET, the body itself is not kept:
+ * a 304 answer means the callbacks already saw it.
+ */
+typedef struct _http_client_cache_entry_t {
+    uint32_t    key;        /* hash of the url, 0 for a free entry */
+    uint32_t    used;       /* for the least recently used replacement */
+    char        etag[HTTP_CLIENT_CACHE_ETAG_LEN];
+    char        last_modified[HTTP_CLIENT_CACHE_DATE_LEN];
+}http_client_cache_entry_t;
+
+static http_client_cache_entry_t cache[CONFIG_HTTP_CLIENT_CACHE_SIZE] = {0};
+static uint32_t cache_clock = 0;
+static http_client_cache_stats_t cache_stats = {0};
+#endif
+
+/**
+ * @brief One keep-alive connection to the backend and the state of the request running on it.
+ * The connection is used by its worker task, and by the order task for the first one, under lock;
+ * the event handler gets it as user data.
+ */
+typedef struct _http_client_conn_t {
+    esp_http_client_handle_t    client;
+    TaskHandle_t                task;
+    uint32_t                    generation;     /* pool generation the connection was opened in */
+    SemaphoreHandle_t           lock;
+    bool                        closing;        /* closed on purpose, not a link loss */
+    bool                        push;           /* long-poll connection, its failures do not change the client status */
+    bool                        sent;           /* the running request reached the server, at least its header */
+    uint8_t                     error_count;    /* transport errors since the connection was last opened */
+    TickType_t                  perform_start;  /* start of the running request, times the connection setup */
+    char*                       output_buffer;  /* response of the running request, only with a response or completion callback */
+    int                         output_len;
+    int                         output_size;
+    const http_client_request_t* request;       /* request running on the connection, NULL for the probe */
+#ifdef CONFIG_USE_OTA
+    cJSON*                      ota_orders;     /* firmware members of the response, NULL if none */
+#endif
+    json_stream_t               stream;         /* tokenizer fed with the response */
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+    bool                        cacheable;      /* GET whose validators are kept */
+    char                        etag[HTTP_CLIENT_CACHE_ETAG_LEN];
+    char                        last_modified[HTTP_CLIENT_CACHE_DATE_LEN];
+#endif
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+    bool                        cbor;           /* the response is CBOR, decoded to JSON text */
+    bool                        cbor_body;      /* the request body is CBOR, a 415 sends it again as JSON */
+    cbor_decoder_t              cbor_decoder;
+#endif
+    char                        url[MAX_HTTP_URL_SIZE];
+}http_client_conn_t;
 
-static char url_buffer[MAX_HTTP_URL_SIZE] = {0};
+/* @brief connections of the send workers, one per worker task */
+static http_client_conn_t pool[HTTP_CLIENT_POOL_SIZE] = {0};
 
-static esp_http_client_handle_t client = NULL;
+/**
+ * @brief the order task probes the backend on the first pool connection: its worker then goes on
+ * with the TCP/TLS session already set up instead of a handshake of its own.
+ */
+#define PROBE_CONN  (&pool[0])
+
+static http_client_conn_stats_t conn_stats = {0};
 
-/* @brief task handle for the http client send task */
-static TaskHandle_t task_http_client_send = NULL;
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+/* @brief the backend answered 415 to a CBOR body, bodies are sent as JSON from then on */
+static bool cbor_refused = false;
+static http_client_cbor_stats_t cbor_stats = {0};
+#endif
+
+/* @brief incremented on HC_ORDER_DISCONNECT, workers reopen connections of an older generation */
+static volatile uint32_t pool_generation = 0;
+
+typedef enum http_client_breaker_state_t {
+    HC_BREAKER_CLOSED = 0,      /* requests pass */
+    HC_BREAKER_OPEN = 1,        /* backend down, requests fail fast until the cooldown ends */
+    HC_BREAKER_HALF_OPEN = 2    /* one trial request decides */
+}http_client_breaker_state_t;
+
+/**
+ * @brief Circuit breaker shared by the send workers.
+ */
+static struct {
+    http_client_breaker_state_t state;
+    uint8_t                     failures;       /* consecutive transient failures */
+    TickType_t                  open_until;
+}breaker = {0};
+
+/* @brief fires the next connect attempt, the order task never sleeps between attempts */
+static TimerHandle_t reconnect_timer = NULL;
+static uint8_t connect_attempt = 0;
+
+#ifdef CONFIG_HTTP_CLIENT_BATCH
+/**
+ * @brief POST records gathered for one URI, sent as one JSON array.
+ */
+typedef struct _http_client_batch_t {
+    char*           uri;            /* NULL for a free slot */
+    char*           buffer;         /* "[record,record" while open, closed with ']' on flush */
+    size_t          len;
+    size_t          max_bytes;
+    TickType_t      linger;
+    TimerHandle_t   timer;          /* started by the first record of a batch */
+}http_client_batch_t;
+
+static http_client_batch_t batches[CONFIG_HTTP_CLIENT_BATCH_URIS] = {0};
+static SemaphoreHandle_t batch_mutex = NULL;
+static http_client_batch_stats_t batch_stats = {0};
+#endif
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+static http_client_gzip_stats_t gzip_stats = {0};
+#endif
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+/* @brief task handle for the outbox replay task */
+static TaskHandle_t task_http_client_outbox = NULL;
+#endif
+#ifdef CONFIG_HTTP_CLIENT_LONG_POLL
+/* @brief connection of the long-poll task, held open by the backend until it has orders */
+static http_client_conn_t poll_conn = {0};
+static TaskHandle_t task_http_client_poll = NULL;
+#endif
 /* @brief task handle for the http client order task */
 static TaskHandle_t task_http_client_order = NULL;
-/* objects used to manipulate the http client send queue of events */
-QueueHandle_t http_client_send_queue;
+/* @brief send queues of the priority lanes, the pointer to a request is queued */
+static QueueHandle_t lanes[HC_LANE_COUNT] = {NULL};
+/* @brief counts the requests queued in all lanes, the workers wait on it */
+static SemaphoreHandle_t lane_pending = NULL;
+/* @brief protects the weighted round robin state */
+static SemaphoreHandle_t lane_mutex = NULL;
+static const uint8_t lane_len[HC_LANE_COUNT] = {
+    CONFIG_HTTP_CLIENT_LANE_CONTROL_LEN, CONFIG_HTTP_CLIENT_LANE_NORMAL_LEN, CONFIG_HTTP_CLIENT_LANE_BULK_LEN
+};
+static uint32_t request_id = 0;
+static const int lane_weight[HC_LANE_COUNT] = {
+    CONFIG_HTTP_CLIENT_LANE_CONTROL_WEIGHT, CONFIG_HTTP_CLIENT_LANE_NORMAL_WEIGHT, CONFIG_HTTP_CLIENT_LANE_BULK_WEIGHT
+};
+static int lane_current[HC_LANE_COUNT] = {0};
 /* objects used to manipulate the http client connect queue of events */
 QueueHandle_t http_client_order_queue;
 
@@ -68,22 +211,96 @@ EventGroupHandle_t http_client_events;
 /* @brief callback response function pointer */
 void (*cb_response_ptr)(const char*, int) = NULL;
 
+/* @brief callback of the streamed response tokens */
+static json_stream_cb_t cb_stream_ptr = NULL;
+static void* cb_stream_arg = NULL;
+
 /* @brief callback http client ready function pointer */
 CallBackList* cb_ready_ptr = NULL;
 
 /* @brief callback http client not ready function pointer */
 CallBackList* cb_not_ready_ptr = NULL;
 
-static char* get_full_path(const char* uri) {
+static void http_client_request_free(http_client_request_t* msg);
+static void http_client_request_done(const http_client_request_t* msg, esp_err_t err, int status, bool retry, const char* body, int body_len);
+static void http_client_release_idle();
+
+static char* get_full_path(http_client_conn_t* conn, const char* uri) {
     esp8266_config_t* wifi_config = wifi_manager_get_config();
-    memset(url_buffer, 0x00, MAX_HTTP_URL_SIZE);
+    memset(conn->url, 0x00, MAX_HTTP_URL_SIZE);
     if (strlen(wifi_config->server_api) > 1) {
-        strcpy(url_buffer, wifi_config->server_api);
+        strcpy(conn->url, wifi_config->server_api);
+    }
+    strncat(conn->url, uri, MAX_HTTP_URL_SIZE - strlen(conn->url) - 1);
+    return conn->url;
+}
+
+/**
+ * @brief exponential backoff with jitter: a random delay between half and all of min(base * 2^attempt, max).
+ */
+static TickType_t http_client_backoff(uint8_t attempt, uint32_t base_ms, uint32_t max_ms) {
+    uint32_t delay_ms = (attempt < 16) ? MIN(base_ms << attempt, max_ms) : max_ms;
+    delay_ms = delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+    return MAX(pdMS_TO_TICKS(delay_ms), 1);
+}
+
+/**
+ * @return true if a request may be sent, false while the breaker is open.
+ */
+static bool http_client_breaker_allow() {
+    bool allow = true;
+    TickType_t now = xTaskGetTickCount();
+
+    taskENTER_CRITICAL();
+    if (breaker.state == HC_BREAKER_OPEN) {
+        if ((int32_t)(now - breaker.open_until) >= 0) {
+            /* cooldown over, let one request probe the backend */
+            breaker.state = HC_BREAKER_HALF_OPEN;
+        }else {
+            allow = false;
+        }
+    }else if (breaker.state == HC_BREAKER_HALF_OPEN) {
+        /* the probe is in flight */
+        allow = false;
+    }
+    taskEXIT_CRITICAL();
+    return allow;
+}
+
+static void http_client_breaker_result(bool transient_failure) {
+    taskENTER_CRITICAL();
+    if (!transient_failure) {
+        breaker.state = HC_BREAKER_CLOSED;
+        breaker.failures = 0;
+    }else {
+        if (breaker.failures < UINT8_MAX) {
+            breaker.failures++;
+        }
+        if (breaker.state == HC_BREAKER_HALF_OPEN || breaker.failures >= CONFIG_HTTP_CLIENT_BREAKER_THRESHOLD) {
+            breaker.state = HC_BREAKER_OPEN;
+            breaker.open_until = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_HTTP_CLIENT_BREAKER_COOLDOWN_MS);
+        }
     }
-    strcat(url_buffer, uri);
-    return url_buffer;
+    taskEXIT_CRITICAL();
 }
 
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+/**
+ * @return ticks left until the breaker lets a request pass, 0 if it is closed.
+ */
+static TickType_t http_client_breaker_wait() {
+    TickType_t wait = 0;
+    TickType_t now = xTaskGetTickCount();
+
+    taskENTER_CRITICAL();
+    if (breaker.state == HC_BREAKER_OPEN && (int32_t)(breaker.open_until - now) > 0) {
+        wait = breaker.open_until - now;
+    }
+    taskEXIT_CRITICAL();
+    return wait;
+}
+#endif
+
 static BaseType_t is_wifi_connected() {
     EventBits_t uxBits = xEventGroupGetBits(http_client_events);
     return ((uxBits & HC_WIFI_OK) == 0) ? pdFALSE : pdTRUE;
@@ -112,6 +329,12 @@ static void cb_wifi_lost(void* pvParameter) {
 
 static void cb_ota_finish(bool fail) {
     if(fail){
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+        /* the responses that offered the firmware are fetched in full again, a 304 would hide the offer */
+        taskENTER_CRITICAL();
+        memset(cache, 0x00, sizeof(cache));
+        taskEXIT_CRITICAL();
+#endif
         run_cb(cb_ready_ptr, NULL);
         xEventGroupSetBits(http_client_events, HC_STATUS_OK);
     }
@@ -121,63 +344,529 @@ void http_client_destroy() {
     run_cb(cb_not_ready_ptr, NULL);
     xEventGroupClearBits(http_client_events, HC_WIFI_OK);
 
-	vTaskDelete(task_http_client_send);
-	task_http_client_send = NULL;
+    for (int i = 0; i < HTTP_CLIENT_POOL_SIZE; i++) {
+        vTaskDelete(pool[i].task);
+        pool[i].task = NULL;
+    }
 
 	vTaskDelete(task_http_client_order);
 	task_http_client_order = NULL;
 
-	vQueueDelete(http_client_send_queue);
-	http_client_send_queue = NULL;
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+	vTaskDelete(task_http_client_outbox);
+	task_http_client_outbox = NULL;
+#endif
+
+#ifdef CONFIG_HTTP_CLIENT_LONG_POLL
+	vTaskDelete(task_http_client_poll);
+	task_http_client_poll = NULL;
+#endif
+
+    http_client_request_t* msg;
+    for (int lane = 0; lane < HC_LANE_COUNT; lane++) {
+        while (xQueueReceive(lanes[lane], &msg, 0) == pdPASS) {
+            http_client_request_done(msg, ESP_ERR_INVALID_STATE, 0, true, NULL, 0);
+            http_client_request_free(msg);
+        }
+        vQueueDelete(lanes[lane]);
+        lanes[lane] = NULL;
+    }
+    vSemaphoreDelete(lane_pending);
+    lane_pending = NULL;
+    vSemaphoreDelete(lane_mutex);
+    lane_mutex = NULL;
 
 	vQueueDelete(http_client_order_queue);
 	http_client_order_queue = NULL;
 }
 
-static void copy_trunc(char* dst, const char* src, size_t max_len) {
-    dst[0] =  '\0';
-    if (src) {
-        size_t len = strlen(src);
-        if (len >= max_len) {
-            len = max_len - 1;
+/**
+ * @brief allocates a request with the uri and, unless a buffer is handed over, a copy of the body in one block.
+ */
+static http_client_request_t* http_client_request_new(uint16_t method, const char* uri, const char* data, size_t data_len) {
+    size_t uri_len = uri ? strlen(uri) : 0;
+    size_t size = sizeof(http_client_request_t) + uri_len + 1 + (data ? data_len + 1 : 0);
+
+    http_client_request_t* msg = (http_client_request_t*)malloc(size);
+    if (msg == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes for request", size);
+        return NULL;
+    }
+    msg->method = method;
+    msg->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_HTTP_CLIENT_REQUEST_DEADLINE_MS);
+    msg->data_len = data_len;
+    msg->data = NULL;
+    msg->data_owned = false;
+    msg->queued = xTaskGetTickCount();
+    msg->done = NULL;
+    msg->done_arg = NULL;
+    taskENTER_CRITICAL();
+    msg->id = ++request_id;
+    taskEXIT_CRITICAL();
+    memcpy(msg->uri, uri ? uri : "", uri_len);
+    msg->uri[uri_len] = '\0';
+    if (data) {
+        msg->data = msg->uri + uri_len + 1;
+        memcpy(msg->data, data, data_len);
+        msg->data[data_len] = '\0';
+    }
+    return msg;
+}
+
+static void http_client_request_free(http_client_request_t* msg) {
+    if (msg->data_owned) {
+        free(msg->data);
+    }
+    free(msg);
+}
+
+/**
+ * @brief reports the outcome to the completion callback of the request, if any.
+ */
+static void http_client_request_done(const http_client_request_t* msg, esp_err_t err, int status, bool retry, const char* body, int body_len) {
+    if (msg->done == NULL) {
+        return;
+    }
+    http_client_result_t result = {
+        .id = msg->id,
+        .err = err,
+        .status = status,
+        .latency_ms = (xTaskGetTickCount() - msg->queued) * portTICK_PERIOD_MS,
+        .body = (body_len > 0) ? body : NULL,
+        .body_len = (body_len > 0) ? body_len : 0,
+        .retry = retry,
+    };
+    msg->done(&result, msg->done_arg);
+}
+
+/**
+ * @brief queues a request in a lane and wakes a worker.
+ * @return pdFALSE if the lane stayed full for ticks_to_wait, the request is not freed.
+ */
+static BaseType_t http_client_lane_put(http_client_lane_t lane, http_client_request_t* msg, bool to_front, TickType_t ticks_to_wait) {
+    BaseType_t ret = (to_front) ?
+        xQueueSendToFront( lanes[lane], &msg, ticks_to_wait) :
+        xQueueSend( lanes[lane], &msg, ticks_to_wait);
+    if (ret == pdPASS) {
+        xSemaphoreGive(lane_pending);
+    }
+    return ret;
+}
+
+/**
+ * @brief takes the next request, lanes with waiting requests are served by smooth weighted round robin:
+ * each gets a share of the workers proportional to its weight, none is starved.
+ */
+static http_client_request_t* http_client_lane_get() {
+    http_client_request_t* msg = NULL;
+
+    xSemaphoreTake(lane_pending, portMAX_DELAY);
+    xSemaphoreTake(lane_mutex, portMAX_DELAY);
+    while (msg == NULL) {
+        int best = -1, total = 0;
+        for (int lane = 0; lane < HC_LANE_COUNT; lane++) {
+            if (uxQueueMessagesWaiting(lanes[lane]) == 0) {
+                continue;
+            }
+            lane_current[lane] += lane_weight[lane];
+            total += lane_weight[lane];
+            if (best < 0 || lane_current[lane] > lane_current[best]) {
+                best = lane;
+            }
         }
-        memcpy((void*)dst, (void*)src, len);
-        dst[len] = '\0';
+        if (best < 0) {
+            break;
+        }
+        lane_current[best] -= total;
+        xQueueReceive(lanes[best], &msg, 0);
     }
+    xSemaphoreGive(lane_mutex);
+    return msg;
 }
 
-BaseType_t http_client_send_message_to_front(uint16_t method, const char* uri, const char* data){
+#ifdef CONFIG_HTTP_CLIENT_BATCH
+/**
+ * @brief closes the array of the batch and queues it. The batch mutex must be held.
+ * @return false if the queue stayed full for ticks_to_wait, the batch is kept open.
+ */
+static bool http_client_batch_flush(http_client_batch_t* batch, TickType_t ticks_to_wait) {
+    if (batch->len == 0) {
+        return true;
+    }
 
-    if (is_wifi_connected() !=  pdPASS) {
-        return pdFALSE;
+    http_client_request_t* msg = http_client_request_new(HTTP_METHOD_POST, batch->uri, NULL, 0);
+    if (msg == NULL) {
+        return false;
     }
+    batch->buffer[batch->len] = ']';
+    msg->data = batch->buffer;
+    msg->data_len = batch->len + 1;
+    msg->data_owned = true;
+
+    if (http_client_lane_put(HC_LANE_NORMAL, msg, false, ticks_to_wait) != pdPASS) {
+        free(msg);
+        return false;
+    }
+    batch_stats.requests++;
+    batch_stats.bytes += batch->len + 1;
+    batch->buffer = NULL;
+    batch->len = 0;
+    xTimerStop(batch->timer, 0);
+    return true;
+}
 
-	http_client_request_t msg = {
-        .method = method,
-    };
-    copy_trunc(msg.uri, uri, MAX_HTTP_URI_LEN);
-    if (data && strlen(data) > 0) {
-        copy_trunc(msg.data, data, MAX_REQUEST_DATA_LEN);
+/**
+ * @brief linger deadline: sends the batch unless the queue is full, then retries after another linger period.
+ * Runs in the timer task and never blocks it.
+ */
+static void http_client_batch_timer_cb(TimerHandle_t timer) {
+    http_client_batch_t* batch = (http_client_batch_t*)pvTimerGetTimerID(timer);
+    bool sent = false;
+
+    if (xSemaphoreTake(batch_mutex, 0) == pdTRUE) {
+        sent = http_client_batch_flush(batch, 0);
+        xSemaphoreGive(batch_mutex);
+    }
+    if (!sent) {
+        xTimerReset(timer, 0);
     }
+}
 
-	return xQueueSendToFront( http_client_send_queue, &msg, portMAX_DELAY);
+/**
+ * @brief appends a record to the batch of its URI.
+ * @param ticks_to_wait for the batch mutex and for queuing a full batch.
+ * @return ESP_ERR_NOT_FOUND if the URI is not batched or no memory is left, the record is then sent alone,
+ * ESP_ERR_TIMEOUT if the full batch could not be queued in time, the record is not added.
+ */
+static esp_err_t http_client_batch_add(const char* uri, const char* data, TickType_t ticks_to_wait) {
+    http_client_batch_t* batch = NULL;
+    size_t data_len = strlen(data);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    if (batch_mutex == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    TickType_t start = xTaskGetTickCount();
+    if (xSemaphoreTake(batch_mutex, ticks_to_wait) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (ticks_to_wait != portMAX_DELAY) {
+        /* the flush gets what the mutex left of the wait */
+        ticks_to_wait -= MIN(xTaskGetTickCount() - start, ticks_to_wait);
+    }
+    for (int i = 0; i < CONFIG_HTTP_CLIENT_BATCH_URIS; i++) {
+        if (batches[i].uri && strcmp(batches[i].uri, uri) == 0) {
+            batch = &batches[i];
+            break;
+        }
+    }
+    if (batch) {
+        /* '[' or ',' before the record and ']' after it */
+        if (batch->len > 0 && batch->len + data_len + 2 > batch->max_bytes) {
+            if (!http_client_batch_flush(batch, ticks_to_wait)) {
+                xSemaphoreGive(batch_mutex);
+                return ESP_ERR_TIMEOUT;
+            }
+        }
+        if (batch->buffer == NULL) {
+            /* a record larger than the limit is sent as a batch of its own */
+            batch->buffer = (char*)malloc(MAX(batch->max_bytes, data_len + 2) + 1);
+            batch->len = 0;
+        }
+        if (batch->buffer) {
+            batch->buffer[batch->len] = (batch->len == 0) ? '[' : ',';
+            batch->len++;
+            memcpy(batch->buffer + batch->len, data, data_len);
+            batch->len += data_len;
+            batch_stats.records++;
+            batch_stats.record_bytes += data_len;
+            /* a full batch the lane does not take in time is retried at the linger deadline */
+            if ((batch->len + 1 < batch->max_bytes || !http_client_batch_flush(batch, ticks_to_wait)) &&
+                    xTimerIsTimerActive(batch->timer) == pdFALSE) {
+                xTimerChangePeriod(batch->timer, batch->linger, 0);
+            }
+            err = ESP_OK;
+        }
+    }
+    xSemaphoreGive(batch_mutex);
+
+    return err;
 }
 
-BaseType_t http_client_send_message(uint16_t method, const char* uri, const char* data){
+esp_err_t http_client_set_batching(const char* uri, size_t max_bytes, uint32_t linger_ms, TickType_t ticks_to_wait) {
+    http_client_batch_t* batch = NULL;
 
-    if (is_wifi_connected() !=  pdPASS) {
+    if (uri == NULL || batch_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    TickType_t start = xTaskGetTickCount();
+    if (xSemaphoreTake(batch_mutex, ticks_to_wait) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (ticks_to_wait != portMAX_DELAY) {
+        ticks_to_wait -= MIN(xTaskGetTickCount() - start, ticks_to_wait);
+    }
+    for (int i = 0; i < CONFIG_HTTP_CLIENT_BATCH_URIS; i++) {
+        if (batches[i].uri && strcmp(batches[i].uri, uri) == 0) {
+            batch = &batches[i];
+            break;
+        }
+        if (batch == NULL && batches[i].uri == NULL) {
+            batch = &batches[i];
+        }
+    }
+    if (batch == NULL) {
+        xSemaphoreGive(batch_mutex);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* send what was gathered with the previous settings */
+    if (batch->uri && !http_client_batch_flush(batch, ticks_to_wait)) {
+        xSemaphoreGive(batch_mutex);
+        return ESP_ERR_TIMEOUT;
+    }
+    if (max_bytes == 0) {
+        if (batch->uri) {
+            xTimerDelete(batch->timer, portMAX_DELAY);
+            free(batch->uri);
+            memset(batch, 0x00, sizeof(http_client_batch_t));
+        }
+        xSemaphoreGive(batch_mutex);
+        return ESP_OK;
+    }
+
+    if (batch->uri == NULL) {
+        batch->uri = strdup(uri);
+        batch->timer = xTimerCreate("batch_timer", 1, pdFALSE, batch, &http_client_batch_timer_cb);
+    }
+    batch->max_bytes = max_bytes;
+    batch->linger = MAX(pdMS_TO_TICKS(linger_ms), 1);
+    xSemaphoreGive(batch_mutex);
+
+    return ESP_OK;
+}
+
+void http_client_get_batch_stats(http_client_batch_stats_t* stats) {
+    *stats = batch_stats;
+}
+#endif
+
+void http_client_get_conn_stats(http_client_conn_stats_t* stats) {
+    taskENTER_CRITICAL();
+    *stats = conn_stats;
+    taskEXIT_CRITICAL();
+}
+
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+/**
+ * @brief persists a request to be replayed once the backend is reachable again.
+ */
+static BaseType_t http_client_store(uint16_t method, const char* uri, const char* data, size_t data_len) {
+    if (uri == NULL || outbox_push(method, uri, data, data_len) != ESP_OK) {
         return pdFALSE;
     }
+    if (task_http_client_outbox) {
+        xTaskNotifyGive(task_http_client_outbox);
+    }
+    return pdPASS;
+}
+#endif
 
-	http_client_request_t msg = {
-        .method = method,
-    };
-    copy_trunc(msg.uri, uri, MAX_HTTP_URI_LEN);
-    if (data && strlen(data) > 0) {
-        copy_trunc(msg.data, data, MAX_REQUEST_DATA_LEN);
+/**
+ * @brief common path of all send functions.
+ * @param owned data is a heap buffer taken over, freed in any case.
+ * @param store_on_backpressure a request finding its lane full is stored to the outbox instead of failing.
+ */
+static esp_err_t http_client_submit(http_client_lane_t lane, bool to_front, uint16_t method, const char* uri,
+        const char* data, size_t data_len, bool owned, TickType_t ticks_to_wait, bool store_on_backpressure) {
+    esp_err_t err = ESP_OK;
+
+    if (lane >= HC_LANE_COUNT || lanes[lane] == NULL) {
+        err = ESP_ERR_INVALID_ARG;
+    }else if (is_wifi_connected() !=  pdPASS) {
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+        err = (http_client_store(method, uri, data, data_len) == pdPASS) ? ESP_OK : ESP_FAIL;
+#else
+        err = ESP_ERR_INVALID_STATE;
+#endif
+    }
+#ifdef CONFIG_HTTP_CLIENT_BATCH
+    else if (!owned && lane != HC_LANE_CONTROL && method == HTTP_METHOD_POST && uri && data &&
+            (err = http_client_batch_add(uri, data, ticks_to_wait)) != ESP_ERR_NOT_FOUND) {
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+        /* the batch of the URI stayed full like a full lane */
+        if (err == ESP_ERR_TIMEOUT && store_on_backpressure && http_client_store(method, uri, data, data_len) == pdPASS) {
+            err = ESP_OK;
+        }
+#endif
+    }
+#endif
+    else {
+        /* not batched */
+        err = ESP_OK;
+        http_client_request_t* msg = http_client_request_new(method, uri, owned ? NULL : data, owned ? 0 : data_len);
+        if (msg == NULL) {
+            err = ESP_ERR_NO_MEM;
+        }else {
+            if (owned) {
+                msg->data = (char*)data;
+                msg->data_len = data_len;
+                msg->data_owned = (data != NULL);
+                owned = false;
+            }
+            if (http_client_lane_put(lane, msg, to_front, ticks_to_wait) != pdPASS) {
+                err = ESP_ERR_TIMEOUT;
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+                if (store_on_backpressure && http_client_store(method, msg->uri, msg->data, msg->data_len) == pdPASS) {
+                    err = ESP_OK;
+                }
+#endif
+                http_client_request_free(msg);
+            }
+        }
+    }
+
+    if (owned) {
+        free((void*)data);
     }
+    return err;
+}
+
+esp_err_t http_client_send(http_client_lane_t lane, uint16_t method, const char* uri, const char* data, TickType_t ticks_to_wait){
+    return http_client_submit(lane, false, method, uri, data, data ? strlen(data) : 0, false, ticks_to_wait, false);
+}
 
-	return xQueueSend( http_client_send_queue, &msg, portMAX_DELAY);
+esp_err_t http_client_send_owned(http_client_lane_t lane, uint16_t method, const char* uri, char* data, size_t len, TickType_t ticks_to_wait){
+    return http_client_submit(lane, false, method, uri, data, len, true, ticks_to_wait, false);
+}
+
+UBaseType_t http_client_lane_free(http_client_lane_t lane){
+    return (lane < HC_LANE_COUNT && lanes[lane]) ? uxQueueSpacesAvailable(lanes[lane]) : 0;
+}
+
+esp_err_t http_client_request(http_client_lane_t lane, uint16_t method, const char* uri, const char* data,
+        http_client_done_cb_t done, void* arg, TickType_t ticks_to_wait, uint32_t* id){
+    if (lane >= HC_LANE_COUNT || lanes[lane] == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (is_wifi_connected() != pdPASS) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    http_client_request_t* msg = http_client_request_new(method, uri, data, data ? strlen(data) : 0);
+    if (msg == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    msg->done = done;
+    msg->done_arg = arg;
+    if (id) {
+        *id = msg->id;
+    }
+    if (http_client_lane_put(lane, msg, false, ticks_to_wait) != pdPASS) {
+        http_client_request_free(msg);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief shared by http_client_request_wait() and the completion callback, freed by the last one to leave:
+ * a waiter giving up does not leave the callback with a dangling pointer.
+ */
+typedef struct _http_client_future_t {
+    SemaphoreHandle_t       done;
+    uint8_t                 refs;
+    http_client_result_t    result;
+    char*                   body;
+    size_t                  body_size;
+}http_client_future_t;
+
+static void http_client_future_release(http_client_future_t* future) {
+    taskENTER_CRITICAL();
+    uint8_t refs = --future->refs;
+    taskEXIT_CRITICAL();
+    if (refs == 0) {
+        vSemaphoreDelete(future->done);
+        free(future->body);
+        free(future);
+    }
+}
+
+static void http_client_future_cb(const http_client_result_t* result, void* arg) {
+    http_client_future_t* future = (http_client_future_t*)arg;
+
+    future->result = *result;
+    future->result.body = NULL;
+    future->result.body_len = 0;
+    if (result->body && future->body_size > 0) {
+        size_t len = MIN((size_t)result->body_len, future->body_size - 1);
+        future->body = (char*)malloc(len + 1);
+        if (future->body) {
+            memcpy(future->body, result->body, len);
+            future->body[len] = '\0';
+            future->result.body_len = len;
+        }
+    }
+    xSemaphoreGive(future->done);
+    http_client_future_release(future);
+}
+
+esp_err_t http_client_request_wait(http_client_lane_t lane, uint16_t method, const char* uri, const char* data,
+        http_client_result_t* result, char* body, size_t body_size, TickType_t ticks_to_wait){
+    TickType_t start = xTaskGetTickCount();
+    http_client_future_t* future = (http_client_future_t*)calloc(1, sizeof(http_client_future_t));
+
+    if (future == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    future->done = xSemaphoreCreateBinary();
+    if (future->done == NULL) {
+        free(future);
+        return ESP_ERR_NO_MEM;
+    }
+    future->refs = 2;
+    future->body_size = (body) ? body_size : 0;
+
+    esp_err_t err = http_client_request(lane, method, uri, data, http_client_future_cb, future, ticks_to_wait, NULL);
+    if (err != ESP_OK) {
+        /* the callback will never run */
+        future->refs = 1;
+    }else {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (ticks_to_wait != portMAX_DELAY) {
+            ticks_to_wait = (elapsed < ticks_to_wait) ? ticks_to_wait - elapsed : 0;
+        }
+        if (xSemaphoreTake(future->done, ticks_to_wait) != pdTRUE) {
+            err = ESP_ERR_TIMEOUT;
+        }else {
+            err = future->result.err;
+            if (result) {
+                *result = future->result;
+            }
+            if (future->body && body) {
+                memcpy(body, future->body, future->result.body_len + 1);
+                if (result) {
+                    result->body = body;
+                }
+            }
+        }
+    }
+    http_client_future_release(future);
+    return err;
+}
+
+BaseType_t http_client_send_message_to_front(uint16_t method, const char* uri, const char* data){
+    return (http_client_submit(HC_LANE_CONTROL, true, method, uri, (data && strlen(data) > 0) ? data : NULL, data ? strlen(data) : 0,
+        false, pdMS_TO_TICKS(CONFIG_HTTP_CLIENT_SEND_TIMEOUT_MS), true) == ESP_OK) ? pdPASS : pdFALSE;
+}
+
+BaseType_t http_client_send_message(uint16_t method, const char* uri, const char* data){
+    return (http_client_submit(HC_LANE_NORMAL, false, method, uri, (data && strlen(data) > 0) ? data : NULL, data ? strlen(data) : 0,
+        false, pdMS_TO_TICKS(CONFIG_HTTP_CLIENT_SEND_TIMEOUT_MS), true) == ESP_OK) ? pdPASS : pdFALSE;
+}
+
+BaseType_t http_client_send_buffer(uint16_t method, const char* uri, char* data, size_t len){
+    return (http_client_submit(HC_LANE_NORMAL, false, method, uri, data, len,
+        true, pdMS_TO_TICKS(CONFIG_HTTP_CLIENT_SEND_TIMEOUT_MS), true) == ESP_OK) ? pdPASS : pdFALSE;
 }
 
 void http_client_set_response_callback(void (*func_ptr)(const char*, int) ){
@@ -189,6 +878,24 @@ void http_client_set_response_callback(void (*func_ptr)(const char*, int) ){
     }
 }
 
+void http_client_set_stream_callback(json_stream_cb_t cb, void* arg){
+    cb_stream_arg = arg;
+    cb_stream_ptr = cb;
+}
+
+esp_err_t http_client_on_response_key(const char* key, json_stream_cb_t cb, void* arg){
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < HTTP_CLIENT_POOL_SIZE && err == ESP_OK; i++) {
+        err = json_stream_on_key(&pool[i].stream, key, cb, arg);
+    }
+#ifdef CONFIG_HTTP_CLIENT_LONG_POLL
+    if (err == ESP_OK) {
+        err = json_stream_on_key(&poll_conn.stream, key, cb, arg);
+    }
+#endif
+    return err;
+}
+
 void http_client_set_ready_callback(void (*func_ptr)(void*) ){
     if (func_ptr) {
         push_cb(&cb_ready_ptr, func_ptr);
@@ -216,88 +923,351 @@ static char* get_http_method_name(esp_http_client_method_t method) {
     }
 }
 
+/**
+ * @brief receives every token of the responses: looks for the firmware file and forwards to the stream callback.
+ */
+static void http_client_stream_cb(const json_stream_token_t* token, void* arg) {
+#ifdef CONFIG_USE_OTA
+    http_client_conn_t* conn = (http_client_conn_t*)arg;
+    esp8266_config_t* wifi_config = wifi_manager_get_config();
+    size_t key_len = (wifi_config->esp_json_key) ? strlen(wifi_config->esp_json_key) : 0;
+
+    if (token->type == JSON_STREAM_STRING && token->depth == 1 && token->len && token->key && key_len &&
+            strncmp(token->key, wifi_config->esp_json_key, key_len) == 0) {
+        if (token->truncated) {
+            /* a cut file name or hash would download or check the wrong thing */
+            ESP_LOGW(TAG, "Value of %s longer than %d characters, ignored", token->key, JSON_STREAM_MAX_VALUE - 1);
+        }else {
+            /* the file and its attributes are taken together when the response is complete */
+            if (conn->ota_orders == NULL) {
+                conn->ota_orders = cJSON_CreateObject();
+            }
+            if (conn->ota_orders) {
+                cJSON_AddStringToObject(conn->ota_orders, token->key, token->value);
+            }
+        }
+    }
+#endif
+    if (cb_stream_ptr) {
+        cb_stream_ptr(token, cb_stream_arg);
+    }
+}
+
+/**
+ * @brief keeps the body for the response callback, at most CONFIG_HTTP_CLIENT_MAX_RESPONSE_LEN bytes.
+ */
+static esp_err_t http_client_buffer_response(http_client_conn_t* conn, const char* data, int data_len, bool sized) {
+    if (conn->output_buffer == NULL) {
+        const int content_len = (sized) ? esp_http_client_get_content_length(conn->client) : 0;
+        conn->output_size = (content_len > 0 && !esp_http_client_is_chunked_response(conn->client)) ?
+            MIN(content_len, MAX_HTTP_OUTPUT_BUFFER) : MAX_HTTP_OUTPUT_BUFFER;
+        conn->output_buffer = (char *) malloc(conn->output_size + 1);
+        conn->output_len = 0;
+        if (conn->output_buffer == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for output buffer");
+            return ESP_FAIL;
+        }
+    }
+    int copy_len = MIN(data_len, (conn->output_size - conn->output_len));
+    if (copy_len < data_len) {
+        ESP_LOGW(TAG, "Response truncated to %d bytes for the response callback", conn->output_size);
+    }
+    if (copy_len) {
+        memcpy(conn->output_buffer + conn->output_len, data, copy_len);
+    }
+    conn->output_len += copy_len;
+    conn->output_buffer[conn->output_len] = '\0';
+    return ESP_OK;
+}
+
+/**
+ * @brief JSON text of the response: tokenized, and buffered for the response or completion callback.
+ * @param sized data is the body as received, its size is given by the headers.
+ */
+static esp_err_t http_client_response_data(http_client_conn_t* conn, const char* data, int data_len, bool sized) {
+    json_stream_feed(&conn->stream, data, data_len);
+    if (cb_response_ptr || (conn->request && conn->request->done)) {
+        return http_client_buffer_response(conn, data, data_len, sized);
+    }
+    return ESP_OK;
+}
+
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+static void http_client_cbor_sink(const char* json, size_t len, void* arg) {
+    http_client_response_data((http_client_conn_t*)arg, json, len, false);
+}
+#endif
+
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+/* @brief FNV-1a, never 0 */
+static uint32_t http_client_cache_key(const char* url) {
+    uint32_t hash = 2166136261U;
+    while (*url) {
+        hash = (hash ^ (uint8_t)*url++) * 16777619U;
+    }
+    return (hash) ? hash : 1;
+}
+
+static http_client_cache_entry_t* http_client_cache_find(uint32_t key) {
+    for (int i = 0; i < CONFIG_HTTP_CLIENT_CACHE_SIZE; i++) {
+        if (cache[i].key == key) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief sets the conditional headers of the next request on the connection, conn->url must be set.
+ * @param get only GET requests are conditional, the headers of a previous one are removed otherwise.
+ */
+static void http_client_cache_prepare(http_client_conn_t* conn, bool get) {
+    char etag[HTTP_CLIENT_CACHE_ETAG_LEN] = {0};
+    char last_modified[HTTP_CLIENT_CACHE_DATE_LEN] = {0};
+
+    conn->cacheable = get;
+    if (get) {
+        taskENTER_CRITICAL();
+        http_client_cache_entry_t* entry = http_client_cache_find(http_client_cache_key(conn->url));
+        cache_stats.lookups++;
+        if (entry) {
+            entry->used = ++cache_clock;
+            memcpy(etag, entry->etag, sizeof(etag));
+            memcpy(last_modified, entry->last_modified, sizeof(last_modified));
+        }
+        taskEXIT_CRITICAL();
+    }
+    if (etag[0]) {
+        esp_http_client_set_header(conn->client, "If-None-Match", etag);
+    }else {
+        esp_http_client_delete_header(conn->client, "If-None-Match");
+    }
+    if (last_modified[0]) {
+        esp_http_client_set_header(conn->client, "If-Modified-Since", last_modified);
+    }else {
+        esp_http_client_delete_header(conn->client, "If-Modified-Since");
+    }
+}
+
+/**
+ * @brief keeps the validators of a full response, forgets the url if it has none.
+ */
+static void http_client_cache_store(http_client_conn_t* conn) {
+    uint32_t key = http_client_cache_key(conn->url);
+    bool validated = conn->etag[0] || conn->last_modified[0];
+
+    taskENTER_CRITICAL();
+    http_client_cache_entry_t* entry = http_client_cache_find(key);
+    if (entry == NULL && validated) {
+        /* a free entry or the least recently used one */
+        entry = &cache[0];
+        for (int i = 1; i < CONFIG_HTTP_CLIENT_CACHE_SIZE && entry->key; i++) {
+            if (cache[i].key == 0 || cache[i].used < entry->used) {
+                entry = &cache[i];
+            }
+        }
+    }
+    if (entry && validated) {
+        entry->key = key;
+        entry->used = ++cache_clock;
+        memcpy(entry->etag, conn->etag, sizeof(entry->etag));
+        memcpy(entry->last_modified, conn->last_modified, sizeof(entry->last_modified));
+        cache_stats.stores++;
+    }else if (entry) {
+        entry->key = 0;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/* @brief copies a validator, one too long to keep whole is not kept */
+static void http_client_cache_header(char* dst, size_t size, const char* value) {
+    size_t len = strlen(value);
+    if (len < size) {
+        memcpy(dst, value, len + 1);
+    }else {
+        dst[0] = '\0';
+    }
+}
+
+void http_client_get_cache_stats(http_client_cache_stats_t* stats) {
+    taskENTER_CRITICAL();
+    *stats = cache_stats;
+    taskEXIT_CRITICAL();
+}
+#endif
+
+static void http_client_reconnect_timer_cb(TimerHandle_t timer) {
+    uint32_t order = HC_ORDER_CONECT;
+    /* the timer task must not block */
+    if (is_wifi_connected() == pdPASS) {
+        xQueueSend(http_client_order_queue, &order, 0);
+    }
+}
+
+/**
+ * @brief plans the next connect attempt with exponential backoff.
+ */
+static void http_client_schedule_reconnect() {
+    TickType_t delay = http_client_backoff(connect_attempt, CONFIG_HTTP_CLIENT_RECONNECT_MIN_MS, CONFIG_HTTP_CLIENT_RECONNECT_MAX_MS);
+    if (connect_attempt < UINT8_MAX) {
+        connect_attempt++;
+    }
+    ESP_LOGI(TAG, "Reconnect in %d ms", delay * portTICK_PERIOD_MS);
+    xTimerChangePeriod(reconnect_timer, delay, 0);
+}
+
 static esp_err_t http_client_handler(esp_http_client_event_t *evt) {
-    static int output_len;       // Stores number of bytes read
-    static uint8_t error_count = 0;
+    http_client_conn_t* conn = (http_client_conn_t*)evt->user_data;
     switch(evt->event_id) {
         case HTTP_EVENT_ERROR:
-            error_count++;
-            ESP_LOGW(TAG, "HTTP_EVENT_ERROR: %d", error_count);
-            if (error_count == CONFIG_HTTP_CLIENT_MAX_ERROR) {
+            if (conn->push) {
+                /* a held poll ending in a timeout is no backend failure, the poll task backs off itself */
+                ESP_LOGD(TAG, "HTTP_EVENT_ERROR on the long-poll connection");
+                break;
+            }
+            conn->error_count++;
+            ESP_LOGW(TAG, "HTTP_EVENT_ERROR: %d", conn->error_count);
+            if (conn->error_count == CONFIG_HTTP_CLIENT_MAX_ERROR) {
                 http_client_send_order(HC_ORDER_DISCONNECT);
             }
-            if (error_count > CONFIG_HTTP_CLIENT_MAX_TRY_CONNECT) {
+            if (conn->error_count > CONFIG_HTTP_CLIENT_MAX_TRY_CONNECT) {
                 FLASH_LOGE("The number of http client errors has exceeded the allowable value");
                 delayed_reboot(2000);
             }
             break;
-        case HTTP_EVENT_ON_CONNECTED:
-            error_count = 0;
-            ESP_LOGW(TAG, "HTTP_EVENT_ON_CONNECTED");
+        case HTTP_EVENT_ON_CONNECTED: {
+            /* only a new connection gets here, a kept alive one is reused silently */
+            uint32_t connect_ms = (xTaskGetTickCount() - conn->perform_start) * portTICK_PERIOD_MS;
+            taskENTER_CRITICAL();
+            conn_stats.connects++;
+            conn_stats.connect_ms += connect_ms;
+            conn_stats.connect_max_ms = MAX(conn_stats.connect_max_ms, connect_ms);
+            taskEXIT_CRITICAL();
+            conn->error_count = 0;
+            ESP_LOGW(TAG, "HTTP_EVENT_ON_CONNECTED in %u ms", connect_ms);
             break;
+        }
         case HTTP_EVENT_HEADER_SENT:
             ESP_LOGD(TAG, "HTTP_EVENT_HEADER_SENT");
+            conn->sent = true;
+            /* a new response follows on the connection */
+            json_stream_init(&conn->stream, http_client_stream_cb, conn);
+#ifdef CONFIG_USE_OTA
+            cJSON_Delete(conn->ota_orders);
+            conn->ota_orders = NULL;
+#endif
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+            conn->cbor = false;
+#endif
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+            conn->etag[0] = '\0';
+            conn->last_modified[0] = '\0';
+#endif
+            /* body of a previous attempt */
+            if (conn->output_buffer != NULL) {
+                free(conn->output_buffer);
+                conn->output_buffer = NULL;
+            }
+            conn->output_len = 0;
             break;
         case HTTP_EVENT_ON_HEADER:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+            if (strcasecmp(evt->header_key, "ETag") == 0) {
+                http_client_cache_header(conn->etag, sizeof(conn->etag), evt->header_value);
+            }else if (strcasecmp(evt->header_key, "Last-Modified") == 0) {
+                http_client_cache_header(conn->last_modified, sizeof(conn->last_modified), evt->header_value);
+            }
+#endif
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+            if (strcasecmp(evt->header_key, "Content-Type") == 0 &&
+                    strncasecmp(evt->header_value, CBOR_CONTENT_TYPE, sizeof(CBOR_CONTENT_TYPE) - 1) == 0) {
+                conn->cbor = true;
+                cbor_decoder_init(&conn->cbor_decoder, http_client_cbor_sink, conn);
+                taskENTER_CRITICAL();
+                cbor_stats.responses++;
+                taskEXIT_CRITICAL();
+            }
+#endif
             break;
         case HTTP_EVENT_ON_DATA:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
             /*
-             *  Check for chunked encoding is added as the URL for chunked encoding used in this example returns binary data.
-             *  However, event handler can also be used in case chunked encoding is used.
+             *  Plain and chunked bodies are tokenized piece by piece in constant RAM,
+             *  the body is buffered only for the response or completion callback.
              */
-            if (!esp_http_client_is_chunked_response(evt->client)) {
-                // If user_data buffer is configured, copy the response into the buffer
-                int copy_len = 0;
-                if (evt->user_data) {
-                    copy_len = MIN(evt->data_len, (MAX_HTTP_OUTPUT_BUFFER - output_len));
-                    if (copy_len) {
-                        memcpy(evt->user_data + output_len, evt->data, copy_len);
-                    }
-                } else {
-                    const int buffer_len = esp_http_client_get_content_length(evt->client);
-                    if (output_buffer == NULL) {
-                        output_buffer = (char *) malloc(buffer_len);
-                        output_len = 0;
-                        if (output_buffer == NULL) {
-                            ESP_LOGE(TAG, "Failed to allocate memory for output buffer");
-                            return ESP_FAIL;
-                        }
-                    }
-                    copy_len = MIN(evt->data_len, (buffer_len - output_len));
-                    if (copy_len) {
-                        memcpy(output_buffer + output_len, evt->data, copy_len);
-                    }
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+            if (conn->cbor) {
+                /* decoded to JSON text, the consumers see the same responses in both formats */
+                if (cbor_decoder_feed(&conn->cbor_decoder, (const uint8_t*)evt->data, evt->data_len) != ESP_OK) {
+                    ESP_LOGW(TAG, "Malformed CBOR response");
                 }
-                output_len += copy_len;
+                break;
             }
-
-            break;
+#endif
+            return http_client_response_data(conn, (const char*)evt->data, evt->data_len, true);
         case HTTP_EVENT_ON_FINISH:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_FINISH");
-            if (output_buffer != NULL) {
-                // Response is accumulated in output_buffer. Uncomment the below line to print the accumulated response
-                // ESP_LOG_BUFFER_HEX(TAG, output_buffer, output_len);
-#ifndef CONFIG_USE_OTA
-                if(cb_response_ptr) cb_response_ptr( output_buffer, output_len );
-#else
-                if(!ota(output_buffer, output_len)){
-                    if(cb_response_ptr) cb_response_ptr( output_buffer, output_len );
-                }else {
-                    run_cb(cb_not_ready_ptr, NULL);
-                    xEventGroupClearBits(http_client_events, HC_STATUS_OK);
-                    firmware_upgrade(cb_ota_finish);
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+            if (conn->cacheable) {
+                int status = esp_http_client_get_status_code(evt->client);
+                if (status == 304) {
+                    /* unchanged since the last response, which the callbacks already saw */
+                    taskENTER_CRITICAL();
+                    cache_stats.hits++;
+                    taskEXIT_CRITICAL();
+                    break;
+                }
+                if (status == 200) {
+                    http_client_cache_store(conn);
                 }
-#endif                
-                free(output_buffer);
-                output_buffer = NULL;
             }
-            output_len = 0;
+#endif
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+            if (conn->cbor) {
+                cbor_decoder_finish(&conn->cbor_decoder);
+            }
+#endif
+            json_stream_finish(&conn->stream);
+#ifdef CONFIG_USE_OTA
+            bool ota_pending = conn->ota_orders && ota_set_orders(conn->ota_orders);
+            cJSON_Delete(conn->ota_orders);
+            conn->ota_orders = NULL;
+            if (ota_pending) {
+                run_cb(cb_not_ready_ptr, NULL);
+                xEventGroupClearBits(http_client_events, HC_STATUS_OK);
+                /* the download does a handshake of its own, leave it the heap of the idle sessions */
+                http_client_release_idle();
+                firmware_upgrade(cb_ota_finish);
+            }else
+#endif
+            if (conn->request && conn->request->done) {
+                /* kept for the completion callback, reported by the worker with the final status */
+                break;
+            }else if (conn->output_buffer != NULL) {
+                // Response is accumulated in output_buffer. Uncomment the below line to print the accumulated response
+                // ESP_LOG_BUFFER_HEX(TAG, conn->output_buffer, conn->output_len);
+                if(cb_response_ptr) cb_response_ptr( conn->output_buffer, conn->output_len );
+            }
+            if (conn->output_buffer != NULL) {
+                free(conn->output_buffer);
+                conn->output_buffer = NULL;
+            }
+            conn->output_len = 0;
             break;
         case HTTP_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "HTTP_EVENT_DISCONNECTED");
 
+            if (conn->output_buffer != NULL && !(conn->request && conn->request->done)) {
+                free(conn->output_buffer);
+                conn->output_buffer = NULL;
+            }
+            conn->output_len = 0;
+            if (conn->closing || conn->push) {
+                /* pool connection of an older generation released by its worker, or the long-poll one */
+                break;
+            }
+
             /* callback */
             run_cb(cb_not_ready_ptr, NULL);
             
@@ -308,34 +1278,162 @@ static esp_err_t http_client_handler(esp_http_client_event_t *evt) {
                 ESP_LOGI(TAG, "Last esp error code: 0x%x", err);
                 ESP_LOGI(TAG, "Last mbedtls failure: 0x%x", mbedtls_err);
             }
-            if (output_buffer != NULL) {
-                free(output_buffer);
-                output_buffer = NULL;
-            }
-            output_len = 0;
-            error_count = 0;
-            vTaskDelay(5000 / portTICK_RATE_MS);
-            http_client_send_order(HC_ORDER_CONECT);
+            conn->error_count = 0;
+            http_client_schedule_reconnect();
             break;
     }
     return ESP_OK;
 }
 
-static void http_client_try_to_send(const http_client_request_t* msg) {
-    esp_err_t err;
-    uint8_t try_to_send = CONFIG_HTTP_CLIENT_MAX_TRY_SEND;
+/**
+ * @brief fills the client configuration for the backend from the saved settings.
+ */
+static void http_client_get_config(http_client_conn_t* conn, esp_http_client_config_t* http_client_config) {
+    esp8266_config_t* wifi_config = wifi_manager_get_config();
+
+    memset(http_client_config, 0x00, sizeof(esp_http_client_config_t));
+    http_client_config->event_handler = http_client_handler;
+    http_client_config->user_data = conn;
+    http_client_config->transport_type = HTTP_TRANSPORT_OVER_TCP;
+    http_client_config->host = wifi_config->server_address;
+    http_client_config->port = wifi_config->server_port;
+    http_client_config->timeout_ms = 1000;
+#ifdef CONFIG_HTTP_CLIENT_LONG_POLL
+    if (conn->push) {
+        /* the response comes when the backend has orders, at the latest after the hold time */
+        http_client_config->timeout_ms = (CONFIG_HTTP_CLIENT_POLL_HOLD_S + 5) * 1000;
+    }
+#endif
+    http_client_config->method = HTTP_METHOD_GET;
+    http_client_config->url = get_full_path(conn, CONFIG_HTTP_CLIENT_CONNECT_PATH);
+
+    if (strcmp(wifi_config->server_auth, "no") == 0 || strcmp(wifi_config->server_auth, "ssl") == 0) {
+        http_client_config->auth_type = HTTP_AUTH_TYPE_NONE;
+    }else {
+        http_client_config->auth_type = HTTP_AUTH_TYPE_BASIC;
+    }
+
+    if (strcmp(wifi_config->server_auth, "basic") == 0) {
+        http_client_config->username = wifi_config->client_username;
+        http_client_config->password = wifi_config->client_password;
+    }else
+    if (strcmp(wifi_config->server_auth, "ssl") == 0) {
+        http_client_config->transport_type = HTTP_TRANSPORT_OVER_SSL;
+        http_client_config->cert_pem = wifi_config->client_ca;
+        http_client_config->client_cert_pem = wifi_config->client_crt;
+        http_client_config->client_key_pem = wifi_config->client_key;
+#ifdef CONFIG_SKIP_COMMON_NAME_CHECK
+        http_client_config->skip_cert_common_name_check = true;
+#endif
+    }
+}
+
+/**
+ * @brief releases a connection, the event handler does not take it for a link loss.
+ */
+static void http_client_conn_release(http_client_conn_t* conn) {
+    if (conn->client) {
+        conn->closing = true;
+        esp_http_client_close(conn->client);
+        esp_http_client_cleanup(conn->client);
+        conn->client = NULL;
+        conn->closing = false;
+    }
+}
+
+/**
+ * @brief closes the pool connections no task is using.
+ * A lock held by the calling task is not taken again, its connection stays open.
+ */
+static void http_client_release_idle() {
+    for (int i = 0; i < HTTP_CLIENT_POOL_SIZE; i++) {
+        if (pool[i].lock && xSemaphoreTake(pool[i].lock, 0) == pdTRUE) {
+            http_client_conn_release(&pool[i]);
+            xSemaphoreGive(pool[i].lock);
+        }
+    }
+}
+
+/**
+ * @brief opens the worker connection lazily and reopens it after HC_ORDER_DISCONNECT.
+ * The TCP/TLS session is set up by the first request and kept alive by the server between requests.
+ */
+static esp_err_t http_client_conn_acquire(http_client_conn_t* conn) {
+    uint32_t generation = pool_generation;
+
+    if (conn->client && conn->generation != generation) {
+        http_client_conn_release(conn);
+    }
+    if (conn->client == NULL) {
+        esp_http_client_config_t http_client_config;
+        http_client_get_config(conn, &http_client_config);
+        conn->client = esp_http_client_init(&http_client_config);
+        if (conn->client == NULL) {
+            return ESP_FAIL;
+        }
+        conn->generation = generation;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief sends the request, retrying connection and server errors with exponential backoff
+ * until CONFIG_HTTP_CLIENT_MAX_TRY_SEND attempts or the request deadline.
+ * A POST or PUT which reached the server is not sent again: it may have been applied.
+ * @return true if the request failed for a reason which may pass and may be sent again.
+ */
+static bool http_client_try_to_send(http_client_conn_t* conn, const http_client_request_t* msg, esp_err_t* result, int* status) {
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    int http_code = 0;
+    bool transient = true;
+    bool idempotent = (msg->method == HTTP_METHOD_GET || msg->method == HTTP_METHOD_DELETE);
+
+    for (uint8_t attempt = 0; attempt < CONFIG_HTTP_CLIENT_MAX_TRY_SEND; attempt++) {
+        if ((int32_t)(xTaskGetTickCount() - msg->deadline) >= 0) {
+            ESP_LOGW(TAG, "Request to %s expired", msg->uri);
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        if (!http_client_breaker_allow()) {
+            /* fail fast, the backend is known to be down */
+            err = ESP_ERR_INVALID_STATE;
+            break;
+        }
 
-    do {
-        err = esp_http_client_perform(client);
-        if (err != ESP_ERR_HTTP_FETCH_HEADER) {
+        conn->perform_start = xTaskGetTickCount();
+        conn->sent = false;
+        err = esp_http_client_perform(conn->client);
+        taskENTER_CRITICAL();
+        conn_stats.requests++;
+        taskEXIT_CRITICAL();
+        http_code = esp_http_client_get_status_code(conn->client);
+        transient = (err != ESP_OK || http_code >= 500);
+        http_client_breaker_result(transient);
+        if (transient && !idempotent && conn->sent) {
+            ESP_LOGW(TAG, "%s %s reached the server, not sent again", get_http_method_name(msg->method), msg->uri);
+            transient = false;
+        }
+        if (!transient) {
             break;
-        }   
-        vTaskDelay(100 / portTICK_RATE_MS);
-    }while(try_to_send--);
+        }
 
-    int http_code = esp_http_client_get_status_code(client);
-    if (err == ESP_OK && http_code == 200) {
+        TickType_t delay = http_client_backoff(attempt, CONFIG_HTTP_CLIENT_RETRY_BASE_MS, CONFIG_HTTP_CLIENT_RETRY_MAX_MS);
+        if ((int32_t)(xTaskGetTickCount() + delay - msg->deadline) >= 0) {
+            break;
+        }
+        vTaskDelay(delay);
+    }
+
+    if (err == ESP_OK && (http_code == 200 || http_code == 304)) {
         xEventGroupSetBits(http_client_events, HC_SEND_OK);
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+    } else if (err == ESP_OK && http_code == 415 && conn->cbor_body) {
+        /* no failure yet, http_client_send_body() sends the body again as JSON */
+#endif
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        /* not logged to flash, every request fails this way while the breaker is open */
+        ESP_LOGW(TAG, "%s %s rejected, circuit breaker open", get_http_method_name(msg->method), msg->uri);
+        xEventGroupSetBits(http_client_events, HC_SEND_FAIL);
     } else {
         FLASH_LOGE("%s request failed: %s, http code: %d", 
             get_http_method_name(msg->method), 
@@ -343,11 +1441,145 @@ static void http_client_try_to_send(const http_client_request_t* msg) {
             http_code);
         xEventGroupSetBits(http_client_events, HC_SEND_FAIL);
     }   
+    *result = err;
+    *status = http_code;
+    return transient;
+}
+
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+/**
+ * @brief compresses the body of a request, len is updated.
+ * @return the gzip body to send instead, to be freed, NULL to send the body as it is.
+ */
+static char* http_client_compress(const char* uri, const char* data, size_t* len) {
+    if (data == NULL || *len < CONFIG_HTTP_CLIENT_GZIP_MIN_SIZE) {
+        return NULL;
+    }
+    /* compression is useful only if the result is smaller */
+    char* out = (char*)malloc(*len);
+    if (out == NULL) {
+        return NULL;
+    }
+    int64_t start = esp_timer_get_time();
+    size_t compressed = gzip_compress((const uint8_t*)data, *len, (uint8_t*)out, *len - 1);
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+    taskENTER_CRITICAL();
+    gzip_stats.time_us += elapsed;
+    if (compressed) {
+        gzip_stats.requests++;
+        gzip_stats.bytes_in += *len;
+        gzip_stats.bytes_out += compressed;
+    }else {
+        gzip_stats.skipped++;
+    }
+    taskEXIT_CRITICAL();
+
+    if (compressed == 0) {
+        free(out);
+        return NULL;
+    }
+    ESP_LOGD(TAG, "Body of %s compressed %d -> %d bytes in %u us", uri, *len, compressed, elapsed);
+    *len = compressed;
+    return out;
+}
+
+void http_client_get_gzip_stats(http_client_gzip_stats_t* stats) {
+    taskENTER_CRITICAL();
+    *stats = gzip_stats;
+    taskEXIT_CRITICAL();
+}
+#endif
+
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+/**
+ * @brief encodes the JSON body of a request to CBOR, len is updated.
+ * @return the CBOR body to send instead, to be freed, NULL to send JSON.
+ */
+static char* http_client_encode_cbor(const http_client_request_t* msg, size_t* len) {
+    if (cbor_refused || msg->data == NULL) {
+        return NULL;
+    }
+    char* out = (char*)malloc(msg->data_len);
+    if (out == NULL) {
+        return NULL;
+    }
+    size_t encoded = cbor_from_json(msg->data, msg->data_len, (uint8_t*)out, msg->data_len);
+    if (encoded == 0) {
+        /* not convertible or not smaller */
+        free(out);
+        return NULL;
+    }
+    taskENTER_CRITICAL();
+    cbor_stats.bodies++;
+    cbor_stats.json_bytes += msg->data_len;
+    cbor_stats.cbor_bytes += encoded;
+    taskEXIT_CRITICAL();
+    *len = encoded;
+    return out;
+}
+
+void http_client_get_cbor_stats(http_client_cbor_stats_t* stats) {
+    taskENTER_CRITICAL();
+    *stats = cbor_stats;
+    taskEXIT_CRITICAL();
+}
+#endif
+
+/**
+ * @brief sends a POST or PUT request, the body encoded and compressed once for all the retries.
+ * @return see http_client_try_to_send()
+ */
+static bool http_client_send_body(http_client_conn_t* conn, const http_client_request_t* msg, esp_err_t* err, int* status) {
+    const char* body = msg->data;
+    size_t body_len = msg->data_len;
+    char* encoded = NULL;
+    char* compressed = NULL;
+    bool failed;
+
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+    encoded = http_client_encode_cbor(msg, &body_len);
+    bool cbor = conn->cbor_body = (encoded != NULL);
+    if (cbor) {
+        body = encoded;
+        esp_http_client_set_header(conn->client, "Content-Type", CBOR_CONTENT_TYPE);
+    }
+#endif
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+    compressed = http_client_compress(msg->uri, body, &body_len);
+    if (compressed) {
+        body = compressed;
+        esp_http_client_set_header(conn->client, "Content-Encoding", "gzip");
+    }
+#endif
+    esp_http_client_set_post_field(conn->client, body, body_len);
+    failed = http_client_try_to_send(conn, msg, err, status);
+    free(compressed);
+    free(encoded);
+
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+    conn->cbor_body = false;
+    if (cbor && *status == 415) {
+        /* Unsupported Media Type: the backend takes JSON only */
+        ESP_LOGW(TAG, "Backend refuses CBOR bodies, sending JSON");
+        cbor_refused = true;
+        esp_http_client_set_header(conn->client, "Content-Type", "application/json");
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+        esp_http_client_delete_header(conn->client, "Content-Encoding");
+#endif
+        return http_client_send_body(conn, msg, err, status);
+    }
+#endif
+    return failed;
 }
 
+/**
+ * @brief send worker: pulls requests from the shared queue and runs them on its own connection,
+ * so a slow response only holds back the worker waiting for it.
+ */
 static void http_client_send_task( void * pvParameters ) {
-	http_client_request_t msg;
-	BaseType_t xStatus;
+    http_client_conn_t* conn = (http_client_conn_t*)pvParameters;
+	http_client_request_t* msg;
 
     /* main processing loop */
     for(;;){
@@ -357,30 +1589,71 @@ static void http_client_send_task( void * pvParameters ) {
                 pdFALSE,                    // HC_STATUS_OK should be not cleared before returning.
                 pdFALSE,                    // Don't wait for both bits, either bit will do.
                 portMAX_DELAY );            // Wait until the bit be set.          
-        xStatus = xQueueReceive( http_client_send_queue, &msg, portMAX_DELAY );
-        if( xStatus == pdPASS ){
-            esp_http_client_set_method(client, msg.method); 
-            esp_http_client_set_url(client, get_full_path(msg.uri));
-            esp_http_client_set_header(client, "Content-Type", "application/json");
+        msg = http_client_lane_get();
+        if( msg ){
+            xSemaphoreTake(conn->lock, portMAX_DELAY);
+            if (http_client_conn_acquire(conn) != ESP_OK) {
+                xSemaphoreGive(conn->lock);
+                FLASH_LOGE("Failed to open backend connection");
+                xEventGroupSetBits(http_client_events, HC_SEND_FAIL);
+                http_client_request_done(msg, ESP_FAIL, 0, true, NULL, 0);
+                http_client_request_free(msg);
+                continue;
+            }
+            esp_http_client_set_method(conn->client, msg->method); 
+            esp_http_client_set_url(conn->client, get_full_path(conn, msg->uri));
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+            http_client_cache_prepare(conn, msg->method == HTTP_METHOD_GET);
+#endif
+            esp_http_client_set_header(conn->client, "Content-Type", "application/json");
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+            esp_http_client_set_header(conn->client, "Accept", CBOR_CONTENT_TYPE ", application/json");
+#endif
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+            /* the connection is reused, drop the header of a previous compressed body */
+            esp_http_client_delete_header(conn->client, "Content-Encoding");
+#endif
 
-            // ESP_LOGI(TAG, "%s", get_http_method_name(msg.method));
+            // ESP_LOGI(TAG, "%s", get_http_method_name(msg->method));
 
-            switch(msg.method){
+            bool failed = false;
+            esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+            int status = 0;
+            conn->request = msg;
+            switch(msg->method){
             case HTTP_METHOD_GET:
             case HTTP_METHOD_DELETE:
-                http_client_try_to_send(&msg);
+                /* the connection is reused, drop the body of a previous request */
+                esp_http_client_set_post_field(conn->client, NULL, 0);
+                failed = http_client_try_to_send(conn, msg, &err, &status);
                 break;
             case HTTP_METHOD_POST:                      
             case HTTP_METHOD_PUT:
-                if(msg.data) {
-                    esp_http_client_set_post_field(client, msg.data, strlen(msg.data));
-                }
-                http_client_try_to_send(&msg);
+                failed = http_client_send_body(conn, msg, &err, &status);
                 break;
             default:
-                FLASH_LOGE("Unknown method: %d", msg.method);
+                FLASH_LOGE("Unknown method: %d", msg->method);
                 break;
             } /* end of switch/case */
+            conn->request = NULL;
+            if (msg->done) {
+                http_client_request_done(msg, err, status, failed, conn->output_buffer, conn->output_len);
+                if (conn->output_buffer != NULL) {
+                    free(conn->output_buffer);
+                    conn->output_buffer = NULL;
+                }
+                conn->output_len = 0;
+            }
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+            else if (failed) {
+                http_client_store(msg->method, msg->uri, msg->data, msg->data_len);
+            }
+#else
+            (void)failed;
+#endif
+            xSemaphoreGive(conn->lock);
+            /* the body was sent from the request, release it only now */
+            http_client_request_free(msg);
         } /* end of if status=pdPASS */
     } /* end of for loop */
 
@@ -389,6 +1662,149 @@ static void http_client_send_task( void * pvParameters ) {
 	vTaskDelete( NULL );    
 }
 
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+/* @brief outcome of the replayed record, given by its completion callback */
+static SemaphoreHandle_t outbox_replayed = NULL;
+static http_client_result_t outbox_result;
+
+static void http_client_outbox_done(const http_client_result_t* result, void* arg) {
+    /* the response goes where it would have gone when the request was made */
+    if (cb_response_ptr && result->body) {
+        cb_response_ptr(result->body, result->body_len);
+    }
+    outbox_result = *result;
+    outbox_result.body = NULL;
+    xSemaphoreGive(outbox_replayed);
+}
+
+/**
+ * @brief replays the outbox in order while the backend is connected, one record at a time,
+ * at most CONFIG_HTTP_CLIENT_OUTBOX_REPLAY_PER_SEC records per second.
+ * A record is removed once the backend took it, a failed one stays the oldest and is replayed again.
+ */
+static void http_client_outbox_task( void * pvParameters ) {
+    outbox_stats_t stats;
+    uint8_t failures = 0;
+
+    /* main processing loop */
+    for(;;){
+        xEventGroupWaitBits(
+                http_client_events,         // The event group being tested.
+                HC_STATUS_OK,               // The bits within the event group to wait for.
+                pdFALSE,                    // HC_STATUS_OK should be not cleared before returning.
+                pdFALSE,                    // Don't wait for both bits, either bit will do.
+                portMAX_DELAY );            // Wait until the bit be set.          
+        outbox_get_stats(&stats);
+        if (stats.records == 0) {
+            /* woken up by the next stored request */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        TickType_t wait = http_client_breaker_wait();
+        if (wait) {
+            /* the replayed record would only fail fast */
+            vTaskDelay(wait);
+            continue;
+        }
+        uint32_t number;
+        http_client_request_t* msg = outbox_peek(&number);
+        if (msg == NULL) {
+            continue;
+        }
+        msg->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_HTTP_CLIENT_REQUEST_DEADLINE_MS);
+        msg->done = http_client_outbox_done;
+        taskENTER_CRITICAL();
+        uint32_t id = msg->id = ++request_id;
+        taskEXIT_CRITICAL();
+        /* the normal lane, replays are not held back by the bulk traffic */
+        if (http_client_lane_put(HC_LANE_NORMAL, msg, false, portMAX_DELAY) != pdPASS) {
+            http_client_request_free(msg);
+            continue;
+        }
+        /* a late outcome of a request dropped by http_client_destroy() is skipped */
+        do {
+            xSemaphoreTake(outbox_replayed, portMAX_DELAY);
+        } while (outbox_result.id != id);
+
+        if (!outbox_result.retry) {
+            /* taken, refused for good, or a write which reached the backend and is not sent twice */
+            outbox_remove(number);
+            failures = 0;
+        }else {
+            outbox_replay_failed(number);
+            vTaskDelay(http_client_backoff(failures, CONFIG_HTTP_CLIENT_RETRY_BASE_MS, CONFIG_HTTP_CLIENT_RETRY_MAX_MS));
+            if (failures < UINT8_MAX) {
+                failures++;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(1000 / CONFIG_HTTP_CLIENT_OUTBOX_REPLAY_PER_SEC));
+    } /* end of for loop */
+
+	vTaskDelete( NULL );    
+}
+#endif
+
+#ifdef CONFIG_HTTP_CLIENT_LONG_POLL
+/**
+ * @brief push channel: keeps a request held by the backend on CONFIG_HTTP_CLIENT_POLL_PATH.
+ * The backend answers as soon as it has orders, which reach the response callback and the key handlers
+ * like those of the connect path, or with 204 after the hold time; the next poll follows at once.
+ * Failures are retried with exponential backoff.
+ */
+static void http_client_poll_task( void * pvParameters ) {
+    http_client_conn_t* conn = &poll_conn;
+    uint8_t attempt = 0;
+    size_t len;
+
+    for(;;){
+        if ((xEventGroupGetBits(http_client_events) & HC_STATUS_OK) == 0) {
+            /* offline or upgrading, do not hold a session meanwhile */
+            http_client_conn_release(conn);
+            attempt = 0;
+        }
+        xEventGroupWaitBits(http_client_events, HC_STATUS_OK, pdFALSE, pdFALSE, portMAX_DELAY);
+
+        esp_err_t err = http_client_conn_acquire(conn);
+        int status = 0;
+        if (err == ESP_OK) {
+            get_full_path(conn, CONFIG_HTTP_CLIENT_POLL_PATH);
+            len = strlen(conn->url);
+            snprintf(conn->url + len, MAX_HTTP_URL_SIZE - len, "%swait=%d",
+                strchr(conn->url, '?') ? "&" : "?", CONFIG_HTTP_CLIENT_POLL_HOLD_S);
+            esp_http_client_set_method(conn->client, HTTP_METHOD_GET);
+            esp_http_client_set_url(conn->client, conn->url);
+            esp_http_client_set_header(conn->client, "Content-Type", "application/json");
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+            esp_http_client_set_header(conn->client, "Accept", CBOR_CONTENT_TYPE ", application/json");
+#endif
+            err = esp_http_client_perform(conn->client);
+            status = esp_http_client_get_status_code(conn->client);
+        }
+
+        if (err == ESP_OK && (status == 200 || status == 204)) {
+            /* orders delivered by the event handler, or none within the hold time */
+            attempt = 0;
+            continue;
+        }
+        if (err == ESP_OK && status >= 400 && status < 500) {
+            /* the backend has no push channel, ask again now and then */
+            ESP_LOGW(TAG, "Long-poll %s answered %d", CONFIG_HTTP_CLIENT_POLL_PATH, status);
+            attempt = UINT8_MAX;
+        }
+        /* the session may be stale after a failure */
+        http_client_conn_release(conn);
+        TickType_t delay = http_client_backoff(attempt, CONFIG_HTTP_CLIENT_RECONNECT_MIN_MS, CONFIG_HTTP_CLIENT_RECONNECT_MAX_MS);
+        if (attempt < UINT8_MAX) {
+            attempt++;
+        }
+        ESP_LOGI(TAG, "Long-poll again in %d ms", delay * portTICK_PERIOD_MS);
+        vTaskDelay(delay);
+    } /* end of for loop */
+
+	vTaskDelete( NULL );
+}
+#endif
+
 static void http_client_order_task( void * pvParameters ) {
 	uint32_t order;
 	BaseType_t xStatus;
@@ -402,63 +1818,50 @@ static void http_client_order_task( void * pvParameters ) {
             switch(order){
                 case HC_ORDER_DISCONNECT:
                     if ((uxBits & HC_STATUS_OK) != 0) {
-                        esp_http_client_close(client);
-                        esp_http_client_cleanup(client);
-                        client = NULL;
+                        /* workers and the next probe reopen their connections */
+                        pool_generation++;
                         ESP_LOGI(TAG, "HC_ORDER_DISCONNECT");
                     }
                     break;
                 case HC_ORDER_CONECT: 
                     if ((uxBits & HC_STATUS_OK) == 0) {
-                        esp8266_config_t* wifi_config = wifi_manager_get_config();
-
-                        esp_http_client_config_t http_client_config = {
-                            .event_handler = http_client_handler,
-                            .user_data = output_buffer,
-                            .transport_type = HTTP_TRANSPORT_OVER_TCP,
-                            .host = wifi_config->server_address,
-                            .port = wifi_config->server_port,
-                            .timeout_ms = 1000,
-                            .method = HTTP_METHOD_GET,
-                            .url = get_full_path(CONFIG_HTTP_CLIENT_CONNECT_PATH),
-                        };
-                        
-                        if (strcmp(wifi_config->server_auth, "no") == 0 || strcmp(wifi_config->server_auth, "ssl") == 0) {
-                            http_client_config.auth_type = HTTP_AUTH_TYPE_NONE;
-                        }else {
-                            http_client_config.auth_type = HTTP_AUTH_TYPE_BASIC;
-                        }
-
-                        if (strcmp(wifi_config->server_auth, "basic") == 0) {
-                            http_client_config.username = wifi_config->client_username;
-                            http_client_config.password = wifi_config->client_password;
-                        }else
-                        if (strcmp(wifi_config->server_auth, "ssl") == 0) {
-                            http_client_config.transport_type = HTTP_TRANSPORT_OVER_SSL;
-                            http_client_config.cert_pem = wifi_config->client_ca;
-                            http_client_config.client_cert_pem = wifi_config->client_crt;
-                            http_client_config.client_key_pem = wifi_config->client_key;
-#ifdef CONFIG_SKIP_COMMON_NAME_CHECK
-                            http_client_config.skip_cert_common_name_check = true;
+                        http_client_conn_t* conn = PROBE_CONN;
+                        esp_err_t err;
+
+                        /* one attempt per order, the reconnect timer orders the next one */
+                        xSemaphoreTake(conn->lock, portMAX_DELAY);
+                        err = http_client_conn_acquire(conn);
+                        if (err == ESP_OK) {
+                            esp_http_client_set_method(conn->client, HTTP_METHOD_GET);
+                            esp_http_client_set_url(conn->client, get_full_path(conn, CONFIG_HTTP_CLIENT_CONNECT_PATH));
+#ifdef CONFIG_HTTP_CLIENT_CACHE
+                            http_client_cache_prepare(conn, true);
+#endif
+                            esp_http_client_set_post_field(conn->client, NULL, 0);
+                            esp_http_client_set_header(conn->client, "Content-Type", "application/json");
+#ifdef CONFIG_HTTP_CLIENT_CBOR
+                            esp_http_client_set_header(conn->client, "Accept", CBOR_CONTENT_TYPE ", application/json");
 #endif
+#ifdef CONFIG_HTTP_CLIENT_GZIP
+                            esp_http_client_delete_header(conn->client, "Content-Encoding");
+#endif
+                            conn->perform_start = xTaskGetTickCount();
+                            err = esp_http_client_perform(conn->client);
+                        }
+                        xSemaphoreGive(conn->lock);
+                        if (err == ESP_OK) {
+                            ESP_LOGI(TAG, "Conection success!");
+                            connect_attempt = 0;
+                            xTimerStop(reconnect_timer, 0);
+                            http_client_breaker_result(false);
+                            xEventGroupSetBits(http_client_events, HC_STATUS_OK);
+
+                            /* callback */
+                            run_cb(cb_ready_ptr, NULL);
+                        }else {
+                            ESP_LOGE(TAG, "Conection fail: %s", esp_err_to_name(err));
+                            http_client_schedule_reconnect();
                         }
-
-                        do {
-                            client = esp_http_client_init(&http_client_config);
-                            esp_http_client_set_header(client, "Content-Type", "application/json");
-                            esp_err_t err = esp_http_client_perform(client);
-                            if (err == ESP_OK) {
-                                ESP_LOGI(TAG, "Conection success!");
-                                xEventGroupSetBits(http_client_events, HC_STATUS_OK);
-
-                                /* callback */
-                                run_cb(cb_ready_ptr, NULL);
-                                break;
-                            }else {
-                                ESP_LOGE(TAG, "Conection fail: %s", esp_err_to_name(err));
-                                vTaskDelay(2000 / portTICK_RATE_MS);
-                            }                           
-                        } while(1);
                     }      
                     break;
             } /* end of switch/case */
@@ -472,8 +1875,18 @@ static void http_client_order_task( void * pvParameters ) {
 
 void http_client_initialize() {
 	/* memory allocation */
-	http_client_send_queue = xQueueCreate( 4, sizeof(http_client_request_t) );  
+    UBaseType_t total = 0;
+    for (int lane = 0; lane < HC_LANE_COUNT; lane++) {
+        lanes[lane] = xQueueCreate( lane_len[lane], sizeof(http_client_request_t*) );
+        total += lane_len[lane];
+    }
+    lane_pending = xSemaphoreCreateCounting(total, 0);
+    lane_mutex = xSemaphoreCreateMutex();
     http_client_order_queue = xQueueCreate( 4, sizeof(uint32_t) );  
+    reconnect_timer = xTimerCreate("reconnect_timer", 1, pdFALSE, NULL, &http_client_reconnect_timer_cb);
+#ifdef CONFIG_HTTP_CLIENT_BATCH
+    batch_mutex = xSemaphoreCreateMutex();
+#endif
 
     /* subscribe to wifi manager events */
     wifi_manager_set_callback(WM_ORDER_HTTP_CLIENT_INIT, &cb_wifi_connect);
@@ -489,6 +1902,25 @@ void http_client_initialize() {
     /* create http client order task */
     xTaskCreate(&http_client_order_task, "http_client_order_task", DEFAULT_CACHE_SIZE, NULL, WIFI_MANAGER_TASK_PRIORITY+1, &task_http_client_order);
 
-    /* create http client send task */
-    xTaskCreate(&http_client_send_task, "http_client_send_task", DEFAULT_CACHE_SIZE, NULL, WIFI_MANAGER_TASK_PRIORITY+2, &task_http_client_send);
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX
+    /* requests stored while offline are replayed by a task of their own */
+    outbox_init();
+    if (outbox_replayed == NULL) {
+        outbox_replayed = xSemaphoreCreateBinary();
+    }
+    xTaskCreate(&http_client_outbox_task, "http_client_outbox_task", DEFAULT_CACHE_SIZE, NULL, WIFI_MANAGER_TASK_PRIORITY, &task_http_client_outbox);
+#endif
+
+#ifdef CONFIG_HTTP_CLIENT_LONG_POLL
+    poll_conn.push = true;
+    xTaskCreate(&http_client_poll_task, "http_client_poll_task", DEFAULT_CACHE_SIZE, NULL, WIFI_MANAGER_TASK_PRIORITY, &task_http_client_poll);
+#endif
+
+    /* create http client send workers, one per pool connection */
+    for (int i = 0; i < HTTP_CLIENT_POOL_SIZE; i++) {
+        if (pool[i].lock == NULL) {
+            pool[i].lock = xSemaphoreCreateMutex();
+        }
+        xTaskCreate(&http_client_send_task, "http_client_send_task", DEFAULT_CACHE_SIZE, &pool[i], WIFI_MANAGER_TASK_PRIORITY+2, &pool[i].task);
+    }
 }
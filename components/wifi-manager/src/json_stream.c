@@ -0,0 +1,406 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#include <sys/param.h>
+#include <string.h>
+
+#include "json_stream.h"
+
+/**
+ * @brief Tokenizer states, the expected input.
+ */
+typedef enum json_stream_state_t {
+	JS_VALUE = 0,			/* any value */
+	JS_VALUE_OR_END = 1,	/* first array element or ']' */
+	JS_KEY = 2,				/* member name after ',' */
+	JS_KEY_OR_END = 3,		/* first member name or '}' */
+	JS_COLON = 4,
+	JS_AFTER_VALUE = 5,		/* ',' or the end of the container */
+	JS_STRING = 6,
+	JS_NUMBER = 7,
+	JS_LITERAL = 8,
+	JS_DONE = 9,
+	JS_ERROR = 10
+}json_stream_state_t;
+
+static const char* literals[] = {"true", "false", "null"};
+
+static bool json_stream_in_object(const json_stream_t* js) {
+	return js->depth > 0 && (js->objects & (1UL << (js->depth - 1)));
+}
+
+static void json_stream_emit(json_stream_t* js, json_stream_event_t type, bool scalar) {
+	json_stream_token_t token = {
+		.type = type,
+		.key = (js->has_key && json_stream_in_object(js)) ? js->key : NULL,
+		.value = NULL,
+		.len = 0,
+		.depth = js->depth,
+		.truncated = js->truncated,
+	};
+	if (type == JSON_STREAM_STRING || type == JSON_STREAM_NUMBER) {
+		js->value[js->len] = '\0';
+		token.value = js->value;
+		token.len = js->len;
+	}
+
+	if (js->cb) {
+		js->cb(&token, js->arg);
+	}
+
+	for (int i = 0; i < JSON_STREAM_MAX_HANDLERS; i++) {
+		json_stream_handler_t* handler = &js->handlers[i];
+		if (handler->cb == NULL) {
+			continue;
+		}
+		if (handler->active) {
+			/* inside the container value of the key */
+			handler->cb(&token, handler->arg);
+			if ((type == JSON_STREAM_OBJECT_END || type == JSON_STREAM_ARRAY_END) && js->depth + 1 == handler->active) {
+				handler->active = 0;
+			}
+		}else if (token.key && strcmp(token.key, handler->key) == 0) {
+			handler->cb(&token, handler->arg);
+			if (!scalar) {
+				handler->active = js->depth + 1;
+			}
+		}
+	}
+	js->truncated = false;
+}
+
+static void json_stream_after_value(json_stream_t* js) {
+	js->has_key = false;
+	js->state = (js->depth == 0) ? JS_DONE : JS_AFTER_VALUE;
+}
+
+static void json_stream_append(json_stream_t* js, char c) {
+	if (js->len < JSON_STREAM_MAX_VALUE - 1) {
+		js->value[js->len++] = c;
+	}else {
+		js->truncated = true;
+	}
+}
+
+/* @brief appends a code point as UTF-8 */
+static void json_stream_append_utf8(json_stream_t* js, uint32_t code) {
+	if (code < 0x80) {
+		json_stream_append(js, (char)code);
+	}else if (code < 0x800) {
+		json_stream_append(js, (char)(0xC0 | (code >> 6)));
+		json_stream_append(js, (char)(0x80 | (code & 0x3F)));
+	}else if (code < 0x10000) {
+		json_stream_append(js, (char)(0xE0 | (code >> 12)));
+		json_stream_append(js, (char)(0x80 | ((code >> 6) & 0x3F)));
+		json_stream_append(js, (char)(0x80 | (code & 0x3F)));
+	}else {
+		json_stream_append(js, (char)(0xF0 | (code >> 18)));
+		json_stream_append(js, (char)(0x80 | ((code >> 12) & 0x3F)));
+		json_stream_append(js, (char)(0x80 | ((code >> 6) & 0x3F)));
+		json_stream_append(js, (char)(0x80 | (code & 0x3F)));
+	}
+}
+
+/* @brief a high surrogate not followed by a low one is replaced by U+FFFD */
+static void json_stream_flush_surrogate(json_stream_t* js) {
+	if (js->surrogate) {
+		js->surrogate = 0;
+		json_stream_append_utf8(js, 0xFFFD);
+	}
+}
+
+/* @brief appends a \uXXXX escape, the two halves of a surrogate pair make one code point */
+static void json_stream_append_unicode(json_stream_t* js, uint16_t code) {
+	if (code >= 0xDC00 && code <= 0xDFFF) {
+		if (js->surrogate) {
+			uint32_t pair = 0x10000 + (((uint32_t)js->surrogate - 0xD800) << 10) + (code - 0xDC00);
+			js->surrogate = 0;
+			json_stream_append_utf8(js, pair);
+		}else {
+			json_stream_append_utf8(js, 0xFFFD);
+		}
+		return;
+	}
+	json_stream_flush_surrogate(js);
+	if (code >= 0xD800 && code <= 0xDBFF) {
+		js->surrogate = code;
+	}else {
+		json_stream_append_utf8(js, code);
+	}
+}
+
+static bool json_stream_open(json_stream_t* js, bool object) {
+	if (js->depth >= JSON_STREAM_MAX_DEPTH) {
+		return false;
+	}
+	json_stream_emit(js, object ? JSON_STREAM_OBJECT_START : JSON_STREAM_ARRAY_START, false);
+	if (object) {
+		js->objects |= (1UL << js->depth);
+	}else {
+		js->objects &= ~(1UL << js->depth);
+	}
+	js->depth++;
+	js->has_key = false;
+	js->state = object ? JS_KEY_OR_END : JS_VALUE_OR_END;
+	return true;
+}
+
+static bool json_stream_close(json_stream_t* js, bool object) {
+	if (js->depth == 0 || json_stream_in_object(js) != object) {
+		return false;
+	}
+	js->depth--;
+	js->has_key = false;
+	json_stream_emit(js, object ? JSON_STREAM_OBJECT_END : JSON_STREAM_ARRAY_END, false);
+	json_stream_after_value(js);
+	return true;
+}
+
+static bool json_stream_is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int json_stream_hex(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static bool json_stream_value(json_stream_t* js, char c) {
+	js->len = 0;
+	js->truncated = false;
+	switch (c) {
+	case '{':
+		return json_stream_open(js, true);
+	case '[':
+		return json_stream_open(js, false);
+	case '"':
+		js->is_key = false;
+		js->escape = 0;
+		js->state = JS_STRING;
+		return true;
+	case 't':
+	case 'f':
+	case 'n':
+		js->value[0] = c;
+		js->literal = 1;
+		js->state = JS_LITERAL;
+		return true;
+	default:
+		if (c == '-' || (c >= '0' && c <= '9')) {
+			json_stream_append(js, c);
+			js->state = JS_NUMBER;
+			return true;
+		}
+		return false;
+	}
+}
+
+static bool json_stream_string(json_stream_t* js, char c) {
+	if (js->surrogate && ((js->escape == 0 && c != '\\') || (js->escape == 1 && c != 'u'))) {
+		json_stream_flush_surrogate(js);
+	}
+	if (js->escape == 1) {
+		js->escape = 0;
+		switch (c) {
+		case 'b': json_stream_append(js, '\b'); break;
+		case 'f': json_stream_append(js, '\f'); break;
+		case 'n': json_stream_append(js, '\n'); break;
+		case 'r': json_stream_append(js, '\r'); break;
+		case 't': json_stream_append(js, '\t'); break;
+		case 'u':
+			js->escape = 2;
+			js->unicode = 0;
+			break;
+		case '"':
+		case '\\':
+		case '/':
+			json_stream_append(js, c);
+			break;
+		default:
+			return false;
+		}
+		return true;
+	}
+	if (js->escape >= 2) {
+		int digit = json_stream_hex(c);
+		if (digit < 0) {
+			return false;
+		}
+		js->unicode = (js->unicode << 4) | digit;
+		if (++js->escape == 6) {
+			js->escape = 0;
+			json_stream_append_unicode(js, js->unicode);
+		}
+		return true;
+	}
+	if (c == '\\') {
+		js->escape = 1;
+		return true;
+	}
+	if (c != '"') {
+		json_stream_append(js, c);
+		return true;
+	}
+
+	/* end of the string */
+	if (js->is_key) {
+		memcpy(js->key, js->value, MIN(js->len, JSON_STREAM_MAX_KEY - 1));
+		js->key[MIN(js->len, JSON_STREAM_MAX_KEY - 1)] = '\0';
+		js->has_key = true;
+		js->state = JS_COLON;
+	}else {
+		json_stream_emit(js, JSON_STREAM_STRING, true);
+		json_stream_after_value(js);
+	}
+	return true;
+}
+
+/**
+ * @brief processes one character.
+ * @return false on a syntax error
+ */
+static bool json_stream_char(json_stream_t* js, char c) {
+	switch (js->state) {
+	case JS_STRING:
+		return json_stream_string(js, c);
+	case JS_NUMBER:
+		if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+			json_stream_append(js, c);
+			return true;
+		}
+		/* the number ends with the next character, which is processed as usual */
+		json_stream_emit(js, JSON_STREAM_NUMBER, true);
+		json_stream_after_value(js);
+		return json_stream_char(js, c);
+	case JS_LITERAL: {
+		int index = (js->value[0] == 't') ? 0 : (js->value[0] == 'f') ? 1 : 2;
+		const char* literal = literals[index];
+		if (c != literal[js->literal]) {
+			return false;
+		}
+		if (literal[++js->literal] == '\0') {
+			json_stream_emit(js, JSON_STREAM_TRUE + index, true);
+			json_stream_after_value(js);
+		}
+		return true;
+	}
+	default:
+		break;
+	}
+
+	if (json_stream_is_space(c)) {
+		return true;
+	}
+
+	switch (js->state) {
+	case JS_VALUE_OR_END:
+		if (c == ']') {
+			return json_stream_close(js, false);
+		}
+		/* fall through */
+	case JS_VALUE:
+		return json_stream_value(js, c);
+	case JS_KEY_OR_END:
+		if (c == '}') {
+			return json_stream_close(js, true);
+		}
+		/* fall through */
+	case JS_KEY:
+		if (c != '"') {
+			return false;
+		}
+		js->len = 0;
+		js->truncated = false;
+		js->is_key = true;
+		js->escape = 0;
+		js->state = JS_STRING;
+		return true;
+	case JS_COLON:
+		if (c != ':') {
+			return false;
+		}
+		js->state = JS_VALUE;
+		return true;
+	case JS_AFTER_VALUE:
+		if (c == ',') {
+			js->state = json_stream_in_object(js) ? JS_KEY : JS_VALUE;
+			return true;
+		}
+		if (c == '}' || c == ']') {
+			return json_stream_close(js, c == '}');
+		}
+		return false;
+	default:
+		/* JS_DONE accepts only trailing white space */
+		return false;
+	}
+}
+
+void json_stream_init(json_stream_t* js, json_stream_cb_t cb, void* arg) {
+	json_stream_handler_t handlers[JSON_STREAM_MAX_HANDLERS];
+
+	memcpy(handlers, js->handlers, sizeof(handlers));
+	memset(js, 0x00, sizeof(json_stream_t));
+	memcpy(js->handlers, handlers, sizeof(handlers));
+	for (int i = 0; i < JSON_STREAM_MAX_HANDLERS; i++) {
+		js->handlers[i].active = 0;
+	}
+	js->state = JS_VALUE;
+	js->cb = cb;
+	js->arg = arg;
+}
+
+esp_err_t json_stream_on_key(json_stream_t* js, const char* key, json_stream_cb_t cb, void* arg) {
+	for (int i = 0; i < JSON_STREAM_MAX_HANDLERS; i++) {
+		if (js->handlers[i].cb == NULL) {
+			js->handlers[i].key = key;
+			js->handlers[i].cb = cb;
+			js->handlers[i].arg = arg;
+			js->handlers[i].active = 0;
+			return ESP_OK;
+		}
+	}
+	return ESP_ERR_NO_MEM;
+}
+
+void json_stream_clear_handlers(json_stream_t* js) {
+	memset(js->handlers, 0x00, sizeof(js->handlers));
+}
+
+esp_err_t json_stream_feed(json_stream_t* js, const char* data, size_t len) {
+	for (size_t i = 0; i < len && js->state != JS_ERROR; i++) {
+		if (!json_stream_char(js, data[i])) {
+			js->state = JS_ERROR;
+		}
+	}
+	return (js->state == JS_ERROR) ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t json_stream_finish(json_stream_t* js) {
+	if (js->state == JS_NUMBER && js->depth == 0) {
+		json_stream_emit(js, JSON_STREAM_NUMBER, true);
+		json_stream_after_value(js);
+	}
+	return (js->state == JS_DONE) ? ESP_OK : ESP_FAIL;
+}
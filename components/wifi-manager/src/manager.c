@@ -732,8 +732,10 @@ void wifi_manager( void * pvParameters ){
 	// ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
 	// ESP_ERROR_CHECK(esp_wifi_start());
 
-	/* start http server */
-	http_app_start(false);
+	/* start http server, it stays up for the whole life of the manager: mode changes only switch routes.
+	 * LRU purge keeps the few sockets available to the provisioning browser in AP mode */
+	http_app_start(true);
+	http_app_set_routes(HTTP_APP_ROUTES_ALL);
 	
 	/* wifi scanner config */
 	wifi_scan_config_t scan_config = {
@@ -969,9 +971,8 @@ void wifi_manager( void * pvParameters ){
 			case WM_ORDER_START_AP:
 				ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
 
-				/* restart HTTP daemon */
-				http_app_stop();
-				http_app_start(true);
+				/* serve the captive portal */
+				http_app_set_routes(HTTP_APP_ROUTES_ALL);
 
 				/* start DNS */
 				start_dns_server();
@@ -1000,9 +1001,8 @@ void wifi_manager( void * pvParameters ){
 					/* stop DNS */
 					stop_dns_server();
 
-					/* restart HTTP daemon */
-					http_app_stop();
-					http_app_start(false);
+					/* the portal stays reachable through the STA IP */
+					http_app_set_routes(HTTP_APP_ROUTES_ALL);
 
 					/* callback */
 					if(cb_ptr_arr[msg.code]) (*cb_ptr_arr[msg.code])(NULL);
@@ -1049,9 +1049,13 @@ void wifi_manager( void * pvParameters ){
 			case WM_ORDER_HTTP_CLIENT_INIT:
 				ESP_LOGI(TAG, "WM_ORDER_HTTP_CLIENT_INIT");
 
-				/* bring down HTPP & DNS hijack */
+				/* bring down DNS hijack and the portal, the server is kept for the next mode change */
 				stop_dns_server();
-				http_app_stop();
+#ifdef CONFIG_HTTP_APP_STA_DIAGNOSTICS
+				http_app_set_routes(HTTP_APP_ROUTES_STATUS);
+#else
+				http_app_set_routes(HTTP_APP_ROUTES_NONE);
+#endif
 
 				/* SNTP initialize */
 				if(strlen(wifi_manager_get_ntp_server_address())) {
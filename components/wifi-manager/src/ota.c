@@ -21,58 +21,288 @@
 @see https://github.com/vivask/esp8266-wifi-manager
 */
 
+#include <sys/param.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/timers.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_system.h>
 #include <esp_ota_ops.h>
 #include <esp_http_client.h>
-#include <esp_https_ota.h>
 #include <cJSON.h>
+#ifdef CONFIG_OTA_SIGNATURE
+#include <mbedtls/ecdsa.h>
+#endif
 
 #include "manager.h"
 #include "flash.h"
 #include "ota.h"
+#include "ota_writer.h"
+#include "ota_delta.h"
+#ifdef CONFIG_OTA_COMPRESSED
+#include "gzip.h"
+#endif
 
 #define DEFAULT_CACHE_SIZE      CONFIG_OTA_TASK_CACHE_SIZE
 #define OTA_RECV_TIMEOUT_MS     5000
-#define HASH_LEN                32
 #define OTA_RESTART_TIMER_MS    2000
+#define OTA_BUFFER_SIZE         CONFIG_OTA_BUFFER_SIZE
+#define OTA_VALIDATOR_LEN       48
+#define OTA_RETRY_DELAY_MS      2000
+#define OTA_SHA256_KEY_SUFFIX   "_sha256"
+#define OTA_SIGNATURE_SUFFIX    "_sig"
+#define OTA_SIGNATURE_MAX_LEN   72
+
+#if defined(CONFIG_OTA_SIGNATURE) && CONFIG_JSON_STREAM_MAX_VALUE <= OTA_SIGNATURE_MAX_LEN * 2
+#error "CONFIG_JSON_STREAM_MAX_VALUE is too small for the hex signatures of the orders"
+#endif
+#define OTA_SIGNATURE_KEY_LEN   65
+#define OTA_PROGRESS_LOG_SIZE   (64 * 1024)
+
+#ifdef CONFIG_OTA_PIPELINE
+#define OTA_PIPE_BUFFER_SIZE    CONFIG_OTA_PIPELINE_BUFFER_SIZE
+#define OTA_PIPE_BUFFERS        2
+#define OTA_PIPE_STACK_SIZE     3072
+#endif
+
+#ifdef CONFIG_OTA_RESUME
+#define STORE_BASE_PATH         "/"CONFIG_STORE_MOUNT_POINT
+#define OTA_RESUME_FILE         STORE_BASE_PATH "/ota.bin"
+#define OTA_RESUME_MAGIC        0x4f544131U
+#define OTA_RESUME_URL_LEN      128
+#define OTA_RESUME_RETRIES      CONFIG_OTA_RESUME_RETRIES
+#else
+#define OTA_RESUME_RETRIES      0
+#endif
 
 static const char *TAG = "OTA";
 
 /* @brief firmware file name */
 static char* file = NULL;
 
+#ifdef CONFIG_OTA_DELTA
+/* @brief patch file name, used once */
+static char* delta_file = NULL;
+#endif
+
+/* @brief expected SHA-256 of the image, from the orders, used once */
+static uint8_t image_sha256[OTA_SHA256_LEN];
+static bool image_sha256_set = false;
+
+#ifdef CONFIG_OTA_SIGNATURE
+/* @brief DER ECDSA signature of the image SHA-256, from the orders, used once */
+static uint8_t signature[OTA_SIGNATURE_MAX_LEN];
+static size_t signature_len = 0;
+#endif
+
 /* @brief callback ota finish function pointer */
 void (*cb_finish_ptr)(bool) = NULL;
 
-bool ota(const char* data, int size) {
-    bool ret = false;
-    cJSON *root = cJSON_Parse(data);
+/* @brief callback ota progress function pointer */
+static ota_progress_cb_t cb_progress_ptr = NULL;
+static void* cb_progress_arg = NULL;
+
+/* @brief sink of the downloaded data */
+typedef esp_err_t (*ota_sink_t)(void* arg, const uint8_t* data, size_t len);
+
+/**
+ * @brief One download, from offset to the end of the file.
+ */
+typedef struct _ota_download_t {
+    const char*     url;
+    size_t          offset;                         /* first byte requested */
+    size_t          total;                          /* size of the whole file, 0 if unknown */
+    char            validator[OTA_VALIDATOR_LEN];   /* ETag, or Last-Modified, of the file */
+    size_t          received;                       /* by all attempts */
+    ota_sink_t      sink;
+    void*           arg;
+    ota_writer_t*   writer;                         /* fed by the sink, erased ahead by the pipeline */
+}ota_download_t;
+
+#ifdef CONFIG_OTA_PIPELINE
+/**
+ * @brief A filled buffer for the writer task, a zero len ends the download.
+ */
+typedef struct _ota_pipe_block_t {
+    uint8_t*        data;
+    size_t          len;
+}ota_pipe_block_t;
+
+/**
+ * @brief Double buffer between the download and the writer task: one buffer is filled
+ * from the network while the other is written to flash.
+ */
+typedef struct _ota_pipe_t {
+    ota_download_t*     download;
+    QueueHandle_t       full;
+    QueueHandle_t       free;
+    SemaphoreHandle_t   done;
+    uint8_t*            fill;                       /* buffer being filled by the download */
+    size_t              fill_len;
+    volatile esp_err_t  err;                        /* first error of the sink, set by the writer task */
+    uint8_t*            buffers[OTA_PIPE_BUFFERS];
+}ota_pipe_t;
+#endif
+
+/**
+ * @brief Image or patch download, kept across attempts.
+ */
+typedef struct _ota_image_t {
+    ota_download_t  download;
+    ota_writer_t    writer;
+    bool            started;                        /* the writer was begun */
+    bool            resumable;                      /* the progress is saved at checkpoints */
+    TickType_t      start;
+    size_t          fed;                            /* bytes of the file taken by the sink */
+    size_t          file_size;                      /* when the writer was begun, 0 if unknown */
+    uint32_t        heap_start;                     /* free heap when the upgrade began */
+    uint32_t        heap_min;                       /* lowest free heap seen at the checkpoints */
+#ifdef CONFIG_OTA_COMPRESSED
+    gzip_inflate_t* inflate;                        /* the file is a compressed image */
+#endif
+}ota_image_t;
+
+#ifdef CONFIG_OTA_RESUME
+/**
+ * @brief Resume state, saved in the storage partition at checkpoints of the writer.
+ */
+typedef struct _ota_resume_t {
+    uint32_t                magic;
+    uint32_t                address;                /* of the partition written */
+    uint32_t                size;
+    uint32_t                written;
+    char                    url[OTA_RESUME_URL_LEN];
+    char                    validator[OTA_VALIDATOR_LEN];
+    mbedtls_sha256_context  sha;
+}ota_resume_t;
+#endif
+
+static bool ota_copy_name(char** dst, const char* name) {
+    size_t len = strlen(name);
+    if (len == 0) {
+        return false;
+    }
+    if (*dst) {
+        free(*dst);
+    }
+    *dst = (char*)malloc(len+1);
+    if (*dst == NULL) {
+        return false;
+    }
+    memcpy((void*)*dst, (void*)name, len);
+    (*dst)[len] = '\0';
+    return true;
+}
+
+bool ota_set_file(const char* name) {
+    if (!ota_copy_name(&file, name)) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Firmware file: %s", file);
+    return true;
+}
+
+bool ota_set_delta_file(const char* name) {
+#ifdef CONFIG_OTA_DELTA
+    if (!ota_copy_name(&delta_file, name)) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Firmware patch: %s", delta_file);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* @brief decodes hex text into at most size bytes, -1 if it is not hex or too long */
+static int ota_hex_decode(const char* hex, uint8_t* out, size_t size) {
+    size_t len = strlen(hex);
+    if (len % 2 || len / 2 > size) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i += 2) {
+        char byte[3] = {hex[i], hex[i + 1], '\0'};
+        char* end;
+        out[i / 2] = (uint8_t)strtoul(byte, &end, 16);
+        if (*end != '\0') {
+            return -1;
+        }
+    }
+    return len / 2;
+}
+
+bool ota_set_attribute(const char* suffix, const char* value) {
+#ifdef CONFIG_OTA_DELTA
+    if (strcmp(suffix, CONFIG_OTA_DELTA_KEY_SUFFIX) == 0) {
+        return ota_set_delta_file(value);
+    }
+#endif
+    if (strcmp(suffix, OTA_SHA256_KEY_SUFFIX) == 0) {
+        image_sha256_set = ota_hex_decode(value, image_sha256, OTA_SHA256_LEN) == OTA_SHA256_LEN;
+        return image_sha256_set;
+    }
+#ifdef CONFIG_OTA_SIGNATURE
+    if (strcmp(suffix, OTA_SIGNATURE_SUFFIX) == 0) {
+        int len = ota_hex_decode(value, signature, OTA_SIGNATURE_MAX_LEN);
+        signature_len = (len > 0) ? len : 0;
+        return signature_len > 0;
+    }
+#endif
+    return false;
+}
+
+/* @brief forgets what the orders told about the last firmware */
+static void ota_clear_attributes() {
+#ifdef CONFIG_OTA_DELTA
+    free(delta_file);
+    delta_file = NULL;
+#endif
+    image_sha256_set = false;
+#ifdef CONFIG_OTA_SIGNATURE
+    signature_len = 0;
+#endif
+}
+
+bool ota_set_orders(const cJSON* root) {
     esp8266_config_t* wifi_config = wifi_manager_get_config();
     cJSON* item = cJSON_GetObjectItem(root, wifi_config->esp_json_key);
-    if (item && item->valuestring) {
-        size_t len = strlen(item->valuestring);
-        if (len) {
-            if (file) {
-                free(file);
-            }else {
-                file = (char*)malloc(len+1);
-                memcpy((void*)file, (void*)item->valuestring, len);
-                file[len] = '\0';
-                ESP_LOGI(TAG, "Firmware file: %s", file);
-            }
-            ret = true;
+    if (item == NULL || item->valuestring == NULL) {
+        return false;
+    }
+    /* what earlier orders told about another firmware does not apply to this one */
+    ota_clear_attributes();
+    if (!ota_set_file(item->valuestring)) {
+        return false;
+    }
+    /* <esp_json_key><suffix> members describe the same firmware */
+    size_t key_len = strlen(wifi_config->esp_json_key);
+    cJSON_ArrayForEach(item, root) {
+        if (item->string && item->valuestring && strncmp(item->string, wifi_config->esp_json_key, key_len) == 0 &&
+                item->string[key_len] != '\0') {
+            ota_set_attribute(item->string + key_len, item->valuestring);
         }
     }
+    return true;
+}
+
+bool ota(const char* data, int size) {
+    cJSON *root = cJSON_Parse(data);
+    bool ret = ota_set_orders(root);
     cJSON_Delete(root);
     return ret;
 }
 
+void ota_set_progress_callback(ota_progress_cb_t func_ptr, void* arg) {
+    cb_progress_ptr = func_ptr;
+    cb_progress_arg = arg;
+}
+
 static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 {
     switch (evt->event_id) {
@@ -85,9 +315,26 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     case HTTP_EVENT_HEADER_SENT:
         ESP_LOGD(TAG, "HTTP_EVENT_HEADER_SENT");
         break;
-    case HTTP_EVENT_ON_HEADER:
+    case HTTP_EVENT_ON_HEADER: {
         ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
+        ota_download_t* download = (ota_download_t*)evt->user_data;
+        if (download == NULL) {
+            break;
+        }
+        if (strcasecmp(evt->header_key, "ETag") == 0 ||
+                (strcasecmp(evt->header_key, "Last-Modified") == 0 && download->validator[0] == '\0')) {
+            snprintf(download->validator, OTA_VALIDATOR_LEN, "%s", evt->header_value);
+        }else if (strcasecmp(evt->header_key, "Content-Range") == 0) {
+            /* bytes <first>-<last>/<total> */
+            const char* total = strchr(evt->header_value, '/');
+            if (total && strtoul(evt->header_value + 6, NULL, 10) == download->offset) {
+                download->total = strtoul(total + 1, NULL, 10);
+            }else {
+                download->total = 0;
+            }
+        }
         break;
+    }
     case HTTP_EVENT_ON_DATA:
         ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
         break;
@@ -101,34 +348,608 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
+static void ota_get_config(esp_http_client_config_t* config, const char* url) {
+    esp8266_config_t* wifi_config = wifi_manager_get_config();
+
+    memset(config, 0x00, sizeof(esp_http_client_config_t));
+    config->event_handler = _http_event_handler;
+    config->transport_type = HTTP_TRANSPORT_OVER_SSL;
+    config->host = wifi_config->server_address;
+    config->port = wifi_config->server_port;
+    config->timeout_ms = OTA_RECV_TIMEOUT_MS;
+    config->url = url;
+    // config->keep_alive_enable = true;
+
+    if (strcmp(wifi_config->server_auth, "ssl") == 0) {
+        config->cert_pem = wifi_config->client_ca;
+        config->client_cert_pem = wifi_config->client_crt;
+        config->client_key_pem = wifi_config->client_key;
+#ifdef CONFIG_SKIP_COMMON_NAME_CHECK
+        config->skip_cert_common_name_check = true;
+#endif
+    }
+}
+
+#ifdef CONFIG_OTA_PIPELINE
+static void ota_pipe_task(void* pvParameter) {
+    ota_pipe_t* pipe = (ota_pipe_t*)pvParameter;
+    ota_download_t* download = pipe->download;
+    ota_pipe_block_t block;
+
+    for (;;) {
+        if (xQueueReceive(pipe->full, &block, 0) != pdTRUE) {
+            /* the flash is idle until the next buffer comes, erase the sectors it will need */
+            if (download->writer && ota_writer_erase_ahead(download->writer, CONFIG_OTA_PIPELINE_ERASE_AHEAD)) {
+                continue;
+            }
+            xQueueReceive(pipe->full, &block, portMAX_DELAY);
+        }
+        if (block.len == 0) {
+            break;
+        }
+        if (pipe->err == ESP_OK) {
+            pipe->err = download->sink(download->arg, block.data, block.len);
+        }
+        xQueueSend(pipe->free, &block.data, portMAX_DELAY);
+    }
+    xSemaphoreGive(pipe->done);
+    vTaskDelete(NULL);
+}
+
+/* @brief hands the filled buffer to the writer task and takes the free one */
+static void ota_pipe_flush(ota_pipe_t* pipe) {
+    ota_pipe_block_t block = {
+        .data = pipe->fill,
+        .len = pipe->fill_len,
+    };
+    if (block.len) {
+        xQueueSend(pipe->full, &block, portMAX_DELAY);
+        xQueueReceive(pipe->free, &pipe->fill, portMAX_DELAY);
+        pipe->fill_len = 0;
+    }
+}
+
+static esp_err_t ota_pipe_sink(void* arg, const uint8_t* data, size_t len) {
+    ota_pipe_t* pipe = (ota_pipe_t*)arg;
+
+    while (len && pipe->err == ESP_OK) {
+        size_t chunk = MIN(len, OTA_PIPE_BUFFER_SIZE - pipe->fill_len);
+        memcpy(pipe->fill + pipe->fill_len, data, chunk);
+        pipe->fill_len += chunk;
+        data += chunk;
+        len -= chunk;
+        if (pipe->fill_len == OTA_PIPE_BUFFER_SIZE) {
+            ota_pipe_flush(pipe);
+        }
+    }
+    return pipe->err;
+}
+
+static void ota_pipe_destroy(ota_pipe_t* pipe) {
+    if (pipe->full) vQueueDelete(pipe->full);
+    if (pipe->free) vQueueDelete(pipe->free);
+    if (pipe->done) vSemaphoreDelete(pipe->done);
+    for (int i = 0; i < OTA_PIPE_BUFFERS; i++) {
+        free(pipe->buffers[i]);
+    }
+    free(pipe);
+}
+
+/* @brief starts the writer task of a download */
+static ota_pipe_t* ota_pipe_create(ota_download_t* download) {
+    ota_pipe_t* pipe = (ota_pipe_t*)calloc(1, sizeof(ota_pipe_t));
+    if (pipe == NULL) {
+        return NULL;
+    }
+    pipe->download = download;
+    pipe->full = xQueueCreate(OTA_PIPE_BUFFERS, sizeof(ota_pipe_block_t));
+    pipe->free = xQueueCreate(OTA_PIPE_BUFFERS, sizeof(uint8_t*));
+    pipe->done = xSemaphoreCreateBinary();
+    bool ok = pipe->full && pipe->free && pipe->done;
+    for (int i = 0; i < OTA_PIPE_BUFFERS && ok; i++) {
+        pipe->buffers[i] = (uint8_t*)malloc(OTA_PIPE_BUFFER_SIZE);
+        ok = pipe->buffers[i] != NULL;
+    }
+    if (ok) {
+        pipe->fill = pipe->buffers[0];
+        for (int i = 1; i < OTA_PIPE_BUFFERS; i++) {
+            xQueueSend(pipe->free, &pipe->buffers[i], 0);
+        }
+        ok = xTaskCreate(&ota_pipe_task, "ota_writer_task", OTA_PIPE_STACK_SIZE, pipe,
+                WIFI_MANAGER_TASK_PRIORITY+1, NULL) == pdPASS;
+    }
+    if (!ok) {
+        ESP_LOGW(TAG, "No memory for the download pipeline");
+        ota_pipe_destroy(pipe);
+        return NULL;
+    }
+    return pipe;
+}
+
+/**
+ * @brief Writes the rest of the download and stops the writer task.
+ * @return the first error of the sink, ESP_OK if all was written.
+ */
+static esp_err_t ota_pipe_finish(ota_pipe_t* pipe) {
+    ota_pipe_block_t end = {
+        .data = NULL,
+        .len = 0,
+    };
+    if (pipe->err == ESP_OK) {
+        ota_pipe_flush(pipe);
+    }
+    xQueueSend(pipe->full, &end, portMAX_DELAY);
+    xSemaphoreTake(pipe->done, portMAX_DELAY);
+    esp_err_t err = pipe->err;
+    ota_pipe_destroy(pipe);
+    return err;
+}
+#endif
+
+/**
+ * @brief Downloads the file piece by piece into the sink, nothing of it is kept in RAM.
+ * A download with an offset continues the file with a Range request, If-Range guards the validator.
+ * @return ESP_OK, ESP_FAIL on a network or server error, ESP_ERR_INVALID_STATE if the file
+ * changed and has to be downloaded from the start, or the error of the sink.
+ */
+static esp_err_t ota_download(ota_download_t* download) {
+    esp_http_client_config_t config;
+    esp_err_t err;
+    char range[24];
+    ota_sink_t sink = download->sink;
+    void* sink_arg = download->arg;
+
+    ota_get_config(&config, download->url);
+    config.user_data = download;
+    char* buffer = (char*)malloc(OTA_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        free(buffer);
+        return ESP_FAIL;
+    }
+    if (download->offset) {
+        snprintf(range, sizeof(range), "bytes=%u-", download->offset);
+        esp_http_client_set_header(client, "Range", range);
+        if (download->validator[0]) {
+            esp_http_client_set_header(client, "If-Range", download->validator);
+        }
+    }
+
+    err = esp_http_client_open(client, 0);
+    if (err == ESP_OK) {
+        int length = esp_http_client_fetch_headers(client);
+        int status = esp_http_client_get_status_code(client);
+        if (status == 200 && download->offset == 0) {
+            download->total = (length > 0) ? length : 0;
+        }else if (status == 206 && download->offset) {
+            if (download->total == 0) {
+                ESP_LOGW(TAG, "Unexpected range of %s", download->url);
+                err = ESP_ERR_INVALID_STATE;
+            }
+        }else if (status == 200 || status == 416) {
+            /* the range was ignored or no longer exists */
+            ESP_LOGW(TAG, "File %s changed, starting over", download->url);
+            err = ESP_ERR_INVALID_STATE;
+        }else {
+            ESP_LOGE(TAG, "Download of %s failed, status %d", download->url, status);
+            err = ESP_FAIL;
+        }
+    }else {
+        err = ESP_FAIL;
+    }
+#ifdef CONFIG_OTA_PIPELINE
+    /* the writer task takes the sink, the data is read while the previous buffer is written */
+    ota_pipe_t* pipe = (err == ESP_OK) ? ota_pipe_create(download) : NULL;
+    if (pipe) {
+        sink = ota_pipe_sink;
+        sink_arg = pipe;
+    }
+#endif
+    while (err == ESP_OK) {
+        int len = esp_http_client_read(client, buffer, OTA_BUFFER_SIZE);
+        if (len < 0) {
+            ESP_LOGE(TAG, "Download of %s interrupted", download->url);
+            err = ESP_FAIL;
+        }else if (len == 0) {
+            if (!esp_http_client_is_complete_data_received(client)) {
+                ESP_LOGE(TAG, "Download of %s incomplete", download->url);
+                err = ESP_FAIL;
+            }
+            break;
+        }else {
+            download->received += len;
+            err = sink(sink_arg, (const uint8_t*)buffer, len);
+        }
+    }
+#ifdef CONFIG_OTA_PIPELINE
+    if (pipe) {
+        esp_err_t sink_err = ota_pipe_finish(pipe);
+        if (sink_err != ESP_OK) {
+            err = sink_err;
+        }
+    }
+#endif
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    free(buffer);
+    return err;
+}
+
+#ifdef CONFIG_OTA_RESUME
+/* @brief the saved state of an unfinished download of url */
+static bool ota_resume_load(ota_resume_t* state, const char* url) {
+    bool ret = false;
+    FILE* f = fopen(OTA_RESUME_FILE, "rb");
+    if (f) {
+        ret = fread(state, sizeof(ota_resume_t), 1, f) == 1 && state->magic == OTA_RESUME_MAGIC &&
+                strncmp(state->url, url, OTA_RESUME_URL_LEN) == 0;
+        fclose(f);
+    }
+    return ret;
+}
+
+static void ota_resume_clear() {
+    remove(OTA_RESUME_FILE);
+}
+
+/* @brief saves the state every CONFIG_OTA_RESUME_SAVE_SECTORS sectors */
+static void ota_resume_save(ota_image_t* image) {
+    ota_writer_t* writer = &image->writer;
+
+    if ((writer->written / SPI_FLASH_SEC_SIZE) % CONFIG_OTA_RESUME_SAVE_SECTORS ||
+            strlen(image->download.url) >= OTA_RESUME_URL_LEN) {
+        return;
+    }
+    ota_resume_t* state = (ota_resume_t*)calloc(1, sizeof(ota_resume_t));
+    if (state == NULL) {
+        return;
+    }
+    state->magic = OTA_RESUME_MAGIC;
+    state->address = writer->partition->address;
+    state->size = writer->size;
+    state->written = writer->written;
+    snprintf(state->url, OTA_RESUME_URL_LEN, "%s", image->download.url);
+    snprintf(state->validator, OTA_VALIDATOR_LEN, "%s", image->download.validator);
+    mbedtls_sha256_clone(&state->sha, &writer->sha);
+    FILE* f = fopen(OTA_RESUME_FILE, "wb");
+    if (f == NULL || fwrite(state, sizeof(ota_resume_t), 1, f) != 1) {
+        ESP_LOGW(TAG, "Failed to save the download state");
+    }
+    if (f) {
+        fclose(f);
+    }
+    free(state);
+}
+
+/* @brief continues a download stopped by a reboot */
+static void ota_resume(ota_image_t* image) {
+    ota_resume_t* state = (ota_resume_t*)malloc(sizeof(ota_resume_t));
+    if (state == NULL) {
+        return;
+    }
+    if (ota_resume_load(state, image->download.url)) {
+        if (ota_writer_resume(&image->writer, state->address, state->size, state->written, &state->sha) == ESP_OK) {
+            image->started = true;
+            image->fed = state->written;
+            image->file_size = state->size;
+            image->download.total = state->size;
+            snprintf(image->download.validator, OTA_VALIDATOR_LEN, "%s", state->validator);
+            FLASH_LOGI("Firmware download resumed at %u of %u bytes", state->written, state->size);
+        }else {
+            ota_resume_clear();
+        }
+    }
+    free(state);
+}
+#endif
+
+static void ota_progress(ota_image_t* image, bool done) {
+    ota_progress_t progress = {
+        .written = image->writer.written,
+        .total = (image->writer.size != OTA_SIZE_UNKNOWN) ? image->writer.size : 0,
+        .received = image->download.received,
+        .elapsed_ms = (xTaskGetTickCount() - image->start) * portTICK_PERIOD_MS,
+        .done = done,
+    };
+    progress.rate = (progress.elapsed_ms) ? (uint64_t)progress.received * 1000 / progress.elapsed_ms : 0;
+
+    image->heap_min = MIN(image->heap_min, esp_get_free_heap_size());
+    if (cb_progress_ptr) {
+        cb_progress_ptr(&progress, cb_progress_arg);
+    }else if (!done && progress.written % OTA_PROGRESS_LOG_SIZE == 0) {
+        ESP_LOGI(TAG, "Written %u of %u bytes, %u B/s", progress.written, progress.total, progress.rate);
+    }
+    if (done) {
+#ifdef CONFIG_OTA_PIPELINE
+        const char* mode = "pipelined";
+#else
+        const char* mode = "serial";
+#endif
+        FLASH_LOGI("Firmware written: %u bytes from %u downloaded in %u ms, %u KB/s %s, peak heap %u bytes",
+                progress.written, progress.received, progress.elapsed_ms, progress.rate / 1024, mode,
+                image->heap_start - image->heap_min);
+    }
+}
+
+/* @brief writer hook at every sector */
+static void ota_checkpoint(ota_writer_t* writer, void* arg) {
+    ota_image_t* image = (ota_image_t*)arg;
+
+    ota_progress(image, false);
+#ifdef CONFIG_OTA_RESUME
+    if (image->resumable) {
+        ota_resume_save(image);
+    }
+#endif
+}
+
+#ifdef CONFIG_OTA_SIGNATURE
+static esp_err_t ota_verify_signature(const uint8_t* digest) {
+    uint8_t key[OTA_SIGNATURE_KEY_LEN];
+    mbedtls_ecdsa_context ecdsa;
+    esp_err_t err = ESP_ERR_INVALID_CRC;
+
+    if (signature_len == 0) {
+        ESP_LOGE(TAG, "Image is not signed");
+        return ESP_ERR_INVALID_CRC;
+    }
+    if (ota_hex_decode(CONFIG_OTA_SIGNATURE_KEY, key, sizeof(key)) != OTA_SIGNATURE_KEY_LEN) {
+        ESP_LOGE(TAG, "Invalid signature key");
+        return ESP_ERR_INVALID_ARG;
+    }
+    mbedtls_ecdsa_init(&ecdsa);
+    if (mbedtls_ecp_group_load(&ecdsa.grp, MBEDTLS_ECP_DP_SECP256R1) == 0 &&
+            mbedtls_ecp_point_read_binary(&ecdsa.grp, &ecdsa.Q, key, sizeof(key)) == 0 &&
+            mbedtls_ecdsa_read_signature(&ecdsa, digest, OTA_SHA256_LEN, signature, signature_len) == 0) {
+        err = ESP_OK;
+    }
+    mbedtls_ecdsa_free(&ecdsa);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image signature mismatch");
+    }
+    return err;
+}
+#endif
+
+/* @brief writer hook with the SHA-256 hashed while the image was written */
+static esp_err_t ota_verify(ota_writer_t* writer, const uint8_t* digest, void* arg) {
+    char hex[OTA_SHA256_LEN * 2 + 1];
+
+    for (int i = 0; i < OTA_SHA256_LEN; i++) {
+        sprintf(&hex[i * 2], "%02x", digest[i]);
+    }
+    ESP_LOGI(TAG, "Image SHA-256: %s", hex);
+    ota_progress((ota_image_t*)arg, true);
+
+    if (image_sha256_set && memcmp(digest, image_sha256, OTA_SHA256_LEN) != 0) {
+        ESP_LOGE(TAG, "Image SHA-256 does not match the orders");
+        return ESP_ERR_INVALID_CRC;
+    }
+#ifdef CONFIG_OTA_SIGNATURE
+    return ota_verify_signature(digest);
+#else
+    return ESP_OK;
+#endif
+}
+
+/* @brief a new image or patch download */
+static ota_image_t* ota_image_create(const char* url, ota_sink_t sink, void* arg) {
+    ota_image_t* image = (ota_image_t*)calloc(1, sizeof(ota_image_t));
+    if (image) {
+        image->download.url = url;
+        image->download.sink = sink;
+        image->download.arg = (arg) ? arg : image;
+        image->download.writer = &image->writer;
+        image->writer.checkpoint = ota_checkpoint;
+        image->writer.verify = ota_verify;
+        image->writer.arg = image;
+        image->start = xTaskGetTickCount();
+        image->heap_start = esp_get_free_heap_size();
+        image->heap_min = image->heap_start;
+    }
+    return image;
+}
+
+#ifdef CONFIG_OTA_COMPRESSED
+static esp_err_t ota_inflate_out(void* arg, const uint8_t* data, size_t len) {
+    return ota_writer_write(&((ota_image_t*)arg)->writer, data, len);
+}
+
+/* @brief the file is decompressed into the writer, a stream cannot be resumed after a reboot */
+static esp_err_t ota_inflate_begin(ota_image_t* image) {
+    image->inflate = (gzip_inflate_t*)malloc(sizeof(gzip_inflate_t));
+    if (image->inflate == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = gzip_inflate_init(image->inflate, CONFIG_OTA_COMPRESSED_WINDOW_BITS, ota_inflate_out, image);
+    if (err != ESP_OK) {
+        free(image->inflate);
+        image->inflate = NULL;
+        return err;
+    }
+    image->resumable = false;
+    ESP_LOGI(TAG, "Compressed image, %u bytes of RAM to decompress it",
+            sizeof(gzip_inflate_t) + (1U << CONFIG_OTA_COMPRESSED_WINDOW_BITS));
+    return ESP_OK;
+}
+#endif
+
+/* @brief drops what was written, the next download starts from the beginning of the file */
+static void ota_image_reset(ota_image_t* image) {
+    if (image->started) {
+        ota_writer_abort(&image->writer);
+        image->started = false;
+    }
+    image->fed = 0;
+#ifdef CONFIG_OTA_COMPRESSED
+    if (image->inflate) {
+        gzip_inflate_finish(image->inflate);
+        free(image->inflate);
+        image->inflate = NULL;
+    }
+#endif
+}
+
+static esp_err_t ota_image_sink(void* arg, const uint8_t* data, size_t len) {
+    ota_image_t* image = (ota_image_t*)arg;
+    esp_err_t err;
+
+    if (!image->started) {
+        size_t size = (image->download.total) ? image->download.total : OTA_SIZE_UNKNOWN;
+#ifdef CONFIG_OTA_COMPRESSED
+        if (data[0] != OTA_IMAGE_MAGIC && gzip_inflate_is_zlib(data, len)) {
+            err = ota_inflate_begin(image);
+            if (err != ESP_OK) {
+                return err;
+            }
+            size = OTA_SIZE_UNKNOWN;
+        }
+#endif
+        err = ota_writer_begin(&image->writer, size);
+        if (err != ESP_OK) {
+            return err;
+        }
+        image->started = true;
+        image->file_size = image->download.total;
+    }else if (image->fed == image->download.offset && image->file_size &&
+            image->download.total != image->file_size) {
+        /* the first data of a resumed download is for another file */
+        return ESP_ERR_INVALID_STATE;
+    }
+    image->fed += len;
+#ifdef CONFIG_OTA_COMPRESSED
+    if (image->inflate) {
+        return gzip_inflate_feed(image->inflate, data, len);
+    }
+#endif
+    return ota_writer_write(&image->writer, data, len);
+}
+
+/**
+ * @brief Downloads the image into the update partition. Interrupted downloads continue where they
+ * stopped, after a reconnect within CONFIG_OTA_RESUME_RETRIES attempts, or after a reboot.
+ */
+static esp_err_t ota_image_upgrade(const char* url) {
+    esp_err_t err = ESP_FAIL;
+    ota_image_t* image = ota_image_create(url, ota_image_sink, NULL);
+    if (image == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+#ifdef CONFIG_OTA_RESUME
+    image->resumable = true;
+    ota_resume(image);
+#endif
+
+    for (int attempt = 0; attempt <= OTA_RESUME_RETRIES; attempt++) {
+        if (attempt) {
+            vTaskDelay(pdMS_TO_TICKS(OTA_RETRY_DELAY_MS * attempt));
+        }
+        image->download.offset = (image->started) ? image->fed : 0;
+        err = ota_download(&image->download);
+        if (err == ESP_ERR_INVALID_STATE) {
+            /* another file under the same name */
+            ota_image_reset(image);
+            image->download.validator[0] = '\0';
+#ifdef CONFIG_OTA_RESUME
+            ota_resume_clear();
+#endif
+        }else if (err != ESP_FAIL) {
+            /* done, or an error of the image or the flash */
+            break;
+        }
+        if (image->started && attempt < OTA_RESUME_RETRIES) {
+            ESP_LOGW(TAG, "Download stopped at %u bytes, retrying", image->fed);
+        }
+    }
+
+#ifdef CONFIG_OTA_COMPRESSED
+    if (err == ESP_OK && image->inflate) {
+        /* the stream must be complete, its checksum is checked too */
+        err = gzip_inflate_finish(image->inflate);
+        free(image->inflate);
+        image->inflate = NULL;
+    }
+#endif
+    if (err == ESP_OK && image->started) {
+        err = ota_writer_finish(&image->writer, NULL);
+    }else {
+        ota_image_reset(image);
+        if (err == ESP_OK) {
+            /* an empty file */
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+#ifdef CONFIG_OTA_RESUME
+    if (err != ESP_FAIL) {
+        /* finished or not resumable, only network errors are */
+        ota_resume_clear();
+    }
+#endif
+    free(image);
+    return err;
+}
+
+#ifdef CONFIG_OTA_DELTA
+static esp_err_t ota_delta_sink(void* arg, const uint8_t* data, size_t len) {
+    return ota_delta_feed((ota_delta_t*)arg, data, len);
+}
+
+/**
+ * @brief Downloads the patch and applies it to the running firmware as it comes.
+ */
+static esp_err_t ota_delta_upgrade(const char* url) {
+    ota_delta_t* delta = (ota_delta_t*)malloc(sizeof(ota_delta_t));
+    ota_image_t* image = ota_image_create(url, ota_delta_sink, delta);
+    if (delta == NULL || image == NULL) {
+        free(delta);
+        free(image);
+        return ESP_ERR_NO_MEM;
+    }
+#ifdef CONFIG_OTA_RESUME
+    /* the patch is written over what a stopped full download left */
+    ota_resume_clear();
+#endif
+    ota_delta_begin(delta, &image->writer);
+    esp_err_t err = ota_download(&image->download);
+    if (err == ESP_OK) {
+        err = ota_delta_finish(delta);
+    }else if (delta->started) {
+        ota_writer_abort(&image->writer);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Patch applied, %u bytes written", image->writer.written);
+    }
+    free(delta);
+    free(image);
+    return err;
+}
+#endif
+
 static void firmware_upgrade_task(void  *pvParameter){
+    esp_err_t err = ESP_FAIL;
+
     if (!file) {
         ESP_LOGE(TAG, "Undefined firmware file");
         abort();
     }
 
-    esp8266_config_t* wifi_config = wifi_manager_get_config();
-    
-    esp_http_client_config_t config = {
-        .event_handler = _http_event_handler,
-        .transport_type = HTTP_TRANSPORT_OVER_SSL,
-        .host = wifi_config->server_address,
-        .port = wifi_config->server_port,
-        .timeout_ms = OTA_RECV_TIMEOUT_MS,
-        .url = file,
-        // .keep_alive_enable = true
-    };
-
-    if (strcmp(wifi_config->server_auth, "ssl") == 0) {
-        config.cert_pem = wifi_config->client_ca;
-        config.client_cert_pem = wifi_config->client_crt;
-        config.client_key_pem = wifi_config->client_key;
-#ifdef CONFIG_SKIP_COMMON_NAME_CHECK
-        config.skip_cert_common_name_check = true;
-#endif
+#ifdef CONFIG_OTA_DELTA
+    if (delta_file) {
+        err = ota_delta_upgrade(delta_file);
+        if (err != ESP_OK) {
+            FLASH_LOGW("Firmware patch failed, downloading the full image");
+        }
     }
+#endif
 
-    esp_err_t err = esp_https_ota(&config);
+    if (err != ESP_OK) {
+        err = ota_image_upgrade(file);
+    }
+    ota_clear_attributes();
 
     if (err == ESP_OK) {
         FLASH_LOGI("Firmware upgrade success");
@@ -143,33 +964,6 @@ static void firmware_upgrade_task(void  *pvParameter){
     vTaskDelete( NULL );
 }
 
-// static void print_sha256(const uint8_t *image_hash, const char *label)
-// {
-//     char hash_print[HASH_LEN * 2 + 1];
-//     hash_print[HASH_LEN * 2] = 0;
-//     for (int i = 0; i < HASH_LEN; ++i) {
-//         sprintf(&hash_print[i * 2], "%02x", image_hash[i]);
-//     }
-//     ESP_LOGI(TAG, "%s %s", label, hash_print);
-// }
-
-// void get_sha256_of_partitions(void)
-// {
-//     uint8_t sha_256[HASH_LEN] = { 0 };
-//     esp_partition_t partition;
-
-//     // get sha256 digest for bootloader
-//     partition.address   = ESP_BOOTLOADER_OFFSET;
-//     partition.size      = ESP_PARTITION_TABLE_OFFSET;
-//     partition.type      = ESP_PARTITION_TYPE_APP;
-//     esp_partition_get_sha256(&partition, sha_256);
-//     print_sha256(sha_256, "SHA-256 for bootloader: ");
-
-//     // get sha256 digest for running partition
-//     esp_partition_get_sha256(esp_ota_get_running_partition(), sha_256);
-//     print_sha256(sha_256, "SHA-256 for current firmware: ");
-// }
-
 void ota_set_finish_callback( void (*func_ptr)(bool) ){
 
 	if(cb_finish_ptr == NULL && cb_finish_ptr != func_ptr){
@@ -0,0 +1,176 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#include <sys/param.h>
+#include <string.h>
+#include <esp_log.h>
+
+#include "ota_delta.h"
+
+#define OTA_DELTA_END       0x00
+#define OTA_DELTA_COPY      0x01
+#define OTA_DELTA_INSERT    0x02
+
+static const char *TAG = "ota_delta";
+
+/**
+ * @brief Patch parser states.
+ */
+typedef enum ota_delta_state_t {
+    OTA_DELTA_HEADER = 0,
+    OTA_DELTA_OP = 1,
+    OTA_DELTA_ARGS = 2,
+    OTA_DELTA_DATA = 3,
+    OTA_DELTA_DONE = 4,
+    OTA_DELTA_ERROR = 5
+}ota_delta_state_t;
+
+static uint32_t ota_delta_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static esp_err_t ota_delta_header(ota_delta_t* delta) {
+    if (memcmp(delta->field, OTA_DELTA_MAGIC, 4) != 0) {
+        ESP_LOGE(TAG, "Not a patch");
+        return ESP_ERR_INVALID_ARG;
+    }
+    delta->source_size = ota_delta_u32(delta->field + 4);
+    delta->target_size = ota_delta_u32(delta->field + 8);
+    memcpy(delta->target_sha256, delta->field + 12, OTA_SHA256_LEN);
+    if (delta->source_size > delta->source->size) {
+        ESP_LOGE(TAG, "Patch for another image: source of %u bytes", delta->source_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGI(TAG, "Patch %u -> %u bytes", delta->source_size, delta->target_size);
+    esp_err_t err = ota_writer_begin(delta->writer, delta->target_size);
+    delta->started = (err == ESP_OK);
+    return err;
+}
+
+/* @brief copies a range of the running image to the new one */
+static esp_err_t ota_delta_copy(ota_delta_t* delta, uint32_t offset, uint32_t len) {
+    if (offset > delta->source_size || len > delta->source_size - offset) {
+        ESP_LOGE(TAG, "Copy out of the source: %u + %u", offset, len);
+        return ESP_ERR_INVALID_ARG;
+    }
+    while (len) {
+        size_t chunk = MIN(len, OTA_DELTA_COPY_BUF);
+        esp_err_t err = esp_partition_read(delta->source, offset, delta->buffer, chunk);
+        if (err == ESP_OK) {
+            err = ota_writer_write(delta->writer, delta->buffer, chunk);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        offset += chunk;
+        len -= chunk;
+    }
+    return ESP_OK;
+}
+
+/* @brief the op and its arguments are read */
+static esp_err_t ota_delta_op(ota_delta_t* delta) {
+    switch (delta->op) {
+    case OTA_DELTA_COPY:
+        delta->state = OTA_DELTA_OP;
+        return ota_delta_copy(delta, ota_delta_u32(delta->field), ota_delta_u32(delta->field + 4));
+    case OTA_DELTA_INSERT:
+        delta->remaining = ota_delta_u32(delta->field);
+        delta->state = (delta->remaining) ? OTA_DELTA_DATA : OTA_DELTA_OP;
+        return ESP_OK;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+void ota_delta_begin(ota_delta_t* delta, ota_writer_t* writer) {
+    memset(delta, 0x00, sizeof(ota_delta_t));
+    delta->state = OTA_DELTA_HEADER;
+    delta->writer = writer;
+    delta->source = esp_ota_get_running_partition();
+}
+
+esp_err_t ota_delta_feed(ota_delta_t* delta, const uint8_t* data, size_t len) {
+    esp_err_t err = ESP_OK;
+    size_t i = 0;
+
+    while (i < len && err == ESP_OK && delta->state != OTA_DELTA_ERROR) {
+        switch (delta->state) {
+        case OTA_DELTA_HEADER:
+            delta->field[delta->field_len++] = data[i++];
+            if (delta->field_len == OTA_DELTA_HEADER_LEN) {
+                delta->field_len = 0;
+                delta->state = OTA_DELTA_OP;
+                err = ota_delta_header(delta);
+            }
+            break;
+        case OTA_DELTA_OP:
+            delta->op = data[i++];
+            delta->field_len = 0;
+            if (delta->op == OTA_DELTA_END) {
+                delta->state = OTA_DELTA_DONE;
+            }else if (delta->op == OTA_DELTA_COPY || delta->op == OTA_DELTA_INSERT) {
+                delta->state = OTA_DELTA_ARGS;
+            }else {
+                ESP_LOGE(TAG, "Unknown op 0x%02x", delta->op);
+                err = ESP_ERR_INVALID_ARG;
+            }
+            break;
+        case OTA_DELTA_ARGS:
+            delta->field[delta->field_len++] = data[i++];
+            if (delta->field_len == ((delta->op == OTA_DELTA_COPY) ? 8 : 4)) {
+                err = ota_delta_op(delta);
+            }
+            break;
+        case OTA_DELTA_DATA: {
+            size_t chunk = MIN(len - i, delta->remaining);
+            err = ota_writer_write(delta->writer, data + i, chunk);
+            i += chunk;
+            delta->remaining -= chunk;
+            if (delta->remaining == 0) {
+                delta->state = OTA_DELTA_OP;
+            }
+            break;
+        }
+        default:
+            /* nothing may follow END */
+            err = ESP_ERR_INVALID_ARG;
+            break;
+        }
+    }
+    if (err != ESP_OK) {
+        delta->state = OTA_DELTA_ERROR;
+    }
+    return err;
+}
+
+esp_err_t ota_delta_finish(ota_delta_t* delta) {
+    if (delta->state != OTA_DELTA_DONE) {
+        ESP_LOGE(TAG, "Patch incomplete");
+        if (delta->started) {
+            ota_writer_abort(delta->writer);
+        }
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* the hash covers the patch and the running image it was applied to */
+    return ota_writer_finish(delta->writer, delta->target_sha256);
+}
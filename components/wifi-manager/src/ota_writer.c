@@ -0,0 +1,172 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#include <sys/param.h>
+#include <string.h>
+#include <esp_log.h>
+
+#include "ota_writer.h"
+
+static const char *TAG = "ota_writer";
+
+static esp_err_t ota_writer_open(ota_writer_t* writer, size_t image_size) {
+    ota_writer_checkpoint_t checkpoint = writer->checkpoint;
+    ota_writer_verify_t verify = writer->verify;
+    void* arg = writer->arg;
+
+    memset(writer, 0x00, sizeof(ota_writer_t));
+    writer->checkpoint = checkpoint;
+    writer->verify = verify;
+    writer->arg = arg;
+    writer->partition = esp_ota_get_next_update_partition(NULL);
+    if (writer->partition == NULL) {
+        ESP_LOGE(TAG, "No update partition");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (image_size != OTA_SIZE_UNKNOWN && image_size > writer->partition->size) {
+        ESP_LOGE(TAG, "Image of %u bytes does not fit partition %s", image_size, writer->partition->label);
+        writer->partition = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    writer->size = image_size;
+    mbedtls_sha256_init(&writer->sha);
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_begin(ota_writer_t* writer, size_t image_size) {
+    esp_err_t err = ota_writer_open(writer, image_size);
+    if (err == ESP_OK) {
+        mbedtls_sha256_starts_ret(&writer->sha, 0);
+        ESP_LOGI(TAG, "Writing partition %s at 0x%x", writer->partition->label, writer->partition->address);
+    }
+    return err;
+}
+
+esp_err_t ota_writer_resume(ota_writer_t* writer, uint32_t address, size_t image_size, size_t written,
+        const mbedtls_sha256_context* sha) {
+    esp_err_t err = ota_writer_open(writer, image_size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (writer->partition->address != address || written % SPI_FLASH_SEC_SIZE ||
+            (image_size != OTA_SIZE_UNKNOWN && written > image_size)) {
+        mbedtls_sha256_free(&writer->sha);
+        writer->partition = NULL;
+        return ESP_ERR_INVALID_ARG;
+    }
+    writer->written = written;
+    writer->erased = written;
+    mbedtls_sha256_clone(&writer->sha, sha);
+    ESP_LOGI(TAG, "Writing partition %s at 0x%x from %u", writer->partition->label, writer->partition->address, written);
+    return ESP_OK;
+}
+
+esp_err_t ota_writer_write(ota_writer_t* writer, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    esp_err_t err = ESP_OK;
+
+    if ((writer->size != OTA_SIZE_UNKNOWN && writer->written + len > writer->size) ||
+            writer->written + len > writer->partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (writer->written == 0 && len && p[0] != OTA_IMAGE_MAGIC) {
+        ESP_LOGE(TAG, "Not an application image, magic 0x%02x", p[0]);
+        return ESP_ERR_INVALID_ARG;
+    }
+    while (len && err == ESP_OK) {
+        /* pieces end at sector boundaries */
+        size_t piece = MIN(len, SPI_FLASH_SEC_SIZE - writer->written % SPI_FLASH_SEC_SIZE);
+        if (writer->written == writer->erased) {
+            err = esp_partition_erase_range(writer->partition, writer->erased, SPI_FLASH_SEC_SIZE);
+            if (err != ESP_OK) {
+                break;
+            }
+            writer->erased += SPI_FLASH_SEC_SIZE;
+        }
+        err = esp_partition_write(writer->partition, writer->written, p, piece);
+        if (err != ESP_OK) {
+            break;
+        }
+        mbedtls_sha256_update_ret(&writer->sha, p, piece);
+        writer->written += piece;
+        p += piece;
+        len -= piece;
+        if (writer->written % SPI_FLASH_SEC_SIZE == 0 && writer->checkpoint) {
+            writer->checkpoint(writer, writer->arg);
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Flash write at 0x%x failed: %s", writer->partition->address + writer->written, esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool ota_writer_erase_ahead(ota_writer_t* writer, size_t sectors) {
+    if (writer->partition == NULL) {
+        return false;
+    }
+    size_t end = writer->partition->size;
+    if (writer->size != OTA_SIZE_UNKNOWN) {
+        end = MIN(end, (writer->size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE);
+    }
+    if (writer->erased >= end || writer->erased >= writer->written + sectors * SPI_FLASH_SEC_SIZE) {
+        return false;
+    }
+    if (esp_partition_erase_range(writer->partition, writer->erased, SPI_FLASH_SEC_SIZE) != ESP_OK) {
+        /* ota_writer_write() retries and reports it */
+        return false;
+    }
+    writer->erased += SPI_FLASH_SEC_SIZE;
+    return true;
+}
+
+esp_err_t ota_writer_finish(ota_writer_t* writer, const uint8_t* sha256) {
+    uint8_t digest[OTA_SHA256_LEN];
+
+    mbedtls_sha256_finish_ret(&writer->sha, digest);
+    mbedtls_sha256_free(&writer->sha);
+    if (sha256 && memcmp(digest, sha256, OTA_SHA256_LEN) != 0) {
+        ESP_LOGE(TAG, "Image SHA-256 mismatch");
+        return ESP_ERR_INVALID_CRC;
+    }
+    if (writer->size != OTA_SIZE_UNKNOWN && writer->written != writer->size) {
+        ESP_LOGE(TAG, "Image incomplete: %u of %u bytes", writer->written, writer->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err = (writer->verify) ? writer->verify(writer, digest, writer->arg) : ESP_OK;
+    if (err != ESP_OK) {
+        return err;
+    }
+    /* validates the image format too */
+    err = esp_ota_set_boot_partition(writer->partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image not accepted: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+void ota_writer_abort(ota_writer_t* writer) {
+    /* the boot partition was not changed, what was written is left for a resume */
+    mbedtls_sha256_free(&writer->sha);
+    /* nothing is erased ahead for an aborted writer */
+    writer->partition = NULL;
+}
@@ -0,0 +1,330 @@
+/**
+ * author:  Viktar Vasiuk
+
+   ----------------------------------------------------------------------
+    Copyright (C) Viktar Vasiuk, 2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   ----------------------------------------------------------------------
+
+@see https://github.com/vivask/esp8266-wifi-manager
+*/
+#include <sys/param.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "outbox.h"
+
+#define STORE_BASE_PATH         "/"CONFIG_STORE_MOUNT_POINT
+#define OUTBOX_META_FILE        STORE_BASE_PATH "/outbox.bin"
+#define OUTBOX_META_NEW_FILE    STORE_BASE_PATH "/outbox.new"
+#define OUTBOX_RECORD_FILE      STORE_BASE_PATH "/outbox_%u.bin"
+#define OUTBOX_MAX_PATH         (sizeof(STORE_BASE_PATH) + 24)
+
+static const char *TAG = "outbox";
+
+/**
+ * @brief Records are files numbered from head (oldest) to tail (next free number).
+ */
+typedef struct _outbox_meta_t {
+    uint32_t    head;
+    uint32_t    tail;
+    uint32_t    bytes;
+    uint32_t    dropped;
+    uint32_t    replays;    /* failed replays of the head record */
+}outbox_meta_t;
+
+/**
+ * @brief Record file layout: header, uri, body.
+ */
+typedef struct _outbox_record_hdr_t {
+    uint16_t    method;
+    uint16_t    uri_len;
+    uint32_t    data_len;
+}outbox_record_hdr_t;
+
+static outbox_meta_t meta = {0};
+
+static SemaphoreHandle_t outbox_mutex = NULL;
+
+static void outbox_record_path(char* path, uint32_t number) {
+    snprintf(path, OUTBOX_MAX_PATH, OUTBOX_RECORD_FILE, number);
+}
+
+/* @brief the state is written aside and renamed, a reset never leaves it half written */
+static esp_err_t outbox_save_meta() {
+    FILE* f = fopen(OUTBOX_META_NEW_FILE, "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open file %s for writing", OUTBOX_META_NEW_FILE);
+        return ESP_FAIL;
+    }
+    size_t wrote = fwrite(&meta, sizeof(outbox_meta_t), 1, f);
+    fclose(f);
+    if (wrote != 1) {
+        remove(OUTBOX_META_NEW_FILE);
+        return ESP_FAIL;
+    }
+    /* SPIFFS rename does not replace an existing file, outbox_init() takes the new one if it is left alone */
+    remove(OUTBOX_META_FILE);
+    if (rename(OUTBOX_META_NEW_FILE, OUTBOX_META_FILE) != 0) {
+        ESP_LOGE(TAG, "Failed to rename %s", OUTBOX_META_NEW_FILE);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static bool outbox_load_meta(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fread(&meta, sizeof(outbox_meta_t), 1, f) == 1 && meta.head <= meta.tail;
+    fclose(f);
+    if (!ok) {
+        memset(&meta, 0x00, sizeof(outbox_meta_t));
+    }
+    return ok;
+}
+
+/* @brief rebuilds the state from the record files, a missing number is skipped as a corrupted record */
+static void outbox_scan_records() {
+    char path[OUTBOX_MAX_PATH];
+    struct stat st;
+    struct dirent* entry;
+    uint32_t number;
+    int end;
+
+    memset(&meta, 0x00, sizeof(outbox_meta_t));
+    DIR* dir = opendir(STORE_BASE_PATH);
+    if (dir == NULL) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        end = 0;
+        if (sscanf(entry->d_name, "outbox_%u.bin%n", &number, &end) != 1 || end == 0 || entry->d_name[end] != '\0') {
+            continue;
+        }
+        if (meta.head == meta.tail) {
+            meta.head = number;
+            meta.tail = number + 1;
+        }else {
+            meta.head = MIN(meta.head, number);
+            meta.tail = MAX(meta.tail, number + 1);
+        }
+        outbox_record_path(path, number);
+        if (stat(path, &st) == 0) {
+            meta.bytes += st.st_size;
+        }
+    }
+    closedir(dir);
+}
+
+static void outbox_remove_oldest() {
+    char path[OUTBOX_MAX_PATH];
+    struct stat st;
+
+    if (meta.head == meta.tail) {
+        return;
+    }
+    outbox_record_path(path, meta.head);
+    if (stat(path, &st) == 0) {
+        meta.bytes -= MIN(meta.bytes, (uint32_t)st.st_size);
+    }
+    remove(path);
+    meta.head++;
+    meta.replays = 0;
+    if (meta.head == meta.tail) {
+        meta.bytes = 0;
+    }
+}
+
+esp_err_t outbox_init() {
+    if (outbox_mutex == NULL) {
+        outbox_mutex = xSemaphoreCreateMutex();
+    }
+
+    if (outbox_load_meta(OUTBOX_META_NEW_FILE)) {
+        /* reset between writing the new state and renaming it */
+        remove(OUTBOX_META_FILE);
+        rename(OUTBOX_META_NEW_FILE, OUTBOX_META_FILE);
+    }else {
+        remove(OUTBOX_META_NEW_FILE);
+        if (!outbox_load_meta(OUTBOX_META_FILE)) {
+            /* none on the first start, or written by an older firmware */
+            outbox_scan_records();
+            if (meta.head != meta.tail) {
+                ESP_LOGW(TAG, "Outbox state lost, recovered from the records");
+            }
+            outbox_save_meta();
+        }
+    }
+    ESP_LOGI(TAG, "Outbox records: %u, bytes: %u", meta.tail - meta.head, meta.bytes);
+    return ESP_OK;
+}
+
+esp_err_t outbox_push(uint16_t method, const char* uri, const char* data, size_t data_len) {
+    char path[OUTBOX_MAX_PATH];
+    outbox_record_hdr_t hdr = {
+        .method = method,
+        .uri_len = strlen(uri),
+        .data_len = (data) ? data_len : 0,
+    };
+    uint32_t size = sizeof(outbox_record_hdr_t) + hdr.uri_len + hdr.data_len;
+    esp_err_t esp_err = ESP_OK;
+
+    xSemaphoreTake(outbox_mutex, portMAX_DELAY);
+
+    if (size > CONFIG_HTTP_CLIENT_OUTBOX_MAX_SIZE) {
+        meta.dropped++;
+        esp_err = ESP_ERR_NO_MEM;
+    }
+    while (esp_err == ESP_OK &&
+            (meta.tail - meta.head >= CONFIG_HTTP_CLIENT_OUTBOX_MAX_RECORDS ||
+            meta.bytes + size > CONFIG_HTTP_CLIENT_OUTBOX_MAX_SIZE)) {
+        meta.dropped++;
+#ifdef CONFIG_HTTP_CLIENT_OUTBOX_DROP_NEWEST
+        esp_err = ESP_ERR_NO_MEM;
+#else
+        outbox_remove_oldest();
+#endif
+    }
+
+    if (esp_err == ESP_OK) {
+        outbox_record_path(path, meta.tail);
+        FILE* f = fopen(path, "wb");
+        if (f == NULL) {
+            ESP_LOGE(TAG, "Failed to open file %s for writing", path);
+            esp_err = ESP_FAIL;
+        }else {
+            if (fwrite(&hdr, sizeof(outbox_record_hdr_t), 1, f) != 1 ||
+                    fwrite(uri, 1, hdr.uri_len, f) != hdr.uri_len ||
+                    fwrite(data, 1, hdr.data_len, f) != hdr.data_len) {
+                esp_err = ESP_FAIL;
+            }
+            fclose(f);
+            if (esp_err == ESP_OK) {
+                meta.tail++;
+                meta.bytes += size;
+            }else {
+                ESP_LOGE(TAG, "File: %s write error", path);
+                remove(path);
+            }
+        }
+    }else {
+        ESP_LOGW(TAG, "Outbox full, request to %s dropped", uri);
+    }
+    outbox_save_meta();
+
+    xSemaphoreGive(outbox_mutex);
+    return esp_err;
+}
+
+http_client_request_t* outbox_peek(uint32_t* number) {
+    char path[OUTBOX_MAX_PATH];
+    outbox_record_hdr_t hdr;
+    http_client_request_t* msg = NULL;
+
+    xSemaphoreTake(outbox_mutex, portMAX_DELAY);
+
+    if (meta.head != meta.tail) {
+        *number = meta.head;
+        outbox_record_path(path, meta.head);
+        FILE* f = fopen(path, "rb");
+        if (f == NULL) {
+            ESP_LOGE(TAG, "Failed to open file %s for reading", path);
+        }else {
+            if (fread(&hdr, sizeof(outbox_record_hdr_t), 1, f) == 1 &&
+                    hdr.data_len <= CONFIG_HTTP_CLIENT_OUTBOX_MAX_SIZE) {
+                msg = (http_client_request_t*)malloc(sizeof(http_client_request_t) + hdr.uri_len + hdr.data_len + 2);
+            }
+            if (msg) {
+                msg->method = hdr.method;
+                msg->deadline = 0;
+                msg->data_len = hdr.data_len;
+                msg->data_owned = false;
+                msg->id = 0;
+                msg->queued = xTaskGetTickCount();
+                msg->done = NULL;
+                msg->done_arg = NULL;
+                msg->data = (hdr.data_len) ? msg->uri + hdr.uri_len + 1 : NULL;
+                if (fread(msg->uri, 1, hdr.uri_len, f) != hdr.uri_len ||
+                        (msg->data && fread(msg->data, 1, hdr.data_len, f) != hdr.data_len)) {
+                    free(msg);
+                    msg = NULL;
+                }else {
+                    msg->uri[hdr.uri_len] = '\0';
+                    if (msg->data) {
+                        msg->data[hdr.data_len] = '\0';
+                    }
+                }
+            }
+            fclose(f);
+        }
+        if (msg == NULL) {
+            /* unreadable record, skip it rather than block the outbox */
+            ESP_LOGE(TAG, "Record %s is corrupted, removed", path);
+            outbox_remove_oldest();
+            outbox_save_meta();
+        }
+    }
+
+    xSemaphoreGive(outbox_mutex);
+    return msg;
+}
+
+void outbox_remove(uint32_t number) {
+    xSemaphoreTake(outbox_mutex, portMAX_DELAY);
+    /* records are only removed oldest first, one below the head was already dropped */
+    if (number == meta.head) {
+        outbox_remove_oldest();
+        outbox_save_meta();
+    }
+    xSemaphoreGive(outbox_mutex);
+}
+
+esp_err_t outbox_replay_failed(uint32_t number) {
+    esp_err_t esp_err = ESP_OK;
+
+    xSemaphoreTake(outbox_mutex, portMAX_DELAY);
+    if (number != meta.head) {
+        esp_err = ESP_ERR_NOT_FOUND;
+    }else {
+        meta.replays++;
+#if CONFIG_HTTP_CLIENT_OUTBOX_MAX_REPLAYS
+        if (meta.replays >= CONFIG_HTTP_CLIENT_OUTBOX_MAX_REPLAYS) {
+            ESP_LOGW(TAG, "Record %u failed %u replays, dropped", number, meta.replays);
+            meta.dropped++;
+            outbox_remove_oldest();
+            esp_err = ESP_ERR_INVALID_STATE;
+        }
+#endif
+        outbox_save_meta();
+    }
+    xSemaphoreGive(outbox_mutex);
+    return esp_err;
+}
+
+void outbox_get_stats(outbox_stats_t* stats) {
+    xSemaphoreTake(outbox_mutex, portMAX_DELAY);
+    stats->records = meta.tail - meta.head;
+    stats->bytes = meta.bytes;
+    stats->dropped = meta.dropped;
+    xSemaphoreGive(outbox_mutex);
+}
@@ -46,8 +46,47 @@
 #define HTTP_CRT_FILE 		STORE_BASE_PATH "/http_crt.json"
 #define HTTP_KEY_FILE 		STORE_BASE_PATH "/http_key.json"
 
+/* bundle transaction: sections are staged next to their files, the marker makes the staging final */
+#define STAGED_SUFFIX		".new"
+#define COMMIT_MARKER_FILE	STORE_BASE_PATH "/config.commit"
+#define MAX_STAGED_PATH		(CONFIG_SPIFFS_OBJ_NAME_LEN + sizeof(STORE_BASE_PATH))
+
 static const char TAG[] = "wifi_store";
 
+static const char* wifi_keys[] = {"wifi_ssid", "wifi_wpa", "wifi_identity", "wifi_username", "wifi_password", "wifi_auth", NULL};
+static const char* ipv4_keys[] = {"ipv4_method", "ipv4_address", "ipv4_mask", "ipv4_gate", "ipv4_dns1", "ipv4_dns2", "ipv4_zone", "ipv4_ntp", NULL};
+static const char* http_keys[] = {"server_address", "server_port", "server_api", "esp_json_key", "stm_json_key", "server_auth", "client_username", "client_password", NULL};
+static const char* wifi_ca_keys[] = {"wifi_ca", NULL};
+static const char* wifi_crt_keys[] = {"wifi_crt", NULL};
+static const char* wifi_key_keys[] = {"wifi_key", NULL};
+static const char* http_ca_keys[] = {"client_ca", NULL};
+static const char* http_crt_keys[] = {"client_crt", NULL};
+static const char* http_key_keys[] = {"client_key", NULL};
+
+/**
+ * @brief One configuration file and the keys it must contain.
+ * The name is the one of the POST endpoint saving this section alone.
+ */
+typedef struct _storage_section_t {
+	const char* 	name;
+	const char* 	file;
+	const char** 	keys;
+}storage_section_t;
+
+static const storage_section_t storage_sections[] = {
+	{ "wifi_setup", 	WIFI_CONFIG_FILE, 	wifi_keys },
+	{ "ipv4_setup", 	IPV4_CONFIG_FILE, 	ipv4_keys },
+	{ "http_setup", 	HTTP_CONFIG_FILE, 	http_keys },
+	{ "wifi_ca", 		WIFI_CA_FILE, 		wifi_ca_keys },
+	{ "wifi_crt", 		WIFI_CRT_FILE, 		wifi_crt_keys },
+	{ "wifi_key", 		WIFI_KEY_FILE, 		wifi_key_keys },
+	{ "client_ca", 		HTTP_CA_FILE, 		http_ca_keys },
+	{ "client_crt", 	HTTP_CRT_FILE, 		http_crt_keys },
+	{ "client_key", 	HTTP_KEY_FILE, 		http_key_keys },
+};
+
+#define STORAGE_SECTIONS_COUNT	(sizeof(storage_sections) / sizeof(storage_sections[0]))
+
 static char* copy_json_item(cJSON* json, const char* item_name) {
 	cJSON* item = cJSON_GetObjectItem(json, item_name);
 	if (!item) {
@@ -213,7 +252,125 @@ esp_err_t wifi_manager_save_http_key(const char* json_string) {
 	return save_flash_json_data(json_string, HTTP_KEY_FILE);
 }
 
+static void staged_path(char* path, const storage_section_t* section) {
+	snprintf(path, MAX_STAGED_PATH, "%s" STAGED_SUFFIX, section->file);
+}
+
+static void discard_staged_sections() {
+	char path[MAX_STAGED_PATH];
+	for (int i = 0; i < STORAGE_SECTIONS_COUNT; i++) {
+		staged_path(path, &storage_sections[i]);
+		remove(path);
+	}
+}
+
+/**
+ * @brief Moves every staged section over its file and drops the marker.
+ * Idempotent: a section already moved has no staged file anymore.
+ */
+static esp_err_t apply_staged_sections() {
+	char path[MAX_STAGED_PATH];
+	esp_err_t ret = ESP_OK;
+	for (int i = 0; i < STORAGE_SECTIONS_COUNT; i++) {
+		staged_path(path, &storage_sections[i]);
+		if (!is_flash_file_exist(path)) {
+			continue;
+		}
+		/* SPIFFS rename does not replace an existing file */
+		remove(storage_sections[i].file);
+		if (rename(path, storage_sections[i].file) != 0) {
+			ESP_LOGE(TAG, "Failed to commit %s", storage_sections[i].file);
+			ret = ESP_FAIL;
+		}
+	}
+	if (ret == ESP_OK) {
+		remove(COMMIT_MARKER_FILE);
+	}
+	return ret;
+}
+
+/**
+ * @brief Completes or rolls back a bundle interrupted by a reset.
+ * With the marker present every section was staged successfully and the commit is redone,
+ * otherwise the staged files are leftovers of an incomplete bundle.
+ */
+static void recover_config_transaction() {
+	if (is_flash_file_exist(COMMIT_MARKER_FILE)) {
+		ESP_LOGW(TAG, "Completing interrupted configuration commit");
+		apply_staged_sections();
+	} else {
+		discard_staged_sections();
+	}
+}
+
+static bool validate_section(const cJSON* bundle, const storage_section_t* section) {
+	cJSON* json = cJSON_GetObjectItem(bundle, section->name);
+	if (!cJSON_IsObject(json)) {
+		ESP_LOGE(TAG, "Bundle section [%s] not found", section->name);
+		return false;
+	}
+	for (const char** key = section->keys; *key; key++) {
+		if (!cJSON_HasObjectItem(json, *key)) {
+			ESP_LOGE(TAG, "Bundle section [%s]: json object [%s] not found", section->name, *key);
+			return false;
+		}
+	}
+	return true;
+}
+
+esp_err_t wifi_manager_save_config_bundle(const char* json_string) {
+	esp_err_t ret = ESP_OK;
+	char path[MAX_STAGED_PATH];
+
+	cJSON *bundle = cJSON_Parse(json_string);
+	if (!bundle) {
+		ESP_LOGE(TAG, "Bundle is not a valid json");
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	/* validate the whole bundle before touching the flash */
+	for (int i = 0; i < STORAGE_SECTIONS_COUNT; i++) {
+		if (!validate_section(bundle, &storage_sections[i])) {
+			cJSON_Delete(bundle);
+			return ESP_ERR_INVALID_ARG;
+		}
+	}
+
+	/* stage every section */
+	recover_config_transaction();
+	for (int i = 0; i < STORAGE_SECTIONS_COUNT && ret == ESP_OK; i++) {
+		char* section = cJSON_PrintUnformatted(cJSON_GetObjectItem(bundle, storage_sections[i].name));
+		if (!section) {
+			ret = ESP_ERR_NO_MEM;
+			break;
+		}
+		staged_path(path, &storage_sections[i]);
+		ret = save_flash_json_data(section, path);
+		free(section);
+	}
+	cJSON_Delete(bundle);
+
+	if (ret != ESP_OK) {
+		discard_staged_sections();
+		return ret;
+	}
+
+	/* commit point */
+	ret = save_flash_json_data("1", COMMIT_MARKER_FILE);
+	if (ret != ESP_OK) {
+		discard_staged_sections();
+		return ret;
+	}
+	ret = apply_staged_sections();
+	if (ret == ESP_OK) {
+		ESP_LOGI(TAG, "Configuration bundle committed");
+	}
+	return ret;
+}
+
 esp_err_t wifi_manager_fetch_config(esp8266_config_t* config)	{
+	recover_config_transaction();
+
 	// Restore wifi configure from flash
 	const char* wifi_string = read_flash_json_data(WIFI_CONFIG_FILE);
 	if (!wifi_string) {
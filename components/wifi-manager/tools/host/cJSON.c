@@ -0,0 +1,134 @@
+/*
+ * Host build: the few cJSON calls of http_client.c and ota.c.
+ *
+ * Only objects of string members are built and parsed, which is what the orders carry:
+ * the firmware file and its attributes. Other documents are not parsed, NULL is returned.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <cJSON.h>
+
+static char* copy(const char* text, size_t len){
+	char* str = (char*)malloc(len + 1);
+	if(str){
+		memcpy(str, text, len);
+		str[len] = '\0';
+	}
+	return str;
+}
+
+cJSON *cJSON_CreateObject(void){
+	cJSON* object = (cJSON*)calloc(1, sizeof(cJSON));
+	if(object){
+		object->type = cJSON_Object;
+	}
+	return object;
+}
+
+cJSON *cJSON_AddStringToObject(cJSON * const object, const char * const name, const char * const string){
+	if(object == NULL){
+		return NULL;
+	}
+	cJSON* item = (cJSON*)calloc(1, sizeof(cJSON));
+	if(item == NULL){
+		return NULL;
+	}
+	item->type = cJSON_String;
+	item->string = copy(name, strlen(name));
+	item->valuestring = copy(string, strlen(string));
+	if(item->string == NULL || item->valuestring == NULL){
+		cJSON_Delete(item);
+		return NULL;
+	}
+	if(object->child == NULL){
+		object->child = item;
+	}
+	else{
+		cJSON* last = object->child;
+		while(last->next){
+			last = last->next;
+		}
+		last->next = item;
+		item->prev = last;
+	}
+	return item;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON * const object, const char * const string){
+	cJSON* item;
+	cJSON_ArrayForEach(item, object){
+		if(item->string && strcmp(item->string, string) == 0){
+			return item;
+		}
+	}
+	return NULL;
+}
+
+void cJSON_Delete(cJSON *item){
+	while(item){
+		cJSON* next = item->next;
+		cJSON_Delete(item->child);
+		free(item->string);
+		free(item->valuestring);
+		free(item);
+		item = next;
+	}
+}
+
+static const char* skip(const char* p){
+	while(*p && isspace((unsigned char)*p)){
+		p++;
+	}
+	return p;
+}
+
+/* @brief a string without escapes, its end quote or NULL */
+static const char* string_end(const char* p){
+	for(; *p && *p != '"'; p++){
+		if(*p == '\\'){
+			return NULL;
+		}
+	}
+	return (*p == '"') ? p : NULL;
+}
+
+cJSON *cJSON_Parse(const char *value){
+	cJSON* object;
+	const char* p;
+
+	if(value == NULL || *(p = skip(value)) != '{' || (object = cJSON_CreateObject()) == NULL){
+		return NULL;
+	}
+	p = skip(p + 1);
+	while(*p == '"'){
+		const char* name = p + 1;
+		const char* name_end = string_end(name);
+		if(name_end == NULL || *(p = skip(name_end + 1)) != ':' || *(p = skip(p + 1)) != '"'){
+			break;
+		}
+		const char* text = p + 1;
+		const char* text_end = string_end(text);
+		if(text_end == NULL){
+			break;
+		}
+		char* key = copy(name, name_end - name);
+		char* str = copy(text, text_end - text);
+		cJSON* item = (key && str) ? cJSON_AddStringToObject(object, key, str) : NULL;
+		free(key);
+		free(str);
+		if(item == NULL){
+			break;
+		}
+		p = skip(text_end + 1);
+		if(*p == ','){
+			p = skip(p + 1);
+		}
+	}
+	if(*p != '}'){
+		cJSON_Delete(object);
+		return NULL;
+	}
+	return object;
+}
@@ -0,0 +1,303 @@
+/*
+ * Host build of http_client.c and ota.c: runs the backend client against a server of the
+ * host, normally ../mock_backend.py, and prints its figures.
+ *
+ * usage: http_client_host [-s host:port] [-a api] load <requests> [rate/s] [body bytes]
+ *        http_client_host [-s host:port] [-a api] batch <seconds> <records/s> [max bytes] [linger ms]
+ *        http_client_host [-s host:port] [-a api] ota [timeout s]
+ *
+ * load    alternates GET and POST /load with a completion callback, all at once or at
+ *         rate per second, and prints the throughput and the latency from queuing to
+ *         completion, measured on the host clock.
+ * batch   posts records to /telemetry batched by http_client_set_batching() for seconds,
+ *         and prints http_client_get_batch_stats() as is and per hour.
+ * ota     waits for the firmware the orders offer (mock_backend.py --firmware) and prints
+ *         the download figures once the upgrade asks for the reboot.
+ *
+ * The server is 127.0.0.1:8080 by default. The storage partition, for the outbox and the
+ * resume state of a download, is the storage directory of the build, emptied at start.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#include "http_client.h"
+#include "ota.h"
+#include "client_stub.h"
+#include "flash_sim.h"
+#include "port.h"
+
+#define STORE_BASE_PATH		"/" CONFIG_STORE_MOUNT_POINT
+#define CONNECT_TIMEOUT_MS	10000
+#define DRAIN_TIMEOUT_MS	30000
+
+static const char TAG[] = "http_client_host";
+
+static SemaphoreHandle_t ready = NULL;
+
+typedef struct {
+	int64_t		start;
+	uint32_t	latency_us;
+	int			status;
+	esp_err_t	err;
+}load_request_t;
+
+static volatile uint32_t completed = 0;
+static ota_progress_t ota_done = {0};
+
+static void usage(void){
+	fprintf(stderr, "usage: http_client_host [-s host:port] [-a api] load <requests> [rate/s] [body bytes]\n"
+		"       http_client_host [-s host:port] [-a api] batch <seconds> <records/s> [max bytes] [linger ms]\n"
+		"       http_client_host [-s host:port] [-a api] ota [timeout s]\n");
+	exit(2);
+}
+
+static void on_ready(void* arg){
+	xSemaphoreGive(ready);
+}
+
+/* @brief a new device: no outbox and no download to resume */
+static void storage_init(void){
+	DIR* dir;
+	struct dirent* entry;
+	char path[sizeof(STORE_BASE_PATH) + 256];
+
+	mkdir(STORE_BASE_PATH, 0755);
+	if((dir = opendir(STORE_BASE_PATH)) == NULL){
+		fprintf(stderr, "http_client_host: no storage directory %s\n", STORE_BASE_PATH);
+		exit(1);
+	}
+	while((entry = readdir(dir)) != NULL){
+		if(entry->d_name[0] != '.'){
+			snprintf(path, sizeof(path), "%s/%s", STORE_BASE_PATH, entry->d_name);
+			unlink(path);
+		}
+	}
+	closedir(dir);
+}
+
+static int compare_latency(const void* a, const void* b){
+	uint32_t x = ((const load_request_t*)a)->latency_us, y = ((const load_request_t*)b)->latency_us;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const load_request_t* sorted, uint32_t count, double p){
+	return (count) ? sorted[(uint32_t)(p * (count - 1))].latency_us / 1000.0 : 0;
+}
+
+static void load_done(const http_client_result_t* result, void* arg){
+	load_request_t* request = (load_request_t*)arg;
+	request->latency_us = (uint32_t)(esp_timer_get_time() - request->start);
+	request->status = result->status;
+	request->err = result->err;
+	__atomic_add_fetch(&completed, 1, __ATOMIC_RELEASE);
+}
+
+static int run_load(uint32_t requests, double rate, size_t body_size){
+	load_request_t* load = (load_request_t*)calloc(requests, sizeof(load_request_t));
+	char* body = (char*)malloc(body_size + 32);
+	uint32_t queued = 0, rejected = 0, failed = 0;
+
+	if(load == NULL || body == NULL){
+		return 1;
+	}
+	int64_t start = esp_timer_get_time();
+	for(uint32_t i = 0; i < requests; i++){
+		if(rate > 0){
+			int64_t wait = start + (int64_t)(i * 1000000.0 / rate) - esp_timer_get_time();
+			if(wait > 0){
+				usleep(wait);
+			}
+		}
+		bool post = i % 2;
+		if(post){
+			int len = snprintf(body, body_size + 32, "{\"seq\":%u,\"data\":\"", i);
+			for(; len < (int)body_size - 2; len++){
+				body[len] = 'a' + len % 26;
+			}
+			strcpy(body + len, "\"}");
+		}
+		load[i].start = esp_timer_get_time();
+		if(http_client_request(HC_LANE_NORMAL, post ? HTTP_METHOD_POST : HTTP_METHOD_GET, "/load", post ? body : NULL,
+				load_done, &load[i], pdMS_TO_TICKS(DRAIN_TIMEOUT_MS), NULL) == ESP_OK){
+			queued++;
+		}
+		else{
+			load[i].start = 0;
+			rejected++;
+		}
+	}
+	int64_t deadline = esp_timer_get_time() + DRAIN_TIMEOUT_MS * 1000LL;
+	while(__atomic_load_n(&completed, __ATOMIC_ACQUIRE) < queued && esp_timer_get_time() < deadline){
+		usleep(1000);
+	}
+	int64_t end = esp_timer_get_time();
+	uint32_t done = __atomic_load_n(&completed, __ATOMIC_ACQUIRE);
+
+	/* the completed requests first */
+	uint32_t count = 0;
+	for(uint32_t i = 0; i < requests; i++){
+		if(load[i].start && load[i].latency_us){
+			if(load[i].err != ESP_OK || load[i].status != 200){
+				failed++;
+			}
+			load[count++] = load[i];
+		}
+	}
+	qsort(load, count, sizeof(load_request_t), compare_latency);
+	double seconds = (end - start) / 1e6;
+	printf("load: %u requests, %u rejected, %u completed, %u failed in %.2f s, %.1f req/s, pool of %d\n",
+		(unsigned)requests, (unsigned)rejected, (unsigned)done, (unsigned)failed, seconds,
+		done / seconds, CONFIG_HTTP_CLIENT_POOL_SIZE);
+	printf("latency: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+		percentile(load, count, 0.5), percentile(load, count, 0.9), percentile(load, count, 0.99),
+		percentile(load, count, 1.0));
+	free(body);
+	free(load);
+	return (failed || done < queued) ? 1 : 0;
+}
+
+#ifdef CONFIG_HTTP_CLIENT_BATCH
+static int run_batch(uint32_t seconds, double rate, size_t max_bytes, uint32_t linger_ms){
+	http_client_batch_stats_t stats;
+	char record[96];
+	uint32_t records = (uint32_t)(seconds * rate), rejected = 0;
+
+	if(http_client_set_batching("/telemetry", max_bytes, linger_ms, portMAX_DELAY) != ESP_OK){
+		fprintf(stderr, "http_client_host: batching not set\n");
+		return 1;
+	}
+	int64_t start = esp_timer_get_time();
+	for(uint32_t i = 0; i < records; i++){
+		int64_t wait = start + (int64_t)(i * 1000000.0 / rate) - esp_timer_get_time();
+		if(wait > 0){
+			usleep(wait);
+		}
+		/* a sensor reading */
+		snprintf(record, sizeof(record), "{\"seq\":%u,\"t\":%u,\"temp\":%u.%u,\"hum\":%u.%u}",
+			i, (unsigned)(esp_timer_get_time() / 1000000), 18 + i % 7, i % 10, 40 + i % 13, i % 10);
+		if(http_client_send(HC_LANE_BULK, HTTP_METHOD_POST, "/telemetry", record, pdMS_TO_TICKS(1000)) != ESP_OK){
+			rejected++;
+		}
+	}
+	/* the last batch lingers */
+	usleep((linger_ms + 1000) * 1000);
+	http_client_get_batch_stats(&stats);
+
+	double per_hour = 3600.0 / seconds;
+	printf("batch: %u records of %u bytes in %u s, %u rejected, max %u bytes, linger %u ms\n",
+		(unsigned)records, (unsigned)(records ? stats.record_bytes / records : 0), (unsigned)seconds,
+		(unsigned)rejected, (unsigned)max_bytes, (unsigned)linger_ms);
+	printf("stats: %u records, %u record bytes, %u requests, %u bytes\n",
+		stats.records, stats.record_bytes, stats.requests, stats.bytes);
+	printf("per hour: %.0f records, %.0f requests, %.0f body bytes, %.1f records per request\n",
+		stats.records * per_hour, stats.requests * per_hour, stats.bytes * per_hour,
+		stats.requests ? (double)stats.records / stats.requests : 0);
+	return rejected ? 1 : 0;
+}
+#endif
+
+static void ota_progress(const ota_progress_t* progress, void* arg){
+	if(progress->done){
+		ota_done = *progress;
+	}
+}
+
+static int run_ota(uint32_t timeout_s){
+	flash_sim_stats_t flash;
+
+	if(!client_stub_wait_reboot(timeout_s * 1000)){
+		fprintf(stderr, "http_client_host: no upgrade within %u s\n", (unsigned)timeout_s);
+		return 1;
+	}
+	flash_sim_get_stats(&flash);
+	printf("ota: %u bytes written from %u downloaded in %u ms, %.1f KB/s, boot partition %s\n",
+		ota_done.written, ota_done.received, ota_done.elapsed_ms,
+		ota_done.elapsed_ms ? ota_done.received / 1.024 / ota_done.elapsed_ms : 0, flash.boot);
+	printf("flash: %u sectors erased, %u pages programmed, busy %u ms (%.0f%% of the download)\n",
+		flash.sectors, flash.pages, (unsigned)(flash.busy_us / 1000),
+		ota_done.elapsed_ms ? flash.busy_us / 10.0 / ota_done.elapsed_ms : 0);
+	return 0;
+}
+
+int main(int argc, char** argv){
+	const char* server = "127.0.0.1:8080";
+	const char* api = "";
+	char host[64];
+	int opt, ret = 2;
+
+	while((opt = getopt(argc, argv, "s:a:")) != -1){
+		if(opt == 's'){
+			server = optarg;
+		}
+		else if(opt == 'a'){
+			api = optarg;
+		}
+		else{
+			usage();
+		}
+	}
+	if(optind >= argc){
+		usage();
+	}
+	const char* mode = argv[optind];
+	const char* colon = strchr(server, ':');
+	snprintf(host, sizeof(host), "%.*s", colon ? (int)(colon - server) : (int)strlen(server), server);
+
+	port_init();
+	flash_sim_init();
+	storage_init();
+	client_stub_init(host, colon ? atoi(colon + 1) : 80, api, "esp");
+
+	ready = xSemaphoreCreateBinary();
+	http_client_initialize();
+	http_client_set_ready_callback(on_ready);
+	ota_set_progress_callback(ota_progress, NULL);
+	size_t heap_base = port_heap_size() - esp_get_free_heap_size();
+
+	/* as the wifi manager does once the station has its address */
+	client_stub_wifi_connected();
+	if(xSemaphoreTake(ready, pdMS_TO_TICKS(CONNECT_TIMEOUT_MS)) != pdTRUE && strcmp(mode, "ota") != 0){
+		fprintf(stderr, "http_client_host: backend %s not reached\n", server);
+		return 1;
+	}
+
+	if(strcmp(mode, "load") == 0 && argc - optind >= 2){
+		ret = run_load(atoi(argv[optind + 1]), (argc - optind > 2) ? atof(argv[optind + 2]) : 0,
+			(argc - optind > 3) ? atoi(argv[optind + 3]) : 200);
+	}
+#ifdef CONFIG_HTTP_CLIENT_BATCH
+	else if(strcmp(mode, "batch") == 0 && argc - optind >= 3){
+		ret = run_batch(atoi(argv[optind + 1]), atof(argv[optind + 2]),
+			(argc - optind > 3) ? atoi(argv[optind + 3]) : 1024, (argc - optind > 4) ? atoi(argv[optind + 4]) : 5000);
+	}
+#endif
+	else if(strcmp(mode, "ota") == 0){
+		ret = run_ota((argc - optind > 1) ? atoi(argv[optind + 1]) : 120);
+	}
+	else{
+		usage();
+	}
+
+	http_client_conn_stats_t conn;
+	http_client_get_conn_stats(&conn);
+	size_t peak = port_heap_peak();
+	printf("connections: %u connects, %u requests, connect %u ms on average, %u ms at most\n",
+		conn.connects, conn.requests, conn.connects ? conn.connect_ms / conn.connects : 0, conn.connect_max_ms);
+	printf("heap: %u bytes, %u used by the client at start, peak use %u bytes, lowest free %u bytes\n",
+		(unsigned)port_heap_size(), (unsigned)heap_base, (unsigned)peak,
+		(unsigned)(port_heap_size() > peak ? port_heap_size() - peak : 0));
+	ESP_LOGI(TAG, "Done");
+	return ret;
+}
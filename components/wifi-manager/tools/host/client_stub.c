@@ -0,0 +1,104 @@
+/*
+ * Host build: the wifi manager and the flash log as seen by http_client.c and ota.c.
+ *
+ * The backend settings are those given to client_stub_init(), without authentication.
+ * The flash log goes to stderr whatever HOST_LOG_LEVEL is, it is what a device keeps.
+ * A reboot is not done, delayed_reboot() is reported to client_stub_wait_reboot().
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#include "manager.h"
+#include "flash.h"
+#include "client_stub.h"
+
+static const char TAG[] = "wifi_manager";
+
+static esp8266_config_t config = {0};
+static void (*callbacks[WM_MESSAGE_CODE_COUNT])(void*) = {NULL};
+
+static pthread_mutex_t reboot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reboot_requested = PTHREAD_COND_INITIALIZER;
+static bool reboot = false;
+
+void client_stub_init(const char* address, int port, const char* api, const char* esp_json_key){
+	config.server_address = (char*)address;
+	config.server_port = port;
+	config.server_api = (char*)api;
+	config.server_auth = "no";
+	config.esp_json_key = (char*)esp_json_key;
+}
+
+esp8266_config_t* wifi_manager_get_config(){
+	return &config;
+}
+
+void wifi_manager_set_callback(message_code_t message_code, void (*func_ptr)(void*) ){
+	if(message_code < WM_MESSAGE_CODE_COUNT){
+		callbacks[message_code] = func_ptr;
+	}
+}
+
+void client_stub_wifi_connected(void){
+	ESP_LOGI(TAG, "Connected to the access point");
+	if(callbacks[WM_ORDER_HTTP_CLIENT_INIT]){
+		callbacks[WM_ORDER_HTTP_CLIENT_INIT](NULL);
+	}
+}
+
+void delayed_reboot(const uint32_t tick){
+	ESP_LOGW(TAG, "Reboot requested in %u ms", tick);
+	pthread_mutex_lock(&reboot_lock);
+	reboot = true;
+	pthread_cond_broadcast(&reboot_requested);
+	pthread_mutex_unlock(&reboot_lock);
+}
+
+bool client_stub_wait_reboot(uint32_t ms){
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t ns = ts.tv_nsec + (uint64_t)ms * 1000000;
+	ts.tv_sec += ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	pthread_mutex_lock(&reboot_lock);
+	while(!reboot && pthread_cond_timedwait(&reboot_requested, &reboot_lock, &ts) == 0);
+	bool ret = reboot;
+	pthread_mutex_unlock(&reboot_lock);
+	return ret;
+}
+
+static void flash_log(char level, const char* format, va_list args){
+	fprintf(stderr, "%c (%u) flash: ", level, (unsigned)(esp_timer_get_time() / 1000));
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+}
+
+void FLASH_LOGE(const char* format, ...){
+	va_list args;
+	va_start(args, format);
+	flash_log('E', format, args);
+	va_end(args);
+}
+
+void FLASH_LOGW(const char* format, ...){
+	va_list args;
+	va_start(args, format);
+	flash_log('W', format, args);
+	va_end(args);
+}
+
+void FLASH_LOGI(const char* format, ...){
+	va_list args;
+	va_start(args, format);
+	flash_log('I', format, args);
+	va_end(args);
+}
@@ -0,0 +1,20 @@
+/* host build: set up of the wifi manager stand-in of http_client.c and ota.c */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief the backend settings, as saved by the web UI on the device.
+ */
+void client_stub_init(const char* address, int port, const char* api, const char* esp_json_key);
+
+/**
+ * @brief the station got its address: the callback http_client_initialize() registered runs.
+ */
+void client_stub_wifi_connected(void);
+
+/**
+ * @brief waits at most ms for delayed_reboot().
+ * @return true if a reboot was requested.
+ */
+bool client_stub_wait_reboot(uint32_t ms);
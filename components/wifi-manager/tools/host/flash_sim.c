@@ -0,0 +1,125 @@
+/*
+ * Host build: two OTA partitions of 960 KB in RAM, with the timing of a SPI flash.
+ *
+ * Erasing a sector takes HOST_FLASH_ERASE_US (45000 by default) and programming a page of
+ * 256 bytes HOST_FLASH_PAGE_US (700 by default), the typical figures of the 4 MB flash chips
+ * of ESP8266 modules. Only the calling thread waits: on the device the flash operations also
+ * hold the CPU, so what the download task does meanwhile is an upper bound here.
+ * Writes only clear bits, as on flash. The partitions are outside the counted heap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+
+#include "flash_sim.h"
+
+#define FLASH_PAGE_SIZE			256
+#define PARTITION_SIZE			0xF0000
+
+static const char TAG[] = "flash_sim";
+
+static const esp_partition_t partitions[2] = {
+	{ .address = 0x010000, .size = PARTITION_SIZE, .label = "ota_0" },
+	{ .address = 0x100000, .size = PARTITION_SIZE, .label = "ota_1" },
+};
+
+static uint8_t flash[2][PARTITION_SIZE];
+static const esp_partition_t* boot = &partitions[0];
+static flash_sim_stats_t stats = {0};
+static uint32_t erase_us = 45000;
+static uint32_t page_us = 700;
+
+void flash_sim_init(void){
+	const char* erase = getenv("HOST_FLASH_ERASE_US");
+	const char* page = getenv("HOST_FLASH_PAGE_US");
+	if(erase){
+		erase_us = strtoul(erase, NULL, 0);
+	}
+	if(page){
+		page_us = strtoul(page, NULL, 0);
+	}
+	/* the running firmware, a patch is applied to it */
+	memset(flash[0], 0xFF, PARTITION_SIZE);
+	flash[0][0] = 0xE9;
+	memset(flash[1], 0xFF, PARTITION_SIZE);
+}
+
+void flash_sim_get_stats(flash_sim_stats_t* out){
+	*out = stats;
+	out->boot = boot->label;
+}
+
+static uint8_t* partition_data(const esp_partition_t* partition, size_t offset, size_t size){
+	int index = partition - partitions;
+	if(index < 0 || index > 1 || offset + size > partition->size){
+		return NULL;
+	}
+	return flash[index] + offset;
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void){
+	return boot;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t *start_from){
+	return (boot == &partitions[0]) ? &partitions[1] : &partitions[0];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition){
+	uint8_t* data = partition_data(partition, 0, 1);
+	if(data == NULL){
+		return ESP_ERR_INVALID_ARG;
+	}
+	if(data[0] != 0xE9){
+		return ESP_ERR_OTA_VALIDATE_FAILED;
+	}
+	boot = partition;
+	ESP_LOGI(TAG, "Boot partition %s", partition->label);
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size){
+	uint8_t* data = partition_data(partition, src_offset, size);
+	if(data == NULL){
+		return ESP_ERR_INVALID_SIZE;
+	}
+	memcpy(dst, data, size);
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size){
+	uint8_t* data = partition_data(partition, dst_offset, size);
+	if(data == NULL){
+		return ESP_ERR_INVALID_SIZE;
+	}
+	const uint8_t* in = (const uint8_t*)src;
+	for(size_t i = 0; i < size; i++){
+		data[i] &= in[i];
+	}
+	if(size){
+		uint32_t pages = (dst_offset + size - 1) / FLASH_PAGE_SIZE - dst_offset / FLASH_PAGE_SIZE + 1;
+		stats.pages += pages;
+		stats.bytes += size;
+		stats.busy_us += pages * page_us;
+		usleep(pages * page_us);
+	}
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t start_addr, size_t size){
+	uint8_t* data = partition_data(partition, start_addr, size);
+	if(data == NULL || start_addr % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE){
+		ESP_LOGE(TAG, "Erase of 0x%zx bytes at 0x%zx rejected", size, start_addr);
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(data, 0xFF, size);
+	stats.sectors += size / SPI_FLASH_SEC_SIZE;
+	stats.busy_us += size / SPI_FLASH_SEC_SIZE * erase_us;
+	usleep(size / SPI_FLASH_SEC_SIZE * erase_us);
+	return ESP_OK;
+}
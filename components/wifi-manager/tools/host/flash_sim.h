@@ -0,0 +1,18 @@
+/* host build: set up and counters of the simulated flash */
+#pragma once
+#include <stdint.h>
+
+typedef struct {
+	uint32_t	sectors;	/* erased */
+	uint32_t	pages;		/* programmed */
+	uint32_t	bytes;		/* written */
+	uint64_t	busy_us;	/* spent erasing and programming */
+	const char*	boot;		/* label of the boot partition */
+}flash_sim_stats_t;
+
+/**
+ * @brief reads HOST_FLASH_ERASE_US and HOST_FLASH_PAGE_US, the running firmware is in ota_0.
+ */
+void flash_sim_init(void);
+
+void flash_sim_get_stats(flash_sim_stats_t* stats);
@@ -0,0 +1,498 @@
+/*
+ * Host build: the FreeRTOS services of http_client.c and ota.c over POSIX threads.
+ *
+ * Tasks are threads, priorities are ignored. The stack size given to xTaskCreate() and
+ * the storage of the queues are allocated from the counted heap (see port.c) while they
+ * exist, as the kernel of the device takes them from its heap. Timer callbacks run on
+ * one timer thread like on the timer task of the device. Waits use the monotonic clock.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#include <freertos/event_groups.h>
+
+static const char TAG[] = "freertos";
+
+typedef struct host_task {
+	pthread_t		thread;
+	TaskFunction_t	code;
+	void*			param;
+	void*			stack;			/* stands for the stack of the device, not used */
+	pthread_mutex_t	lock;
+	pthread_cond_t	notified;
+	uint32_t		notify;
+	char			name[16];
+}host_task_t;
+
+typedef struct host_queue {
+	pthread_mutex_t	lock;
+	pthread_cond_t	not_empty;
+	pthread_cond_t	not_full;
+	UBaseType_t		length;
+	UBaseType_t		item_size;		/* 0 for a semaphore */
+	UBaseType_t		count;
+	UBaseType_t		head;
+	uint8_t*		items;
+}host_queue_t;
+
+typedef struct host_event_group {
+	pthread_mutex_t	lock;
+	pthread_cond_t	changed;
+	EventBits_t		bits;
+}host_event_group_t;
+
+typedef struct host_timer {
+	struct host_timer*		next;
+	TickType_t				period;
+	bool					auto_reload;
+	bool					active;
+	TickType_t				expiry;
+	void*					id;
+	TimerCallbackFunction_t	callback;
+}host_timer_t;
+
+static __thread host_task_t* current_task = NULL;
+
+static pthread_mutex_t critical = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t timers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timers_changed;
+static pthread_once_t timers_once = PTHREAD_ONCE_INIT;
+static host_timer_t* timers = NULL;
+
+static void cond_init(pthread_cond_t* cond){
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/* @brief absolute time of a wait of ticks, false for portMAX_DELAY */
+static bool deadline(TickType_t ticks, struct timespec* ts){
+	if(ticks == portMAX_DELAY){
+		return false;
+	}
+	int64_t us = esp_timer_get_time() + (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+	ts->tv_sec = us / 1000000;
+	ts->tv_nsec = (us % 1000000) * 1000;
+	return true;
+}
+
+/* @brief waits on cond, false once the deadline passed */
+static bool cond_wait(pthread_cond_t* cond, pthread_mutex_t* lock, bool timed, const struct timespec* ts){
+	if(!timed){
+		pthread_cond_wait(cond, lock);
+		return true;
+	}
+	return pthread_cond_timedwait(cond, lock, ts) != ETIMEDOUT;
+}
+
+static void critical_init(void){
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&critical, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(void){
+	pthread_once(&critical_once, critical_init);
+	pthread_mutex_lock(&critical);
+}
+
+void vPortExitCritical(void){
+	pthread_mutex_unlock(&critical);
+}
+
+static void* task_main(void* arg){
+	host_task_t* task = (host_task_t*)arg;
+	current_task = task;
+	task->code(task->param);
+	/* a task must not return, as on the device */
+	ESP_LOGE(TAG, "Task %s returned", task->name);
+	vTaskDelete(NULL);
+	return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth,
+		void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pxCreatedTask){
+	host_task_t* task = (host_task_t*)calloc(1, sizeof(host_task_t));
+	if(task == NULL){
+		return pdFAIL;
+	}
+	task->stack = malloc(usStackDepth);
+	if(task->stack == NULL){
+		free(task);
+		return pdFAIL;
+	}
+	task->code = pvTaskCode;
+	task->param = pvParameters;
+	strncpy(task->name, pcName ? pcName : "", sizeof(task->name) - 1);
+	pthread_mutex_init(&task->lock, NULL);
+	cond_init(&task->notified);
+	if(pxCreatedTask){
+		*pxCreatedTask = task;
+	}
+	if(pthread_create(&task->thread, NULL, task_main, task) != 0){
+		free(task->stack);
+		free(task);
+		if(pxCreatedTask){
+			*pxCreatedTask = NULL;
+		}
+		return pdFAIL;
+	}
+	pthread_detach(task->thread);
+	return pdPASS;
+}
+
+static void task_free(host_task_t* task){
+	free(task->stack);
+	pthread_cond_destroy(&task->notified);
+	pthread_mutex_destroy(&task->lock);
+	free(task);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete){
+	host_task_t* task = (xTaskToDelete) ? (host_task_t*)xTaskToDelete : current_task;
+	if(task == NULL){
+		return;
+	}
+	if(task == current_task){
+		current_task = NULL;
+		task_free(task);
+		pthread_exit(NULL);
+	}
+	/* only http_client_destroy() deletes other tasks, they wait at a cancellation point */
+	pthread_cancel(task->thread);
+	task_free(task);
+}
+
+void vTaskDelay(TickType_t xTicksToDelay){
+	struct timespec ts = {
+		.tv_sec = xTicksToDelay * portTICK_PERIOD_MS / 1000,
+		.tv_nsec = (long)(xTicksToDelay * portTICK_PERIOD_MS % 1000) * 1000000,
+	};
+	while(clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify){
+	host_task_t* task = (host_task_t*)xTaskToNotify;
+	if(task == NULL){
+		return pdFAIL;
+	}
+	pthread_mutex_lock(&task->lock);
+	task->notify++;
+	pthread_cond_signal(&task->notified);
+	pthread_mutex_unlock(&task->lock);
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait){
+	host_task_t* task = current_task;
+	struct timespec ts;
+	bool timed = deadline(xTicksToWait, &ts);
+	uint32_t value;
+
+	if(task == NULL){
+		return 0;
+	}
+	pthread_mutex_lock(&task->lock);
+	while(task->notify == 0 && xTicksToWait && cond_wait(&task->notified, &task->lock, timed, &ts));
+	value = task->notify;
+	if(value){
+		task->notify = (xClearCountOnExit) ? 0 : value - 1;
+	}
+	pthread_mutex_unlock(&task->lock);
+	return value;
+}
+
+QueueHandle_t xQueueGenericCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, UBaseType_t uxInitialCount){
+	host_queue_t* queue = (host_queue_t*)calloc(1, sizeof(host_queue_t));
+	if(queue == NULL){
+		return NULL;
+	}
+	if(uxItemSize){
+		queue->items = (uint8_t*)malloc(uxQueueLength * uxItemSize);
+		if(queue->items == NULL){
+			free(queue);
+			return NULL;
+		}
+	}
+	queue->length = uxQueueLength;
+	queue->item_size = uxItemSize;
+	queue->count = uxInitialCount;
+	pthread_mutex_init(&queue->lock, NULL);
+	cond_init(&queue->not_empty);
+	cond_init(&queue->not_full);
+	return queue;
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait, BaseType_t xCopyPosition){
+	host_queue_t* queue = (host_queue_t*)xQueue;
+	struct timespec ts;
+	bool timed = deadline(xTicksToWait, &ts);
+	BaseType_t ret = errQUEUE_FULL;
+
+	pthread_mutex_lock(&queue->lock);
+	while(queue->count == queue->length && xTicksToWait && cond_wait(&queue->not_full, &queue->lock, timed, &ts));
+	if(queue->count < queue->length){
+		if(queue->item_size){
+			UBaseType_t slot;
+			if(xCopyPosition == queueSEND_TO_FRONT){
+				queue->head = (queue->head + queue->length - 1) % queue->length;
+				slot = queue->head;
+			}
+			else{
+				slot = (queue->head + queue->count) % queue->length;
+			}
+			memcpy(queue->items + slot * queue->item_size, pvItemToQueue, queue->item_size);
+		}
+		queue->count++;
+		pthread_cond_signal(&queue->not_empty);
+		ret = pdPASS;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait){
+	host_queue_t* queue = (host_queue_t*)xQueue;
+	struct timespec ts;
+	bool timed = deadline(xTicksToWait, &ts);
+	BaseType_t ret = pdFAIL;
+
+	pthread_mutex_lock(&queue->lock);
+	while(queue->count == 0 && xTicksToWait && cond_wait(&queue->not_empty, &queue->lock, timed, &ts));
+	if(queue->count){
+		if(queue->item_size){
+			memcpy(pvBuffer, queue->items + queue->head * queue->item_size, queue->item_size);
+			queue->head = (queue->head + 1) % queue->length;
+		}
+		queue->count--;
+		pthread_cond_signal(&queue->not_full);
+		ret = pdPASS;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return ret;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue){
+	host_queue_t* queue = (host_queue_t*)xQueue;
+	pthread_mutex_lock(&queue->lock);
+	UBaseType_t count = queue->count;
+	pthread_mutex_unlock(&queue->lock);
+	return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue){
+	host_queue_t* queue = (host_queue_t*)xQueue;
+	pthread_mutex_lock(&queue->lock);
+	UBaseType_t spaces = queue->length - queue->count;
+	pthread_mutex_unlock(&queue->lock);
+	return spaces;
+}
+
+void vQueueDelete(QueueHandle_t xQueue){
+	host_queue_t* queue = (host_queue_t*)xQueue;
+	if(queue == NULL){
+		return;
+	}
+	pthread_cond_destroy(&queue->not_empty);
+	pthread_cond_destroy(&queue->not_full);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->items);
+	free(queue);
+}
+
+EventGroupHandle_t xEventGroupCreate(void){
+	host_event_group_t* group = (host_event_group_t*)calloc(1, sizeof(host_event_group_t));
+	if(group){
+		pthread_mutex_init(&group->lock, NULL);
+		cond_init(&group->changed);
+	}
+	return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet){
+	host_event_group_t* group = (host_event_group_t*)xEventGroup;
+	pthread_mutex_lock(&group->lock);
+	group->bits |= uxBitsToSet;
+	EventBits_t bits = group->bits;
+	pthread_cond_broadcast(&group->changed);
+	pthread_mutex_unlock(&group->lock);
+	return bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear){
+	host_event_group_t* group = (host_event_group_t*)xEventGroup;
+	pthread_mutex_lock(&group->lock);
+	EventBits_t bits = group->bits;
+	group->bits &= ~uxBitsToClear;
+	pthread_mutex_unlock(&group->lock);
+	return bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup){
+	host_event_group_t* group = (host_event_group_t*)xEventGroup;
+	pthread_mutex_lock(&group->lock);
+	EventBits_t bits = group->bits;
+	pthread_mutex_unlock(&group->lock);
+	return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor,
+		const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits, TickType_t xTicksToWait){
+	host_event_group_t* group = (host_event_group_t*)xEventGroup;
+	struct timespec ts;
+	bool timed = deadline(xTicksToWait, &ts);
+	bool met;
+
+	pthread_mutex_lock(&group->lock);
+	for(;;){
+		EventBits_t set = group->bits & uxBitsToWaitFor;
+		met = (xWaitForAllBits) ? set == uxBitsToWaitFor : set != 0;
+		if(met || !xTicksToWait || !cond_wait(&group->changed, &group->lock, timed, &ts)){
+			break;
+		}
+	}
+	EventBits_t bits = group->bits;
+	if(met && xClearOnExit){
+		group->bits &= ~uxBitsToWaitFor;
+	}
+	pthread_mutex_unlock(&group->lock);
+	return bits;
+}
+
+void vEventGroupDelete(EventGroupHandle_t xEventGroup){
+	host_event_group_t* group = (host_event_group_t*)xEventGroup;
+	pthread_cond_destroy(&group->changed);
+	pthread_mutex_destroy(&group->lock);
+	free(group);
+}
+
+/* @brief the timer task: runs the callbacks of the expired timers in the order of their expiry */
+static void* timer_main(void* arg){
+	pthread_mutex_lock(&timers_lock);
+	for(;;){
+		host_timer_t* next = NULL;
+		TickType_t now = xTaskGetTickCount();
+		for(host_timer_t* timer = timers; timer; timer = timer->next){
+			if(timer->active && (next == NULL || (int32_t)(timer->expiry - next->expiry) < 0)){
+				next = timer;
+			}
+		}
+		if(next == NULL){
+			pthread_cond_wait(&timers_changed, &timers_lock);
+			continue;
+		}
+		if((int32_t)(next->expiry - now) > 0){
+			struct timespec ts;
+			deadline(next->expiry - now, &ts);
+			pthread_cond_timedwait(&timers_changed, &timers_lock, &ts);
+			continue;
+		}
+		if(next->auto_reload){
+			next->expiry += next->period;
+		}
+		else{
+			next->active = false;
+		}
+		/* the callback may change the timers */
+		pthread_mutex_unlock(&timers_lock);
+		next->callback(next);
+		pthread_mutex_lock(&timers_lock);
+	}
+	return NULL;
+}
+
+static void timers_init(void){
+	pthread_t thread;
+	cond_init(&timers_changed);
+	pthread_create(&thread, NULL, timer_main, NULL);
+	pthread_detach(thread);
+}
+
+TimerHandle_t xTimerCreate(const char* pcTimerName, TickType_t xTimerPeriod, UBaseType_t uxAutoReload,
+		void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction){
+	pthread_once(&timers_once, timers_init);
+	host_timer_t* timer = (host_timer_t*)calloc(1, sizeof(host_timer_t));
+	if(timer == NULL){
+		return NULL;
+	}
+	timer->period = xTimerPeriod;
+	timer->auto_reload = uxAutoReload;
+	timer->id = pvTimerID;
+	timer->callback = pxCallbackFunction;
+	pthread_mutex_lock(&timers_lock);
+	timer->next = timers;
+	timers = timer;
+	pthread_mutex_unlock(&timers_lock);
+	return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait){
+	host_timer_t* timer = (host_timer_t*)xTimer;
+	pthread_mutex_lock(&timers_lock);
+	timer->active = true;
+	timer->expiry = xTaskGetTickCount() + timer->period;
+	pthread_cond_signal(&timers_changed);
+	pthread_mutex_unlock(&timers_lock);
+	return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait){
+	return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait){
+	/* starts a dormant timer too */
+	((host_timer_t*)xTimer)->period = xNewPeriod;
+	return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait){
+	host_timer_t* timer = (host_timer_t*)xTimer;
+	pthread_mutex_lock(&timers_lock);
+	timer->active = false;
+	pthread_mutex_unlock(&timers_lock);
+	return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait){
+	host_timer_t* timer = (host_timer_t*)xTimer;
+	pthread_mutex_lock(&timers_lock);
+	for(host_timer_t** link = &timers; *link; link = &(*link)->next){
+		if(*link == timer){
+			*link = timer->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&timers_lock);
+	free(timer);
+	return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer){
+	host_timer_t* timer = (host_timer_t*)xTimer;
+	pthread_mutex_lock(&timers_lock);
+	BaseType_t active = timer->active;
+	pthread_mutex_unlock(&timers_lock);
+	return active;
+}
+
+void* pvTimerGetTimerID(TimerHandle_t xTimer){
+	return ((host_timer_t*)xTimer)->id;
+}
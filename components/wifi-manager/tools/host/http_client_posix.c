@@ -0,0 +1,597 @@
+/*
+ * Host build: esp_http_client over POSIX sockets, for http_client.c and ota.c.
+ *
+ * The events come in the order of esp_http_client: ON_CONNECTED for a new connection,
+ * HEADER_SENT, ON_HEADER per response header, ON_DATA per piece of the body, ON_FINISH,
+ * DISCONNECTED when the connection closes, ERROR when a request fails. The connection
+ * is kept alive unless the server closes it. The head and the body of a request are
+ * written separately, and the receive and send buffers have the default buffer_size,
+ * as on the device. TLS is not done, HTTP_TRANSPORT_OVER_SSL connects over plain TCP;
+ * basic authentication is not sent.
+ *
+ * HOST_LINK_KBPS (0, no limit, by default) limits the download of every connection to
+ * the rate of the radio. The link delivers into a receive window of HOST_LINK_WINDOW bytes
+ * (CONFIG_LWIP_TCP_WND_DEFAULT of the sdkconfig by default): while the application does
+ * not read, the window fills and the link stays idle, as the server cannot send more. This
+ * holds for a server which always has data to send, like a firmware download.
+ */
+#define _GNU_SOURCE		/* memmem */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_tls.h>
+#include <esp_http_client.h>
+
+static const char TAG[] = "esp_http_client";
+
+typedef struct http_header {
+	struct http_header*	next;
+	char*				key;
+	char*				value;
+}http_header_t;
+
+struct esp_http_client {
+	http_event_handle_cb		handler;
+	void*						user_data;
+	int							timeout_ms;
+	int							buffer_size;
+	char*						host;
+	int							port;
+	char*						path;			/* path and query of the url */
+	esp_http_client_method_t	method;
+	http_header_t*				headers;
+	const char*					post_data;
+	int							post_len;
+	int							fd;				/* -1 while not connected */
+	char*						request;		/* send buffer */
+	int							request_len;
+	char*						response;		/* receive buffer */
+	int							response_pos;
+	int							response_len;
+	/* the response */
+	int							status;
+	int							content_length;	/* -1 if not given */
+	bool						chunked;
+	bool						keep_alive;
+	bool						has_body;
+	int							left;			/* of the body or of the chunk */
+	int							received;
+	bool						complete;		/* the body was read to its end */
+	bool						finished;		/* ON_FINISH was dispatched */
+	/* the link model */
+	double						tokens;			/* bytes the link delivered to the window */
+	int64_t						link_time;
+};
+
+static pthread_once_t link_once = PTHREAD_ONCE_INIT;
+static double link_rate = 0;					/* bytes per microsecond, 0 for no limit */
+#ifdef CONFIG_LWIP_TCP_WND_DEFAULT
+static double link_window = CONFIG_LWIP_TCP_WND_DEFAULT;
+#else
+static double link_window = 5840;
+#endif
+
+static void link_init(void){
+	const char* kbps = getenv("HOST_LINK_KBPS");
+	const char* window = getenv("HOST_LINK_WINDOW");
+	if(kbps){
+		link_rate = atof(kbps) * 1000.0 / 8.0 / 1000000.0;
+	}
+	if(window){
+		link_window = atof(window);
+	}
+}
+
+static void dispatch(esp_http_client_handle_t client, esp_http_client_event_id_t id, void* data, int len,
+		char* key, char* value){
+	esp_http_client_event_t evt = {
+		.event_id = id,
+		.client = client,
+		.data = data,
+		.data_len = len,
+		.user_data = client->user_data,
+		.header_key = key,
+		.header_value = value,
+	};
+	if(client->handler){
+		client->handler(&evt);
+	}
+}
+
+esp_err_t esp_tls_get_and_clear_last_error(esp_tls_error_handle_t h, int *esp_tls_code, int *esp_tls_flags){
+	if(esp_tls_code){
+		*esp_tls_code = 0;
+	}
+	if(esp_tls_flags){
+		*esp_tls_flags = 0;
+	}
+	return ESP_OK;
+}
+
+static char* copy(const char* text){
+	size_t len = strlen(text);
+	char* str = (char*)malloc(len + 1);
+	if(str){
+		memcpy(str, text, len + 1);
+	}
+	return str;
+}
+
+static esp_err_t replace(char** dst, const char* text){
+	char* str = copy(text);
+	if(str == NULL){
+		return ESP_ERR_NO_MEM;
+	}
+	free(*dst);
+	*dst = str;
+	return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url){
+	const char* scheme = strstr(url, "://");
+	if(scheme == NULL){
+		/* a path, on the same server */
+		return replace(&client->path, url);
+	}
+	const char* host = scheme + 3;
+	const char* path = strchr(host, '/');
+	const char* port = memchr(host, ':', (path ? path : host + strlen(host)) - host);
+	const char* host_end = port ? port : (path ? path : host + strlen(host));
+	char* name = (char*)malloc(host_end - host + 1);
+	if(name == NULL){
+		return ESP_ERR_NO_MEM;
+	}
+	memcpy(name, host, host_end - host);
+	name[host_end - host] = '\0';
+	free(client->host);
+	client->host = name;
+	client->port = port ? atoi(port + 1) : (strncmp(url, "https", 5) == 0 ? 443 : 80);
+	return replace(&client->path, path ? path : "/");
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config){
+	pthread_once(&link_once, link_init);
+	esp_http_client_handle_t client = (esp_http_client_handle_t)calloc(1, sizeof(struct esp_http_client));
+	if(client == NULL){
+		return NULL;
+	}
+	client->handler = config->event_handler;
+	client->user_data = config->user_data;
+	client->timeout_ms = config->timeout_ms ? config->timeout_ms : 5000;
+	client->buffer_size = config->buffer_size ? config->buffer_size : DEFAULT_HTTP_BUF_SIZE;
+	client->method = config->method;
+	client->fd = -1;
+	client->port = config->port ? config->port : (config->transport_type == HTTP_TRANSPORT_OVER_SSL ? 443 : 80);
+	client->request = (char*)malloc(client->buffer_size);
+	client->response = (char*)malloc(client->buffer_size + 1);
+	bool ok = client->request && client->response;
+	if(ok && config->host){
+		ok = replace(&client->host, config->host) == ESP_OK;
+	}
+	if(ok && config->url){
+		ok = esp_http_client_set_url(client, config->url) == ESP_OK;
+	}
+	else if(ok){
+		ok = replace(&client->path, config->path ? config->path : "/") == ESP_OK;
+	}
+	if(!ok || client->host == NULL){
+		ESP_LOGE(TAG, "Invalid configuration");
+		esp_http_client_cleanup(client);
+		return NULL;
+	}
+	return client;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method){
+	client->method = method;
+	return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len){
+	client->post_data = data;
+	client->post_len = (data) ? len : 0;
+	return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value){
+	http_header_t* header;
+	for(header = client->headers; header; header = header->next){
+		if(strcasecmp(header->key, key) == 0){
+			return replace(&header->value, value);
+		}
+	}
+	header = (http_header_t*)calloc(1, sizeof(http_header_t));
+	if(header == NULL || (header->key = copy(key)) == NULL || (header->value = copy(value)) == NULL){
+		if(header){
+			free(header->key);
+			free(header);
+		}
+		return ESP_ERR_NO_MEM;
+	}
+	header->next = client->headers;
+	client->headers = header;
+	return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key){
+	for(http_header_t** link = &client->headers; *link; link = &(*link)->next){
+		http_header_t* header = *link;
+		if(strcasecmp(header->key, key) == 0){
+			*link = header->next;
+			free(header->key);
+			free(header->value);
+			free(header);
+			break;
+		}
+	}
+	return ESP_OK;
+}
+
+static esp_err_t tcp_connect(esp_http_client_handle_t client){
+	struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo* addr;
+	char port[8];
+	struct timeval tv = {
+		.tv_sec = client->timeout_ms / 1000,
+		.tv_usec = (client->timeout_ms % 1000) * 1000,
+	};
+
+	snprintf(port, sizeof(port), "%d", client->port);
+	if(getaddrinfo(client->host, port, &hints, &addr) != 0){
+		ESP_LOGE(TAG, "Unknown host %s", client->host);
+		return ESP_ERR_HTTP_CONNECT;
+	}
+	int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if(fd >= 0){
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		if(connect(fd, addr->ai_addr, addr->ai_addrlen) != 0){
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addr);
+	if(fd < 0){
+		ESP_LOGE(TAG, "Connection to %s:%d failed: %s", client->host, client->port, strerror(errno));
+		return ESP_ERR_HTTP_CONNECT;
+	}
+	client->fd = fd;
+	client->tokens = 0;
+	client->link_time = esp_timer_get_time();
+	return ESP_OK;
+}
+
+/* @brief recv() behind the link model */
+static int link_recv(esp_http_client_handle_t client, char* buf, int len){
+	if(link_rate > 0){
+		int64_t now = esp_timer_get_time();
+		client->tokens += (now - client->link_time) * link_rate;
+		if(client->tokens > link_window){
+			client->tokens = link_window;
+		}
+		client->link_time = now;
+		if(client->tokens < 1){
+			/* until a segment, or what is asked for, has come */
+			int want = (len < 1460) ? len : 1460;
+			usleep((useconds_t)((want - client->tokens) / link_rate));
+			now = esp_timer_get_time();
+			client->tokens += (now - client->link_time) * link_rate;
+			client->link_time = now;
+		}
+		if(len > (int)client->tokens){
+			len = (int)client->tokens;
+		}
+	}
+	int n = recv(client->fd, buf, len, 0);
+	if(n > 0 && link_rate > 0){
+		client->tokens -= n;
+	}
+	return n;
+}
+
+static bool tcp_send(esp_http_client_handle_t client, const char* data, int len){
+	while(len > 0){
+		int n = send(client->fd, data, len, MSG_NOSIGNAL);
+		if(n <= 0){
+			return false;
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+/* @brief appends to the send buffer, sent whenever it is full */
+static bool request_append(esp_http_client_handle_t client, const char* text){
+	int len = strlen(text);
+	while(len > 0){
+		int piece = client->buffer_size - client->request_len;
+		if(piece > len){
+			piece = len;
+		}
+		memcpy(client->request + client->request_len, text, piece);
+		client->request_len += piece;
+		text += piece;
+		len -= piece;
+		if(client->request_len == client->buffer_size){
+			if(!tcp_send(client, client->request, client->request_len)){
+				return false;
+			}
+			client->request_len = 0;
+		}
+	}
+	return true;
+}
+
+static bool request_header(esp_http_client_handle_t client, const char* key, const char* value){
+	return request_append(client, key) && request_append(client, ": ") && request_append(client, value) &&
+		request_append(client, "\r\n");
+}
+
+static const char* method_name(esp_http_client_method_t method){
+	static const char* names[HTTP_METHOD_MAX] = {"GET", "POST", "PUT", "PATCH", "DELETE", "HEAD"};
+	return (method < HTTP_METHOD_MAX) ? names[method] : "GET";
+}
+
+/* @brief closes the connection after a failure of the request */
+static esp_err_t request_failed(esp_http_client_handle_t client, esp_err_t err){
+	client->status = 0;
+	dispatch(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+	esp_http_client_close(client);
+	return err;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len){
+	char length[12];
+	bool ok;
+
+	if(client->fd < 0){
+		esp_err_t err = tcp_connect(client);
+		if(err != ESP_OK){
+			dispatch(client, HTTP_EVENT_ERROR, NULL, 0, NULL, NULL);
+			return err;
+		}
+		dispatch(client, HTTP_EVENT_ON_CONNECTED, NULL, 0, NULL, NULL);
+	}
+	client->status = 0;
+	client->content_length = -1;
+	client->chunked = false;
+	client->keep_alive = true;
+	client->received = 0;
+	client->complete = false;
+	client->finished = false;
+	client->response_pos = client->response_len = 0;
+
+	snprintf(length, sizeof(length), "%d", write_len);
+	client->request_len = 0;
+	ok = request_append(client, method_name(client->method)) && request_append(client, " ") &&
+		request_append(client, client->path) && request_append(client, " HTTP/1.1\r\n") &&
+		request_header(client, "User-Agent", "ESP32 HTTP Client/1.0") &&
+		request_header(client, "Host", client->host);
+	for(http_header_t* header = client->headers; header && ok; header = header->next){
+		ok = request_header(client, header->key, header->value);
+	}
+	ok = ok && request_header(client, "Content-Length", length) && request_append(client, "\r\n") &&
+		tcp_send(client, client->request, client->request_len);
+	client->request_len = 0;
+	if(!ok){
+		ESP_LOGE(TAG, "Failed to send the request: %s", strerror(errno));
+		return request_failed(client, ESP_ERR_HTTP_WRITE_DATA);
+	}
+	dispatch(client, HTTP_EVENT_HEADER_SENT, NULL, 0, NULL, NULL);
+	return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len){
+	return tcp_send(client, buffer, len) ? len : -1;
+}
+
+/* @brief the next line of the head into the receive buffer, without its CRLF, NULL on failure */
+static char* read_line(esp_http_client_handle_t client){
+	for(;;){
+		char* start = client->response + client->response_pos;
+		char* end = memmem(start, client->response_len - client->response_pos, "\r\n", 2);
+		if(end){
+			*end = '\0';
+			client->response_pos = end + 2 - client->response;
+			return start;
+		}
+		/* keep the partial line at the start of the buffer */
+		client->response_len -= client->response_pos;
+		memmove(client->response, start, client->response_len);
+		client->response_pos = 0;
+		if(client->response_len == client->buffer_size){
+			ESP_LOGE(TAG, "Response header longer than %d bytes", client->buffer_size);
+			return NULL;
+		}
+		int n = link_recv(client, client->response + client->response_len, client->buffer_size - client->response_len);
+		if(n <= 0){
+			return NULL;
+		}
+		client->response_len += n;
+	}
+}
+
+int esp_http_client_fetch_headers(esp_http_client_handle_t client){
+	char* line = read_line(client);
+	if(line == NULL || strncmp(line, "HTTP/1.", 7) != 0 || strlen(line) < 12){
+		request_failed(client, ESP_ERR_HTTP_FETCH_HEADER);
+		return -1;
+	}
+	client->keep_alive = (line[7] == '1');
+	client->status = atoi(line + 9);
+	while((line = read_line(client)) != NULL && *line){
+		char* value = strchr(line, ':');
+		if(value == NULL){
+			continue;
+		}
+		*value++ = '\0';
+		while(*value == ' '){
+			value++;
+		}
+		if(strcasecmp(line, "Content-Length") == 0){
+			client->content_length = atoi(value);
+		}
+		else if(strcasecmp(line, "Transfer-Encoding") == 0 && strcasecmp(value, "chunked") == 0){
+			client->chunked = true;
+		}
+		else if(strcasecmp(line, "Connection") == 0){
+			client->keep_alive = (strcasecmp(value, "close") != 0);
+		}
+		dispatch(client, HTTP_EVENT_ON_HEADER, NULL, 0, line, value);
+	}
+	if(line == NULL){
+		request_failed(client, ESP_ERR_HTTP_FETCH_HEADER);
+		return -1;
+	}
+	client->has_body = !(client->method == HTTP_METHOD_HEAD || client->status / 100 == 1 ||
+		client->status == 204 || client->status == 304 || client->content_length == 0);
+	client->left = (client->chunked) ? 0 : client->content_length;
+	if(client->chunked){
+		client->content_length = -1;
+	}
+	return client->content_length;
+}
+
+/* @brief body bytes from the receive buffer, then from the socket */
+static int body_recv(esp_http_client_handle_t client, char* buf, int len){
+	int buffered = client->response_len - client->response_pos;
+	if(buffered > 0){
+		int n = (len < buffered) ? len : buffered;
+		memcpy(buf, client->response + client->response_pos, n);
+		client->response_pos += n;
+		return n;
+	}
+	return link_recv(client, buf, len);
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len){
+	int n = 0;
+
+	if(client->has_body && !client->complete){
+		if(client->chunked && client->left == 0){
+			/* the CRLF of the previous chunk, then the size of the next one */
+			char* line = read_line(client);
+			if(line && *line == '\0' && client->received){
+				line = read_line(client);
+			}
+			if(line == NULL){
+				return -1;
+			}
+			client->left = strtol(line, NULL, 16);
+			if(client->left == 0){
+				while((line = read_line(client)) != NULL && *line);
+				client->complete = true;
+			}
+		}
+		if(!client->complete){
+			int want = (client->left >= 0 && client->left < len) ? client->left : len;
+			n = body_recv(client, buffer, want);
+			if(n < 0 || (n == 0 && client->left >= 0)){
+				/* closed or timed out before the end */
+				return -1;
+			}
+			if(n == 0){
+				/* a body delimited by the end of the connection */
+				client->keep_alive = false;
+				client->complete = true;
+			}
+			client->received += n;
+			if(client->left >= 0){
+				client->left -= n;
+				client->complete = (client->left == 0 && !client->chunked);
+			}
+		}
+	}
+	else{
+		client->complete = true;
+	}
+	if(n > 0){
+		dispatch(client, HTTP_EVENT_ON_DATA, buffer, n, NULL, NULL);
+	}
+	if(client->complete && !client->finished && n == 0){
+		client->finished = true;
+		dispatch(client, HTTP_EVENT_ON_FINISH, NULL, 0, NULL, NULL);
+	}
+	return n;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client){
+	char buffer[DEFAULT_HTTP_BUF_SIZE];
+	esp_err_t err = esp_http_client_open(client, client->post_len);
+	if(err != ESP_OK){
+		return err;
+	}
+	if(client->post_len && esp_http_client_write(client, client->post_data, client->post_len) < 0){
+		return request_failed(client, ESP_ERR_HTTP_WRITE_DATA);
+	}
+	if(esp_http_client_fetch_headers(client) < 0 && client->status == 0){
+		return ESP_ERR_HTTP_FETCH_HEADER;
+	}
+	int n;
+	while((n = esp_http_client_read(client, buffer, sizeof(buffer))) > 0);
+	if(n < 0){
+		ESP_LOGE(TAG, "Response body interrupted");
+		return request_failed(client, ESP_FAIL);
+	}
+	if(!client->keep_alive){
+		esp_http_client_close(client);
+	}
+	return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client){
+	return client->status;
+}
+
+int esp_http_client_get_content_length(esp_http_client_handle_t client){
+	return client->content_length;
+}
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client){
+	return client->chunked;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client){
+	return client->complete;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client){
+	if(client->fd >= 0){
+		close(client->fd);
+		client->fd = -1;
+		dispatch(client, HTTP_EVENT_DISCONNECTED, NULL, 0, NULL, NULL);
+	}
+	return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client){
+	if(client == NULL){
+		return ESP_FAIL;
+	}
+	esp_http_client_close(client);
+	while(client->headers){
+		esp_http_client_delete_header(client, client->headers->key);
+	}
+	free(client->host);
+	free(client->path);
+	free(client->request);
+	free(client->response);
+	free(client);
+	return ESP_OK;
+}
@@ -0,0 +1,558 @@
+/*
+ * esp_http_server over POSIX sockets, for the host build of http_app.c.
+ *
+ * Follows the model of the ESP-IDF server: a single task serves the sessions one
+ * request at a time, up to max_open_sockets sessions. With lru_purge_enable the least
+ * recently used session is closed for a new client, otherwise the new client is closed.
+ * URIs are matched exactly, without their query. A handler returning an error closes
+ * its session. Session buffers are allocated like on the device, so they count in the
+ * heap figures of port.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <esp_log.h>
+#include <esp_http_server.h>
+
+static const char TAG[] = "httpd";
+
+uint16_t httpd_host_port = 0;
+
+typedef struct {
+	int			fd;
+	uint32_t	lru;		/* last request, 0 for a free slot */
+	char*		buf;		/* request header, then the start of the body */
+	size_t		len;
+} httpd_sess_t;
+
+/**
+ * @brief state of the request being served, req->aux.
+ */
+typedef struct {
+	httpd_sess_t*	sess;
+	const char*		headers;		/* header lines, zero terminated */
+	size_t			header_len;		/* bytes of the buffer taken by the request line and header */
+	size_t			body_offset;	/* next body byte in the buffer */
+	size_t			remaining;		/* body bytes not read by the handler */
+	const char*		status;
+	const char*		type;
+	const char*		hdr_field[16];
+	const char*		hdr_value[16];
+	int				hdr_count;
+	bool			chunked;
+	bool			close;
+} httpd_req_aux_t;
+
+typedef struct {
+	httpd_config_t	config;
+	int				listen_fd;
+	int				ctrl[2];		/* wakes the server task up to stop */
+	httpd_sess_t*	sessions;
+	httpd_uri_t*	uris;
+	int				uri_count;
+	uint32_t		lru_counter;
+	httpd_req_t*	req;			/* the request being served, allocated once as in ESP-IDF */
+	httpd_req_aux_t* aux;
+	pthread_t		task;
+} httpd_data_t;
+
+static int httpd_send_all(int fd, const char* buf, size_t len){
+	while(len > 0){
+		ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+		if(n < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return HTTPD_SOCK_ERR_FAIL;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void httpd_sess_close(httpd_sess_t* sess){
+	close(sess->fd);
+	free(sess->buf);
+	memset(sess, 0x00, sizeof(httpd_sess_t));
+	sess->fd = -1;
+}
+
+static void httpd_accept_conn(httpd_data_t* hd){
+	httpd_sess_t* free_sess = NULL;
+	httpd_sess_t* lru_sess = NULL;
+	for(int i = 0; i < hd->config.max_open_sockets; i++){
+		httpd_sess_t* s = &hd->sessions[i];
+		if(s->fd < 0){
+			free_sess = free_sess ? free_sess : s;
+		}
+		else if(lru_sess == NULL || s->lru < lru_sess->lru){
+			lru_sess = s;
+		}
+	}
+	if(free_sess == NULL && hd->config.lru_purge_enable){
+		/* the new client is accepted on the next turn of the loop */
+		ESP_LOGD(TAG, "Purging session %d", lru_sess->fd);
+		httpd_sess_close(lru_sess);
+		return;
+	}
+
+	int fd = accept(hd->listen_fd, NULL, NULL);
+	if(fd < 0){
+		return;
+	}
+	if(free_sess == NULL){
+		ESP_LOGW(TAG, "No free session, closing the new client");
+		close(fd);
+		return;
+	}
+	struct timeval tv = { .tv_sec = hd->config.recv_wait_timeout };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	tv.tv_sec = hd->config.send_wait_timeout;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	free_sess->buf = malloc(HTTPD_MAX_REQ_HDR_LEN + 1);
+	if(free_sess->buf == NULL){
+		close(fd);
+		return;
+	}
+	free_sess->fd = fd;
+	free_sess->len = 0;
+	free_sess->lru = ++hd->lru_counter;
+}
+
+static esp_err_t httpd_send_err(httpd_req_t *r, const char* status, const char* msg){
+	httpd_resp_set_status(r, status);
+	httpd_resp_set_type(r, "text/html");
+	return httpd_resp_send(r, msg, HTTPD_RESP_USE_STRLEN);
+}
+
+static int httpd_parse_method(const char* m, size_t len){
+	static const char* methods[] = { "DELETE", "GET", "HEAD", "POST", "PUT" };
+	for(int i = 0; i < (int)(sizeof(methods) / sizeof(methods[0])); i++){
+		if(strlen(methods[i]) == len && strncmp(methods[i], m, len) == 0){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief reads and serves one request of the session.
+ * @return false if the session must be closed.
+ */
+static bool httpd_serve_request(httpd_data_t* hd, httpd_sess_t* sess){
+	char* end;
+	/* the header, a previous request may have left its start in the buffer */
+	while((sess->buf[sess->len] = '\0', end = strstr(sess->buf, "\r\n\r\n")) == NULL){
+		if(sess->len == HTTPD_MAX_REQ_HDR_LEN){
+			httpd_req_t r = { .handle = hd };
+			httpd_req_aux_t aux = { .sess = sess };
+			r.aux = &aux;
+			httpd_send_err(&r, "431 Request Header Fields Too Large", "Header fields are too long");
+			return false;
+		}
+		ssize_t n = recv(sess->fd, sess->buf + sess->len, HTTPD_MAX_REQ_HDR_LEN - sess->len, 0);
+		if(n <= 0){
+			return false;
+		}
+		sess->len += n;
+	}
+	sess->lru = ++hd->lru_counter;
+
+	httpd_req_t* r = hd->req;
+	httpd_req_aux_t* aux = hd->aux;
+	memset(r, 0x00, sizeof(httpd_req_t));
+	memset(aux, 0x00, sizeof(httpd_req_aux_t));
+	r->handle = hd;
+	r->aux = aux;
+	aux->sess = sess;
+	aux->header_len = end + 4 - sess->buf;
+	end[2] = '\0';
+
+	/* request line */
+	char* line_end = strstr(sess->buf, "\r\n");
+	char* sp1 = memchr(sess->buf, ' ', line_end - sess->buf);
+	char* sp2 = sp1 ? memchr(sp1 + 1, ' ', line_end - sp1 - 1) : NULL;
+	bool keep_alive = false;
+	bool served = false;
+	if(sp1 && sp2 && (size_t)(sp2 - sp1 - 1) <= HTTPD_MAX_URI_LEN){
+		r->method = httpd_parse_method(sess->buf, sp1 - sess->buf);
+		memcpy((char*)r->uri, sp1 + 1, sp2 - sp1 - 1);
+		keep_alive = (strncmp(sp2 + 1, "HTTP/1.1", 8) == 0);
+		aux->headers = line_end + 2;
+
+		char value[16];
+		if(httpd_req_get_hdr_value_str(r, "Content-Length", value, sizeof(value)) == ESP_OK){
+			r->content_len = strtoul(value, NULL, 10);
+		}
+		if(httpd_req_get_hdr_value_str(r, "Connection", value, sizeof(value)) == ESP_OK){
+			keep_alive = (strcasecmp(value, "keep-alive") == 0) || (keep_alive && strcasecmp(value, "close") != 0);
+		}
+		aux->remaining = r->content_len;
+		aux->body_offset = aux->header_len;
+
+		size_t path_len = strcspn(r->uri, "?");
+		const httpd_uri_t* handler = NULL;
+		bool uri_found = false;
+		for(int i = 0; i < hd->uri_count && handler == NULL; i++){
+			const httpd_uri_t* u = &hd->uris[i];
+			if(strlen(u->uri) == path_len && strncmp(u->uri, r->uri, path_len) == 0){
+				uri_found = true;
+				handler = ((int)u->method == r->method) ? u : NULL;
+			}
+		}
+		if(handler){
+			r->user_ctx = handler->user_ctx;
+			served = (handler->handler(r) == ESP_OK);
+		}
+		else if(uri_found){
+			served = (httpd_send_err(r, "405 Method Not Allowed", "Request method for this URI is not handled by server") == ESP_OK);
+		}
+		else{
+			served = (httpd_send_err(r, "404 Not Found", "Nothing matches the given URI") == ESP_OK);
+		}
+	}
+	else{
+		httpd_send_err(r, "400 Bad Request", "Bad request syntax");
+	}
+
+	/* the body the handler did not read is dropped */
+	char discard[256];
+	while(served && aux->remaining > 0){
+		if(httpd_req_recv(r, discard, sizeof(discard)) <= 0){
+			served = false;
+		}
+	}
+	/* keep a pipelined request */
+	if(served && aux->body_offset < sess->len){
+		memmove(sess->buf, sess->buf + aux->body_offset, sess->len - aux->body_offset);
+		sess->len -= aux->body_offset;
+	}
+	else{
+		sess->len = 0;
+	}
+	return served && keep_alive && !aux->close;
+}
+
+static void* httpd_server(void* arg){
+	httpd_data_t* hd = (httpd_data_t*)arg;
+	for(;;){
+		fd_set read_set;
+		FD_ZERO(&read_set);
+		FD_SET(hd->listen_fd, &read_set);
+		FD_SET(hd->ctrl[0], &read_set);
+		int max_fd = MAX(hd->listen_fd, hd->ctrl[0]);
+		for(int i = 0; i < hd->config.max_open_sockets; i++){
+			if(hd->sessions[i].fd >= 0){
+				FD_SET(hd->sessions[i].fd, &read_set);
+				max_fd = MAX(max_fd, hd->sessions[i].fd);
+			}
+		}
+		if(select(max_fd + 1, &read_set, NULL, NULL, NULL) < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			ESP_LOGE(TAG, "select: %s", strerror(errno));
+			break;
+		}
+		if(FD_ISSET(hd->ctrl[0], &read_set)){
+			break;
+		}
+		for(int i = 0; i < hd->config.max_open_sockets; i++){
+			httpd_sess_t* s = &hd->sessions[i];
+			if(s->fd >= 0 && FD_ISSET(s->fd, &read_set)){
+				/* serve the pipelined requests already received too */
+				bool keep;
+				do{
+					keep = httpd_serve_request(hd, s);
+				}while(keep && s->len > 0);
+				if(!keep){
+					httpd_sess_close(s);
+				}
+			}
+		}
+		if(FD_ISSET(hd->listen_fd, &read_set)){
+			httpd_accept_conn(hd);
+		}
+	}
+	return NULL;
+}
+
+static void httpd_free(httpd_data_t* hd){
+	free(hd->sessions);
+	free(hd->uris);
+	free(hd->req);
+	free(hd->aux);
+	free(hd);
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config){
+	httpd_data_t* hd = calloc(1, sizeof(httpd_data_t));
+	if(hd == NULL){
+		return ESP_ERR_NO_MEM;
+	}
+	hd->config = *config;
+	hd->sessions = calloc(config->max_open_sockets, sizeof(httpd_sess_t));
+	hd->uris = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+	hd->req = calloc(1, sizeof(httpd_req_t));
+	hd->aux = calloc(1, sizeof(httpd_req_aux_t));
+	if(hd->sessions == NULL || hd->uris == NULL || hd->req == NULL || hd->aux == NULL){
+		httpd_free(hd);
+		return ESP_ERR_NO_MEM;
+	}
+	for(int i = 0; i < config->max_open_sockets; i++){
+		hd->sessions[i].fd = -1;
+	}
+
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(httpd_host_port ? httpd_host_port : config->server_port),
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+	};
+	int one = 1;
+	hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if(hd->listen_fd < 0 || bind(hd->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+			listen(hd->listen_fd, config->backlog_conn) != 0 || pipe(hd->ctrl) != 0){
+		ESP_LOGE(TAG, "Cannot listen on port %d: %s", ntohs(addr.sin_port), strerror(errno));
+		if(hd->listen_fd >= 0){
+			close(hd->listen_fd);
+		}
+		httpd_free(hd);
+		return ESP_FAIL;
+	}
+	ESP_LOGI(TAG, "Listening on port %d", ntohs(addr.sin_port));
+
+	pthread_create(&hd->task, NULL, httpd_server, hd);
+	*handle = hd;
+	return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle){
+	httpd_data_t* hd = (httpd_data_t*)handle;
+	if(hd == NULL){
+		return ESP_ERR_INVALID_ARG;
+	}
+	if(write(hd->ctrl[1], "", 1) != 1){
+		return ESP_FAIL;
+	}
+	pthread_join(hd->task, NULL);
+	for(int i = 0; i < hd->config.max_open_sockets; i++){
+		if(hd->sessions[i].fd >= 0){
+			httpd_sess_close(&hd->sessions[i]);
+		}
+	}
+	close(hd->listen_fd);
+	close(hd->ctrl[0]);
+	close(hd->ctrl[1]);
+	httpd_free(hd);
+	return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler){
+	httpd_data_t* hd = (httpd_data_t*)handle;
+	if(hd->uri_count == hd->config.max_uri_handlers){
+		ESP_LOGE(TAG, "No slot left for %s", uri_handler->uri);
+		return ESP_ERR_NO_MEM;
+	}
+	hd->uris[hd->uri_count++] = *uri_handler;
+	return ESP_OK;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len){
+	httpd_req_aux_t* aux = (httpd_req_aux_t*)r->aux;
+	httpd_sess_t* sess = aux->sess;
+	size_t len = MIN(buf_len, aux->remaining);
+	if(len == 0){
+		return 0;
+	}
+	if(aux->body_offset < sess->len){
+		/* body received with the header */
+		len = MIN(len, sess->len - aux->body_offset);
+		memcpy(buf, sess->buf + aux->body_offset, len);
+		aux->body_offset += len;
+		aux->remaining -= len;
+		return len;
+	}
+	ssize_t n = recv(sess->fd, buf, len, 0);
+	if(n < 0){
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+	}
+	if(n == 0){
+		return HTTPD_SOCK_ERR_FAIL;
+	}
+	aux->remaining -= n;
+	/* nothing of the next request is in the buffer */
+	aux->body_offset = sess->len;
+	return n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r){
+	return ((httpd_req_aux_t*)r->aux)->sess->fd;
+}
+
+/**
+ * @brief finds the value of a header field.
+ * @return the start of the value, NULL if the field is absent; len is set to its length.
+ */
+static const char* httpd_find_hdr(httpd_req_t *r, const char *field, size_t* len){
+	httpd_req_aux_t* aux = (httpd_req_aux_t*)r->aux;
+	size_t field_len = strlen(field);
+	const char* line = aux->headers;
+	while(line && *line){
+		const char* eol = strstr(line, "\r\n");
+		if(eol == NULL){
+			eol = line + strlen(line);
+		}
+		if((size_t)(eol - line) > field_len && line[field_len] == ':' && strncasecmp(line, field, field_len) == 0){
+			const char* value = line + field_len + 1;
+			while(value < eol && (*value == ' ' || *value == '\t')){
+				value++;
+			}
+			*len = eol - value;
+			return value;
+		}
+		line = (*eol) ? eol + 2 : NULL;
+	}
+	return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field){
+	size_t len = 0;
+	return httpd_find_hdr(r, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size){
+	size_t len = 0;
+	const char* value = httpd_find_hdr(r, field, &len);
+	if(value == NULL){
+		return ESP_ERR_NOT_FOUND;
+	}
+	size_t n = MIN(len, val_size - 1);
+	memcpy(val, value, n);
+	val[n] = '\0';
+	return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len){
+	const char* query = strchr(r->uri, '?');
+	if(query == NULL){
+		return ESP_ERR_NOT_FOUND;
+	}
+	query++;
+	size_t len = strlen(query);
+	size_t n = MIN(len, buf_len - 1);
+	memcpy(buf, query, n);
+	buf[n] = '\0';
+	return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size){
+	size_t key_len = strlen(key);
+	const char* p = qry;
+	while(p && *p){
+		const char* next = strchr(p, '&');
+		size_t pair_len = next ? (size_t)(next - p) : strlen(p);
+		if(pair_len > key_len && p[key_len] == '=' && strncmp(p, key, key_len) == 0){
+			size_t len = pair_len - key_len - 1;
+			size_t n = MIN(len, val_size - 1);
+			memcpy(val, p + key_len + 1, n);
+			val[n] = '\0';
+			return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+		}
+		p = next ? next + 1 : NULL;
+	}
+	return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status){
+	((httpd_req_aux_t*)r->aux)->status = status;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type){
+	((httpd_req_aux_t*)r->aux)->type = type;
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value){
+	httpd_req_aux_t* aux = (httpd_req_aux_t*)r->aux;
+	httpd_data_t* hd = (httpd_data_t*)r->handle;
+	if(aux->hdr_count == MIN(hd->config.max_resp_headers, 16)){
+		return ESP_ERR_NO_MEM;
+	}
+	aux->hdr_field[aux->hdr_count] = field;
+	aux->hdr_value[aux->hdr_count] = value;
+	aux->hdr_count++;
+	return ESP_OK;
+}
+
+static esp_err_t httpd_send_hdr(httpd_req_t *r, const char* length_hdr){
+	httpd_req_aux_t* aux = (httpd_req_aux_t*)r->aux;
+	char hdr[512];
+	int len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s\r\n",
+		aux->status ? aux->status : "200 OK", aux->type ? aux->type : "text/html", length_hdr);
+	for(int i = 0; i < aux->hdr_count && len < (int)sizeof(hdr); i++){
+		len += snprintf(hdr + len, sizeof(hdr) - len, "%s: %s\r\n", aux->hdr_field[i], aux->hdr_value[i]);
+	}
+	if(len + 2 >= (int)sizeof(hdr)){
+		return ESP_ERR_INVALID_SIZE;
+	}
+	memcpy(hdr + len, "\r\n", 2);
+	return (httpd_send_all(aux->sess->fd, hdr, len + 2) == 0) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len){
+	httpd_req_aux_t* aux = (httpd_req_aux_t*)r->aux;
+	if(buf_len == HTTPD_RESP_USE_STRLEN){
+		buf_len = buf ? strlen(buf) : 0;
+	}
+	char length_hdr[32];
+	snprintf(length_hdr, sizeof(length_hdr), "Content-Length: %d", (int)buf_len);
+	esp_err_t ret = httpd_send_hdr(r, length_hdr);
+	if(ret == ESP_OK && buf_len > 0 && httpd_send_all(aux->sess->fd, buf, buf_len) != 0){
+		ret = ESP_FAIL;
+	}
+	return ret;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len){
+	httpd_req_aux_t* aux = (httpd_req_aux_t*)r->aux;
+	if(buf_len == HTTPD_RESP_USE_STRLEN){
+		buf_len = buf ? strlen(buf) : 0;
+	}
+	if(!aux->chunked){
+		aux->chunked = true;
+		if(httpd_send_hdr(r, "Transfer-Encoding: chunked") != ESP_OK){
+			return ESP_FAIL;
+		}
+	}
+	char size[16];
+	int len = snprintf(size, sizeof(size), "%x\r\n", (unsigned)buf_len);
+	if(httpd_send_all(aux->sess->fd, size, len) != 0 ||
+			(buf_len > 0 && httpd_send_all(aux->sess->fd, buf, buf_len) != 0) ||
+			httpd_send_all(aux->sess->fd, "\r\n", 2) != 0){
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t *r){
+	/* the ESP-IDF server closes the session after an error response */
+	((httpd_req_aux_t*)r->aux)->close = true;
+	return httpd_send_err(r, "500 Internal Server Error", "Server has encountered an unexpected error");
+}
@@ -0,0 +1,25 @@
+/* host build: the cJSON calls of http_client.c and ota.c, objects of strings only, see cJSON.c */
+#pragma once
+
+#define cJSON_Invalid   (0)
+#define cJSON_String    (1 << 4)
+#define cJSON_Object    (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+cJSON *cJSON_Parse(const char *value);
+cJSON *cJSON_CreateObject(void);
+cJSON *cJSON_AddStringToObject(cJSON * const object, const char * const name, const char * const string);
+cJSON *cJSON_GetObjectItem(const cJSON * const object, const char * const string);
+void cJSON_Delete(cJSON *item);
+
+#define cJSON_ArrayForEach(element, array) for(element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
@@ -0,0 +1,3 @@
+/* host build: not used by http_app.c */
+#pragma once
+#include "esp_err.h"
@@ -0,0 +1,92 @@
+/* host build: the part of the esp_http_server API used by http_app.c, served by httpd_posix.c */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define HTTPD_MAX_REQ_HDR_LEN       CONFIG_HTTPD_MAX_REQ_HDR_LEN
+#define HTTPD_MAX_URI_LEN           CONFIG_HTTPD_MAX_URI_LEN
+
+#define HTTPD_SOCK_ERR_FAIL         -1
+#define HTTPD_SOCK_ERR_INVALID      -2
+#define HTTPD_SOCK_ERR_TIMEOUT      -3
+
+#define HTTPD_RESP_USE_STRLEN       -1
+
+#define ESP_ERR_HTTPD_BASE          (0x8000)
+#define ESP_ERR_HTTPD_RESULT_TRUNC  (ESP_ERR_HTTPD_BASE + 6)
+
+typedef void* httpd_handle_t;
+
+/* values of http_parser, as in ESP-IDF */
+typedef enum {
+    HTTP_DELETE = 0,
+    HTTP_GET = 1,
+    HTTP_HEAD = 2,
+    HTTP_POST = 3,
+    HTTP_PUT = 4
+} httpd_method_t;
+
+typedef struct httpd_req {
+    httpd_handle_t  handle;
+    int             method;
+    const char      uri[HTTPD_MAX_URI_LEN + 1];
+    size_t          content_len;
+    void*           aux;
+    void*           user_ctx;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+    const char*     uri;
+    httpd_method_t  method;
+    esp_err_t       (*handler)(httpd_req_t *r);
+    void*           user_ctx;
+} httpd_uri_t;
+
+typedef struct httpd_config {
+    uint16_t        server_port;
+    uint16_t        max_open_sockets;
+    uint16_t        max_uri_handlers;
+    uint16_t        max_resp_headers;
+    uint16_t        backlog_conn;
+    bool            lru_purge_enable;
+    uint16_t        recv_wait_timeout;
+    uint16_t        send_wait_timeout;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() {        \
+        .server_port        = 80,       \
+        .max_open_sockets   = 7,        \
+        .max_uri_handlers   = 8,        \
+        .max_resp_headers   = 8,        \
+        .backlog_conn       = 5,        \
+        .lru_purge_enable   = false,    \
+        .recv_wait_timeout  = 5,        \
+        .send_wait_timeout  = 5,        \
+}
+
+/**
+ * @brief port of the host server, replaces config->server_port when not 0.
+ */
+extern uint16_t httpd_host_port;
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_stop(httpd_handle_t handle);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+int httpd_req_to_sockfd(httpd_req_t *r);
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_500(httpd_req_t *r);
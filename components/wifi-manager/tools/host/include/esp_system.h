@@ -0,0 +1,10 @@
+/* host build: the heap figures are those of the allocations counted by port.c */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+size_t esp_get_free_heap_size(void);
+size_t esp_get_minimum_free_heap_size(void);
+
+uint32_t esp_random(void);
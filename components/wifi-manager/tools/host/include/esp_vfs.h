@@ -0,0 +1,3 @@
+/* host build: the storage partition is a directory of the host, see HOST_STORE in the Makefile */
+#pragma once
+#include <stdio.h>
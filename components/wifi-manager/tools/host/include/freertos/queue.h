@@ -0,0 +1,19 @@
+/* host build: queues of freertos_posix.c, the semaphores are queues of no item size */
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"		/* as the FreeRTOS queue.h */
+
+#define queueSEND_TO_BACK       0
+#define queueSEND_TO_FRONT      1
+
+QueueHandle_t xQueueGenericCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, UBaseType_t uxInitialCount);
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait, BaseType_t xCopyPosition);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue);
+void vQueueDelete(QueueHandle_t xQueue);
+
+#define xQueueCreate(length, size)              xQueueGenericCreate((length), (size), 0)
+#define xQueueSend(queue, item, ticks)          xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToBack(queue, item, ticks)    xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_BACK)
+#define xQueueSendToFront(queue, item, ticks)   xQueueGenericSend((queue), (item), (ticks), queueSEND_TO_FRONT)
@@ -0,0 +1,10 @@
+/* host build: semaphores and mutexes are counting queues without items, mutexes are not recursive */
+#pragma once
+#include "freertos/queue.h"
+
+#define xSemaphoreCreateBinary()                    xQueueGenericCreate(1, 0, 0)
+#define xSemaphoreCreateCounting(max, initial)      xQueueGenericCreate((max), 0, (initial))
+#define xSemaphoreCreateMutex()                     xQueueGenericCreate(1, 0, 1)
+#define xSemaphoreTake(sem, ticks)                  xQueueReceive((sem), NULL, (ticks))
+#define xSemaphoreGive(sem)                         xQueueGenericSend((sem), NULL, 0, queueSEND_TO_BACK)
+#define vSemaphoreDelete(sem)                       vQueueDelete(sem)
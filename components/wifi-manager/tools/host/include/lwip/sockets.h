@@ -0,0 +1,5 @@
+/* host build: lwIP offers the BSD socket API of the host */
+#pragma once
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
@@ -0,0 +1,35 @@
+/* host build: the mbedtls SHA-256 calls of ota_writer.c and ota.c, computed by OpenSSL */
+#pragma once
+#include <string.h>
+#include <openssl/sha.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+typedef SHA256_CTX mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha256_clone(mbedtls_sha256_context *dst, const mbedtls_sha256_context *src) {
+    *dst = *src;
+}
+
+static inline int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224) {
+    return SHA256_Init(ctx) ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen) {
+    return SHA256_Update(ctx, input, ilen) ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32]) {
+    return SHA256_Final(output, ctx) ? 0 : -1;
+}
+
+#pragma GCC diagnostic pop
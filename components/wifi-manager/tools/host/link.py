@@ -0,0 +1,90 @@
+#!/usr/bin/env python
+#
+# TCP proxy emulating the wifi link of the device in front of the host build:
+# every byte is delayed by half the round trip in each direction, a new connection
+# by one round trip for its handshake, and each direction is limited to --kbps shared
+# by all the connections, as the radio is.
+#
+# usage: link.py [--listen 8090] [--target 127.0.0.1:8080] [--rtt 10] [--kbps 2000]
+#
+import argparse
+import asyncio
+
+
+class Link(object):
+    """one direction of the radio: transfers are serialized at the link rate"""
+
+    def __init__(self, kbps):
+        self.rate = kbps * 1000.0 / 8.0
+        self.free_at = 0.0
+
+    def reserve(self, size, ready):
+        """time at which size bytes ready at ready have been sent"""
+        if not self.rate:
+            return ready
+        start = max(ready, self.free_at)
+        self.free_at = start + size / self.rate
+        return self.free_at
+
+
+async def forward(reader, writer, link, delay, handshake):
+    loop = asyncio.get_event_loop()
+    queue = asyncio.Queue()
+
+    async def receive():
+        first = True
+        while True:
+            data = await reader.read(4096)
+            ready = loop.time() + delay + (handshake if first else 0.0)
+            first = False
+            await queue.put((link.reserve(len(data), ready), data))
+            if not data:
+                return
+
+    async def send():
+        while True:
+            at, data = await queue.get()
+            wait = at - loop.time()
+            if wait > 0:
+                await asyncio.sleep(wait)
+            if not data:
+                break
+            writer.write(data)
+            await writer.drain()
+        writer.close()
+
+    await asyncio.gather(receive(), send(), return_exceptions=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="wifi link emulation in front of the host build")
+    parser.add_argument("--listen", type=int, default=8090)
+    parser.add_argument("--target", default="127.0.0.1:8080")
+    parser.add_argument("--rtt", type=float, default=10.0, help="round trip, ms")
+    parser.add_argument("--kbps", type=float, default=2000.0, help="rate of each direction, 0 for no limit")
+    args = parser.parse_args()
+    host, _, port = args.target.partition(":")
+    delay = args.rtt / 2000.0
+    uplink, downlink = Link(args.kbps), Link(args.kbps)
+
+    async def on_client(client_reader, client_writer):
+        try:
+            server_reader, server_writer = await asyncio.open_connection(host, int(port))
+        except OSError:
+            client_writer.close()
+            return
+        await asyncio.gather(forward(client_reader, server_writer, uplink, delay, 2 * delay),
+                             forward(server_reader, client_writer, downlink, delay, 0.0))
+
+    loop = asyncio.get_event_loop()
+    server = loop.run_until_complete(asyncio.start_server(on_client, "127.0.0.1", args.listen))
+    print("link: %d -> %s, rtt %.1f ms, %.0f kbps" % (args.listen, args.target, args.rtt, args.kbps))
+    try:
+        loop.run_forever()
+    except KeyboardInterrupt:
+        pass
+    server.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,50 @@
+/*
+ * Host build of http_app.c: serves the web UI of the wifi manager on a port of the host
+ * until SIGINT or SIGTERM, then prints the heap figures and the requests made to the
+ * wifi manager.
+ *
+ * usage: http_app_host [port]      8080 by default
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <esp_http_server.h>
+
+#include "http_app.h"
+#include "manager_stub.h"
+#include "port.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int sig){
+	stop = 1;
+}
+
+int main(int argc, char** argv){
+	httpd_host_port = (argc > 1) ? atoi(argv[1]) : 8080;
+
+	port_init();
+	manager_stub_init();
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	/* as the wifi manager does when it starts the access point */
+	http_app_start(true);
+	http_app_set_routes(HTTP_APP_ROUTES_ALL);
+
+	while(!stop){
+		pause();
+	}
+
+	size_t peak = port_heap_peak();
+	uint32_t scans, connects, saves;
+	manager_stub_get_counts(&scans, &connects, &saves);
+	http_app_stop();
+	printf("heap: %u bytes, peak use %u bytes, lowest free %u bytes\n",
+		(unsigned)port_heap_size(), (unsigned)peak, (unsigned)(port_heap_size() > peak ? port_heap_size() - peak : 0));
+	printf("wifi manager: %u scans, %u connects, %u configurations saved\n",
+		(unsigned)scans, (unsigned)connects, (unsigned)saves);
+	return 0;
+}
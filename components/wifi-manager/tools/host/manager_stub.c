@@ -0,0 +1,130 @@
+/*
+ * Host build: the wifi manager as seen by http_app.c.
+ *
+ * The access point list holds MAX_AP_NUM entries as after a scan, the json buffer and the
+ * STA address are guarded by mutexes like on the device. Nothing is written: the setup
+ * calls only check the body is a JSON object, /setup also wants its "wifi" section, and
+ * the scan and connect requests are counted.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+
+#include "manager.h"
+#include "manager_stub.h"
+
+static const char TAG[] = "wifi_manager";
+
+static pthread_mutex_t json_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sta_ip_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char accessp_json[MAX_AP_NUM * JSON_ONE_APP_SIZE + 4];
+static char ip_info_json[JSON_IP_INFO_SIZE];
+static char sta_ip_string[] = "0.0.0.0";
+
+static uint32_t scan_requests = 0;
+static uint32_t connect_requests = 0;
+static uint32_t saved = 0;
+
+void manager_stub_init(void){
+	const char oneap_str[] = "{\"ssid\":\"%s\",\"chan\":%d,\"rssi\":%d,\"auth\":%d}%c\n";
+	char one_ap[JSON_ONE_APP_SIZE];
+	char ssid[33];
+
+	strcpy(accessp_json, "[");
+	for(int i = 0; i < MAX_AP_NUM; i++){
+		snprintf(ssid, sizeof(ssid), "access-point-%02d", i);
+		snprintf(one_ap, sizeof(one_ap), oneap_str, ssid, 1 + i % 13, -40 - 3 * i, WIFI_AUTH_WPA2_PSK,
+			i == MAX_AP_NUM - 1 ? ']' : ',');
+		strcat(accessp_json, one_ap);
+	}
+	snprintf(ip_info_json, sizeof(ip_info_json),
+		"{\"ssid\":\"\",\"ip\":\"0\",\"netmask\":\"0\",\"gw\":\"0\",\"urc\":%d,\"httpc\":0}\n", UPDATE_USER_DISCONNECT);
+}
+
+void manager_stub_get_counts(uint32_t* scans, uint32_t* connects, uint32_t* saves){
+	*scans = scan_requests;
+	*connects = connect_requests;
+	*saves = saved;
+}
+
+static bool lock_timed(pthread_mutex_t* mutex, TickType_t xTicksToWait){
+	if(xTicksToWait == portMAX_DELAY){
+		return pthread_mutex_lock(mutex) == 0;
+	}
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t ns = ts.tv_nsec + (uint64_t)xTicksToWait * portTICK_PERIOD_MS * 1000000;
+	ts.tv_sec += ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	return pthread_mutex_timedlock(mutex, &ts) == 0;
+}
+
+bool wifi_manager_lock_json_buffer(TickType_t xTicksToWait){
+	return lock_timed(&json_mutex, xTicksToWait);
+}
+
+void wifi_manager_unlock_json_buffer(){
+	pthread_mutex_unlock(&json_mutex);
+}
+
+bool wifi_manager_lock_sta_ip_string(TickType_t xTicksToWait){
+	return lock_timed(&sta_ip_mutex, xTicksToWait);
+}
+
+void wifi_manager_unlock_sta_ip_string(){
+	pthread_mutex_unlock(&sta_ip_mutex);
+}
+
+char* wifi_manager_get_ap_list_json(){
+	return accessp_json;
+}
+
+char* wifi_manager_get_ip_info_json(){
+	return ip_info_json;
+}
+
+char* wifi_manager_get_sta_ip_string(){
+	return sta_ip_string;
+}
+
+void wifi_manager_scan_async(){
+	__atomic_add_fetch(&scan_requests, 1, __ATOMIC_RELAXED);
+}
+
+void wifi_manager_connect_async(){
+	__atomic_add_fetch(&connect_requests, 1, __ATOMIC_RELAXED);
+}
+
+static esp_err_t save_json(const char* what, const char* json_string){
+	if(json_string == NULL || json_string[0] != '{'){
+		ESP_LOGE(TAG, "%s is not a json object", what);
+		return ESP_ERR_INVALID_ARG;
+	}
+	__atomic_add_fetch(&saved, 1, __ATOMIC_RELAXED);
+	return ESP_OK;
+}
+
+esp_err_t wifi_manager_save_config_bundle(const char* json_string){
+	if(json_string == NULL || strstr(json_string, "\"wifi\"") == NULL){
+		ESP_LOGE(TAG, "Bundle without wifi section");
+		return ESP_ERR_INVALID_ARG;
+	}
+	return save_json("bundle", json_string);
+}
+
+esp_err_t wifi_manager_save_wifi_config(const char* json_string){ return save_json("wifi", json_string); }
+esp_err_t wifi_manager_save_wifi_ca(const char* json_string){ return save_json("wifi ca", json_string); }
+esp_err_t wifi_manager_save_wifi_crt(const char* json_string){ return save_json("wifi crt", json_string); }
+esp_err_t wifi_manager_save_wifi_key(const char* json_string){ return save_json("wifi key", json_string); }
+esp_err_t wifi_manager_save_ipv4_config(const char* json_string){ return save_json("ipv4", json_string); }
+esp_err_t wifi_manager_save_http_config(const char* json_string){ return save_json("http", json_string); }
+esp_err_t wifi_manager_save_http_ca(const char* json_string){ return save_json("http ca", json_string); }
+esp_err_t wifi_manager_save_http_crt(const char* json_string){ return save_json("http crt", json_string); }
+esp_err_t wifi_manager_save_http_key(const char* json_string){ return save_json("http key", json_string); }
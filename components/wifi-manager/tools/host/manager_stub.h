@@ -0,0 +1,13 @@
+/* host build: set up and counters of the wifi manager stand-in */
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief fills the access point list and the connection status.
+ */
+void manager_stub_init(void);
+
+/**
+ * @brief scans and connections requested by the server, configurations accepted.
+ */
+void manager_stub_get_counts(uint32_t* scans, uint32_t* connects, uint32_t* saves);
@@ -0,0 +1,152 @@
+/*
+ * Host build: clock, log and heap of the ESP8266 port used by http_app.c and http_client.c.
+ *
+ * malloc, calloc, realloc and free of the host objects are wrapped (see LDFLAGS in the
+ * Makefile) to count the bytes in use. The free heap is HOST_HEAP_SIZE less those bytes,
+ * so esp_get_minimum_free_heap_size() gives the high-water mark of the server and the
+ * wifi manager code, not of the C library or of the host system.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+
+#include <esp_err.h>
+#include <esp_http_client.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "port.h"
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+
+static size_t heap_size = HOST_HEAP_SIZE;
+static size_t heap_used = 0;
+static size_t heap_peak = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void heap_count(void* ptr, int sign){
+	if(ptr == NULL){
+		return;
+	}
+	size_t size = malloc_usable_size(ptr);
+	if(sign > 0){
+		size_t used = __atomic_add_fetch(&heap_used, size, __ATOMIC_RELAXED);
+		size_t peak = __atomic_load_n(&heap_peak, __ATOMIC_RELAXED);
+		while(used > peak && !__atomic_compare_exchange_n(&heap_peak, &peak, used, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	}
+	else{
+		__atomic_sub_fetch(&heap_used, size, __ATOMIC_RELAXED);
+	}
+}
+
+void *__wrap_malloc(size_t size){
+	void* ptr = __real_malloc(size);
+	heap_count(ptr, 1);
+	return ptr;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size){
+	void* ptr = __real_calloc(nmemb, size);
+	heap_count(ptr, 1);
+	return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size){
+	heap_count(ptr, -1);
+	void* ret = __real_realloc(ptr, size);
+	heap_count(ret ? ret : ptr, 1);
+	return ret;
+}
+
+void __wrap_free(void *ptr){
+	heap_count(ptr, -1);
+	__real_free(ptr);
+}
+
+void port_init(void){
+	const char* level = getenv("HOST_LOG_LEVEL");
+	const char* size = getenv("HOST_HEAP_SIZE");
+	if(level){
+		log_level = (esp_log_level_t)atoi(level);
+	}
+	if(size){
+		heap_size = strtoul(size, NULL, 0);
+	}
+}
+
+size_t port_heap_size(void){
+	return heap_size;
+}
+
+size_t port_heap_peak(void){
+	return __atomic_load_n(&heap_peak, __ATOMIC_RELAXED);
+}
+
+size_t esp_get_free_heap_size(void){
+	size_t used = __atomic_load_n(&heap_used, __ATOMIC_RELAXED);
+	return (used < heap_size) ? heap_size - used : 0;
+}
+
+size_t esp_get_minimum_free_heap_size(void){
+	size_t peak = port_heap_peak();
+	return (peak < heap_size) ? heap_size - peak : 0;
+}
+
+uint32_t esp_random(void){
+	return ((uint32_t)random() << 16) ^ (uint32_t)random();
+}
+
+int64_t esp_timer_get_time(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+TickType_t xTaskGetTickCount(void){
+	return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...){
+	static const char letters[] = "NEWIDV";
+	if(level > log_level){
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	fprintf(stderr, "%c (%u) %s: ", letters[level], (unsigned)(esp_timer_get_time() / 1000), tag);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+}
+
+const char* esp_err_to_name(esp_err_t code){
+	switch(code){
+	case ESP_OK:					return "ESP_OK";
+	case ESP_FAIL:					return "ESP_FAIL";
+	case ESP_ERR_NO_MEM:			return "ESP_ERR_NO_MEM";
+	case ESP_ERR_INVALID_ARG:		return "ESP_ERR_INVALID_ARG";
+	case ESP_ERR_INVALID_STATE:		return "ESP_ERR_INVALID_STATE";
+	case ESP_ERR_INVALID_SIZE:		return "ESP_ERR_INVALID_SIZE";
+	case ESP_ERR_NOT_FOUND:			return "ESP_ERR_NOT_FOUND";
+	case ESP_ERR_NOT_SUPPORTED:		return "ESP_ERR_NOT_SUPPORTED";
+	case ESP_ERR_TIMEOUT:			return "ESP_ERR_TIMEOUT";
+	case ESP_ERR_INVALID_RESPONSE:	return "ESP_ERR_INVALID_RESPONSE";
+	case ESP_ERR_INVALID_CRC:		return "ESP_ERR_INVALID_CRC";
+	case ESP_ERR_HTTP_MAX_REDIRECT:	return "ESP_ERR_HTTP_MAX_REDIRECT";
+	case ESP_ERR_HTTP_CONNECT:		return "ESP_ERR_HTTP_CONNECT";
+	case ESP_ERR_HTTP_WRITE_DATA:	return "ESP_ERR_HTTP_WRITE_DATA";
+	case ESP_ERR_HTTP_FETCH_HEADER:	return "ESP_ERR_HTTP_FETCH_HEADER";
+	case ESP_ERR_HTTP_INVALID_TRANSPORT:	return "ESP_ERR_HTTP_INVALID_TRANSPORT";
+	default:						return "UNKNOWN ERROR";
+	}
+}
@@ -0,0 +1,20 @@
+/* host build: set up of port.c and the heap figures reported at exit */
+#pragma once
+#include <stddef.h>
+
+/* @brief nominal heap of the device, free heap once the wifi manager runs, HOST_HEAP_SIZE overrides it */
+#ifndef HOST_HEAP_SIZE
+#define HOST_HEAP_SIZE		40960
+#endif
+
+/**
+ * @brief reads HOST_LOG_LEVEL (0 none to 5 verbose, 2 by default) and HOST_HEAP_SIZE from the environment.
+ */
+void port_init(void);
+
+size_t port_heap_size(void);
+
+/**
+ * @brief highest number of bytes allocated at the same time since the start.
+ */
+size_t port_heap_peak(void);
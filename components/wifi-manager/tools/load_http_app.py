@@ -0,0 +1,267 @@
+#!/usr/bin/env python
+#
+# Load generator for the web server of http_app.c: concurrent keep-alive clients
+# drive the portal routes and report the request rate, the latency percentiles
+# per route and the heap figures of /stats.json (CONFIG_HTTP_APP_STATS).
+#
+#   GET  /                  the web UI page
+#   GET  /ap.json           the access point list, also starts a scan
+#   GET  / captive          with a foreign Host header, answered by the captive redirect
+#                           (only the registered routes redirect, others are 404)
+#   POST /setup             a bundle the device rejects before writing the flash (400),
+#                           --post-body sends a real one
+#
+# Connect to the access point of the device, or to its STA address with
+# CONFIG_HTTP_APP_STA_DIAGNOSTICS. /stats.json is read with ?reset before the
+# run, polled during it for the lowest free heap, and read again at the end.
+# 429 answers of the rate limiter are counted apart from the errors.
+#
+# Without a device, host/ builds http_app.c as a program of the host: run
+# host/build/http_app_host and load it with --host 127.0.0.1 --port 8080
+# --portal-host 10.10.0.1. All the clients then share one address, disable the rate
+# limiter to measure the server.
+#
+# --page N loads the UI N times as a browser with an empty cache would instead:
+# the page, then the files it links over up to --page-connections new connections.
+# The time to the last byte compares the separate files with the single inlined
+# page of CONFIG_HTTP_APP_UI_BUNDLE.
+#
+# usage: load_http_app.py [--host 10.10.0.1] [--port 80] [--clients 4] [--duration 30]
+#                         [--mix root=4,ap=2,captive=2,post=1] [--post-body bundle.json]
+#                         [--page 20 [--page-connections 6]]
+#
+import argparse
+import http.client
+import json
+import random
+import re
+import sys
+import threading
+import time
+
+# files linked by the page, data: URIs and other hosts are not requested
+ASSET_RE = re.compile(r'<(?:script|link|img)\b[^>]*?\b(?:src|href)="([^"#:]+)"', re.IGNORECASE)
+
+# the default POST: valid JSON that fails the bundle validation, nothing is written
+INVALID_BUNDLE = b'{"load_test":true}'
+
+
+class Route(object):
+    def __init__(self, name, method, path, headers=None, body=None, expect=(200,)):
+        self.name = name
+        self.method = method
+        self.path = path
+        self.headers = headers or {}
+        self.body = body
+        self.expect = expect
+        self.latencies = []
+        self.statuses = {}
+        self.rejected = 0
+        self.errors = 0
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def get_stats(args, reset=False):
+    """the /stats.json document, None if the route is not served"""
+    try:
+        conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+        conn.request("GET", args.root + "stats.json" + ("?reset" if reset else ""))
+        response = conn.getresponse()
+        body = response.read()
+        conn.close()
+        return json.loads(body.decode()) if response.status == 200 else None
+    except (OSError, ValueError, http.client.HTTPException):
+        return None
+
+
+def fetch(args, path):
+    """status and body of one request on a new connection"""
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    try:
+        conn.request("GET", path, headers={"Host": args.portal_host} if args.portal_host else {})
+        response = conn.getresponse()
+        return response.status, response.read()
+    finally:
+        conn.close()
+
+
+def load_page(args):
+    """one page load: seconds to the last byte, requests, bytes, False if a request failed"""
+    start = time.time()
+    status, page = fetch(args, args.root)
+    if status != 200:
+        return time.time() - start, 1, len(page), False
+    assets = [args.root + path.lstrip("./") for path in ASSET_RE.findall(page.decode("utf-8", "replace"))]
+    results = []
+    lock = threading.Lock()
+
+    def worker():
+        while True:
+            with lock:
+                if not assets:
+                    return
+                path = assets.pop(0)
+            try:
+                result = fetch(args, path)
+            except (OSError, http.client.HTTPException):
+                result = (0, b"")
+            with lock:
+                results.append(result)
+
+    threads = [threading.Thread(target=worker) for _ in range(min(args.page_connections, max(len(assets), 1)))]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    ok = all(status == 200 for status, _ in results)
+    return time.time() - start, 1 + len(results), len(page) + sum(len(body) for _, body in results), ok
+
+
+def page_loads(args):
+    times, failed = [], 0
+    requests = size = 0
+    for _ in range(args.page):
+        try:
+            elapsed, requests, size, ok = load_page(args)
+        except (OSError, http.client.HTTPException):
+            elapsed, ok = 0, False
+        if ok:
+            times.append(elapsed * 1000.0)
+        else:
+            failed += 1
+        time.sleep(args.page_pause)
+    print("load_http_app: %s:%d, %d page loads, %d requests and %d bytes each, %d failed"
+          % (args.host, args.port, args.page, requests, size, failed))
+    print("  load time: p50 %.1f ms, p90 %.1f ms, max %.1f ms"
+          % (percentile(times, 50), percentile(times, 90), max(times or [0])))
+    return 1 if failed else 0
+
+
+def client(args, routes, weights, lock, deadline):
+    conn = None
+    while time.time() < deadline:
+        route = random.choices(routes, weights)[0]
+        start = time.time()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            conn.request(route.method, route.path, body=route.body, headers=route.headers)
+            response = conn.getresponse()
+            response.read()
+            status = response.status
+            if response.getheader("Connection", "").lower() == "close":
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException):
+            if conn is not None:
+                conn.close()
+            conn = None
+            with lock:
+                route.errors += 1
+            continue
+        elapsed_ms = (time.time() - start) * 1000.0
+        with lock:
+            route.statuses[status] = route.statuses.get(status, 0) + 1
+            if status == 429:
+                route.rejected += 1
+            elif status in route.expect:
+                route.latencies.append(elapsed_ms)
+            else:
+                route.errors += 1
+    if conn is not None:
+        conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="concurrent load on the http_app web server")
+    parser.add_argument("--host", default="10.10.0.1", help="address of the device, CONFIG_DEFAULT_AP_IP")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--root", default="/", help="CONFIG_WEBAPP_LOCATION")
+    parser.add_argument("--clients", type=int, default=4, help="concurrent keep-alive connections")
+    parser.add_argument("--duration", type=int, default=30, help="seconds")
+    parser.add_argument("--timeout", type=float, default=10.0, help="seconds per request")
+    parser.add_argument("--mix", default="root=4,ap=2,captive=2,post=1", help="weights of the routes")
+    parser.add_argument("--captive-host", default="connectivitycheck.gstatic.com", help="Host of the captive requests")
+    parser.add_argument("--portal-host", help="Host of the portal requests, CONFIG_DEFAULT_AP_IP when --host is not")
+    parser.add_argument("--post-body", help="bundle sent to /setup, written to the flash of the device")
+    parser.add_argument("--sample", type=float, default=2.0, help="seconds between /stats.json polls, 0 for none")
+    parser.add_argument("--page", type=int, default=0, help="page loads to time instead of the load mix")
+    parser.add_argument("--page-connections", type=int, default=6, help="parallel connections of a page load")
+    parser.add_argument("--page-pause", type=float, default=0.5, help="seconds between page loads")
+    args = parser.parse_args()
+    if args.page:
+        return page_loads(args)
+
+    body = INVALID_BUNDLE
+    if args.post_body:
+        with open(args.post_body, "rb") as f:
+            body = f.read()
+    portal_headers = {"Host": args.portal_host} if args.portal_host else {}
+    json_headers = dict(portal_headers, **{"Content-Type": "application/json"})
+    routes = {
+        "root": Route("GET /", "GET", args.root, portal_headers),
+        "ap": Route("GET /ap.json", "GET", args.root + "ap.json", portal_headers, expect=(200, 503)),
+        "captive": Route("GET / captive", "GET", args.root, {"Host": args.captive_host}, expect=(302,)),
+        "post": Route("POST /setup", "POST", args.root + "setup", json_headers, body,
+                      expect=(200,) if args.post_body else (400,)),
+    }
+    selected, weights = [], []
+    for item in args.mix.split(","):
+        name, _, weight = item.partition("=")
+        if name not in routes:
+            sys.exit("load_http_app: unknown route %s, one of %s" % (name, ", ".join(routes)))
+        selected.append(routes[name])
+        weights.append(float(weight or 1))
+
+    before = get_stats(args, reset=True)
+    lowest_heap = before["free_heap"] if before else None
+    lock = threading.Lock()
+    started = time.time()
+    deadline = started + args.duration
+    threads = [threading.Thread(target=client, args=(args, selected, weights, lock, deadline))
+               for _ in range(args.clients)]
+    for thread in threads:
+        thread.start()
+    while args.sample and time.time() < deadline:
+        time.sleep(min(args.sample, max(deadline - time.time(), 0)))
+        stats = get_stats(args)
+        if stats:
+            lowest_heap = min(lowest_heap if lowest_heap is not None else stats["free_heap"], stats["free_heap"])
+    for thread in threads:
+        thread.join()
+    elapsed = time.time() - started
+    after = get_stats(args)
+
+    total = sum(sum(route.statuses.values()) for route in selected)
+    print("load_http_app: %s:%d, %d clients, %.1f s, %d requests, %.1f req/s"
+          % (args.host, args.port, args.clients, elapsed, total, total / elapsed))
+    print("  %-14s %8s %8s %9s %9s %9s %6s %6s" % ("route", "count", "req/s", "p50 ms", "p99 ms", "max ms", "429", "errors"))
+    for route in selected:
+        count = sum(route.statuses.values())
+        print("  %-14s %8d %8.1f %9.1f %9.1f %9.1f %6d %6d"
+              % (route.name, count, count / elapsed, percentile(route.latencies, 50), percentile(route.latencies, 99),
+                 max(route.latencies or [0]), route.rejected, route.errors))
+    if after is None:
+        print("  /stats.json is not served or rate limited, no device figures (CONFIG_HTTP_APP_STATS, CONFIG_HTTP_APP_STA_DIAGNOSTICS)")
+        return 0
+    if before:
+        print("  heap: %u free before, %u after, %u lowest polled, %u low-water mark since boot"
+              % (before["free_heap"], after["free_heap"], lowest_heap, after["min_free_heap"]))
+    else:
+        print("  heap: %u free, %u low-water mark since boot" % (after["free_heap"], after["min_free_heap"]))
+    for name in ("static", "json", "action"):
+        device = after.get(name)
+        if device:
+            print("  device %-7s %6d requests %5d rejected, p50 %u ms p99 %u ms max %u ms"
+                  % (name, device["requests"], device["rejected"], device["p50_ms"], device["p99_ms"], device["max_ms"]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,417 @@
+#!/usr/bin/env python
+#
+# Stand-in for the backend of http_client, with fault injection, to measure the
+# client on the device against a server on the bench instead of the real one.
+#
+#   GET  CONFIG_HTTP_CLIENT_CONNECT_PATH   orders: {} or the firmware to install
+#   GET  CONFIG_HTTP_CLIENT_POLL_PATH      long-poll: held until --push-interval
+#                                          makes an order, 204 after ?wait= seconds
+#   GET  /firmware/<name>                  the --firmware image or the --patch, Range supported;
+#                                          an image of ota_compress.py is offered with the
+#                                          SHA-256 of the image it inflates to
+#   POST/PUT any other path                sink, gzip bodies and JSON are checked, CBOR accepted
+#
+# Point the server settings of the device (address, port, api prefix, esp json
+# key) to this host. Faults apply to every request except the firmware download
+# unless --faults-on-ota is given.
+#
+# --ota-fail N checks that a failed upgrade is retried: the first N firmware
+# downloads are corrupted, so the device rejects them, and the orders keep
+# offering the firmware. The orders request after each failure must come
+# without the validators of the previous one, a 304 would hide the offer. The
+# server exits with 1 when one does, with 0 once a good image has been sent.
+#
+# usage: mock_backend.py [--port 8080] [--latency 200] [--error-rate 0.1]
+#                        [--disconnect-rate 0.05] [--slow-body 2048]
+#                        [--firmware build/app.bin --ota-after 3 [--patch app.patch] [--sig app.sig]
+#                         [--ota-cut 65536] [--ota-repeat] [--ota-fail 1]]
+#                        [--cert server.crt --key server.key [--ca ca.crt]]
+#
+import argparse
+import gzip
+import hashlib
+import json
+import os
+import random
+import ssl
+import sys
+import threading
+import time
+import zlib
+
+try:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+    from socketserver import ThreadingMixIn
+except ImportError:
+    sys.exit("mock_backend: python 3 is required")
+
+
+class Stats(object):
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.connections = 0
+        self.requests = {}
+        self.bytes_in = 0
+        self.bytes_wire = 0
+        self.errors = 0
+        self.disconnects = 0
+        self.bad_bodies = 0
+        self.ota_bytes = 0
+        self.not_modified = 0
+        self.started = time.time()
+
+    def count(self, key, value=1):
+        with self.lock:
+            if key in ("connections", "errors", "disconnects", "bad_bodies", "ota_bytes", "not_modified"):
+                setattr(self, key, getattr(self, key) + value)
+            else:
+                self.requests[key] = self.requests.get(key, 0) + value
+
+    def report(self):
+        with self.lock:
+            elapsed = max(time.time() - self.started, 1e-3)
+            total = sum(self.requests.values())
+            print("mock_backend: %.0fs, %d connections, %d requests (%.2f/s), body %d bytes (%d on the wire), "
+                  "injected %d errors %d disconnects, %d bad bodies, %d not modified, ota %d bytes"
+                  % (elapsed, self.connections, total, total / elapsed, self.bytes_in, self.bytes_wire,
+                     self.errors, self.disconnects, self.bad_bodies, self.not_modified, self.ota_bytes))
+            for path in sorted(self.requests):
+                print("  %-32s %d" % (path, self.requests[path]))
+            sys.stdout.flush()
+
+
+class Handler(BaseHTTPRequestHandler):
+    # keep-alive, as the client pool expects
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        BaseHTTPRequestHandler.setup(self)
+        self.server.stats.count("connections")
+
+    def log_message(self, fmt, *args):
+        if self.server.args.verbose:
+            BaseHTTPRequestHandler.log_message(self, fmt, *args)
+
+    def path_only(self):
+        path = self.path.split("?", 1)[0]
+        api = self.server.args.api
+        if api and path.startswith(api):
+            path = path[len(api):] or "/"
+        return path
+
+    def fault(self, ota=False):
+        """applies latency and the injected failures, True if the request was answered by a fault"""
+        args = self.server.args
+        if ota and not args.faults_on_ota:
+            return False
+        if args.latency:
+            time.sleep((args.latency + random.uniform(-args.jitter, args.jitter)) / 1000.0)
+        if random.random() < args.disconnect_rate:
+            self.server.stats.count("disconnects")
+            self.close_connection = True
+            self.connection.close()
+            return True
+        if random.random() < args.error_rate:
+            self.server.stats.count("errors")
+            self.reply(503, b'{"error":"injected"}')
+            return True
+        return False
+
+    def reply(self, code, body, content_type="application/json", headers=None):
+        self.send_response(code)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        self.end_headers()
+        self.write_body(body)
+
+    def write_body(self, body):
+        rate = self.server.args.slow_body
+        if not rate:
+            self.wfile.write(body)
+            return
+        # slow body: pieces of 1/10 s worth of bytes
+        piece = max(rate // 10, 1)
+        for i in range(0, len(body), piece):
+            self.wfile.write(body[i:i + piece])
+            self.wfile.flush()
+            time.sleep(0.1)
+
+    def read_body(self):
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            data = b""
+            while True:
+                size = int(self.rfile.readline().split(b";")[0].strip(), 16)
+                if size == 0:
+                    self.rfile.readline()
+                    return data
+                data += self.rfile.read(size)
+                self.rfile.readline()
+        return self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+    def do_GET(self):
+        path = self.path_only()
+        if path.startswith("/firmware/"):
+            return self.firmware()
+        self.server.stats.count("GET " + path)
+        if self.fault():
+            return
+        if path == self.server.args.connect_path:
+            body = json.dumps(self.server.next_orders()).encode()
+            # conditional GET: the ETag is the hash of the orders
+            etag = '"%08x"' % (zlib.crc32(body) & 0xffffffff)
+            self.server.check_retry(self.headers.get("If-None-Match") == etag)
+            if self.headers.get("If-None-Match") == etag:
+                self.server.stats.count("not_modified")
+                return self.reply(304, b"", headers={"ETag": etag})
+            return self.reply(200, body, headers={"ETag": etag})
+        if path == self.server.args.poll_path:
+            return self.long_poll()
+        self.reply(200, b"{}")
+
+    def do_DELETE(self):
+        self.server.stats.count("DELETE " + self.path_only())
+        if not self.fault():
+            self.reply(200, b"{}")
+
+    def do_POST(self):
+        path = self.path_only()
+        data = self.read_body()
+        self.server.stats.count(self.command + " " + path)
+        if self.fault():
+            return
+        wire = len(data)
+        try:
+            if self.headers.get("Content-Encoding", "").lower() == "gzip":
+                data = gzip.decompress(data)
+            # CBOR bodies are accepted as they are
+            if data and not self.headers.get("Content-Type", "").startswith("application/cbor"):
+                json.loads(data.decode("utf-8"))
+        except (OSError, ValueError, EOFError) as e:
+            self.server.stats.count("bad_bodies")
+            print("mock_backend: bad body to %s: %s" % (path, e))
+            return self.reply(400, b'{"error":"bad body"}')
+        with self.server.stats.lock:
+            self.server.stats.bytes_in += len(data)
+            self.server.stats.bytes_wire += wire
+        if self.server.args.verbose:
+            print("mock_backend: %s %s %d bytes (%d on the wire)" % (self.command, path, len(data), wire))
+        self.reply(200, b'{"ok":true}')
+
+    do_PUT = do_POST
+
+    def long_poll(self):
+        wait = 30
+        for param in self.path.partition("?")[2].split("&"):
+            if param.startswith("wait="):
+                wait = int(param[5:])
+        order = self.server.wait_push(wait)
+        if order is None:
+            return self.reply(204, b"")
+        self.reply(200, json.dumps(order).encode())
+
+    def firmware(self):
+        self.server.stats.count("GET /firmware")
+        image = self.server.image
+        if self.server.patch is not None and self.path_only().endswith("/" + os.path.basename(self.server.args.patch)):
+            image = self.server.patch
+        if image is None:
+            return self.reply(404, b'{"error":"no firmware"}')
+        if self.fault(ota=True):
+            return
+        is_patch = image is self.server.patch
+        corrupt = self.server.fails_left > 0
+        if corrupt:
+            # the hash no longer matches, the device rejects the image at the end
+            image = image[:-1] + bytes([image[-1] ^ 0xFF])
+        etag = '"%08x"' % (zlib.crc32(image) & 0xffffffff)
+        start, end, code, headers = 0, len(image) - 1, 200, {"Accept-Ranges": "bytes", "ETag": etag}
+        requested = self.headers.get("Range", "")
+        if self.headers.get("If-Range", etag) != etag:
+            # changed since the first part was downloaded, the whole file is sent
+            requested = ""
+        if requested.startswith("bytes="):
+            first, _, last = requested[6:].partition("-")
+            start = int(first) if first else 0
+            end = min(int(last), end) if last else end
+            if start > end:
+                return self.reply(416, b"", headers={"Content-Range": "bytes */%d" % len(image)})
+            code = 206
+            headers["Content-Range"] = "bytes %d-%d/%d" % (start, end, len(image))
+        body = image[start:end + 1]
+        cut = self.server.args.ota_cut
+        if cut and len(body) > cut:
+            # a link drop: the headers promise the whole body, the connection closes after cut bytes
+            self.server.stats.count("disconnects")
+            self.server.stats.count("ota_bytes", cut)
+            self.send_response(code)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Content-Length", str(len(body)))
+            for name, value in headers.items():
+                self.send_header(name, value)
+            self.end_headers()
+            self.write_body(body[:cut])
+            self.close_connection = True
+            return
+        self.server.stats.count("ota_bytes", len(body))
+        self.reply(code, body, "application/octet-stream", headers)
+        if end == len(image) - 1:
+            self.server.ota_sent(corrupt, is_patch)
+
+
+class Server(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+    def __init__(self, args):
+        HTTPServer.__init__(self, ("", args.port), Handler)
+        self.args = args
+        self.stats = Stats()
+        self.orders = 0
+        self.pushed = []
+        self.push_ready = threading.Condition()
+        self.image = None
+        self.image_sha256 = None
+        self.patch = None
+        self.fails_left = args.ota_fail
+        self.check_pending = False
+        self.installed = False
+        self.result = 0
+        if args.firmware:
+            with open(args.firmware, "rb") as f:
+                self.image = f.read()
+            image = self.image
+            if image[:1] != b"\xe9":
+                image = zlib.decompress(image)
+            self.image_sha256 = hashlib.sha256(image).hexdigest()
+        if args.patch:
+            with open(args.patch, "rb") as f:
+                self.patch = f.read()
+
+    def next_orders(self):
+        with self.stats.lock:
+            self.orders += 1
+            repeat = (self.args.ota_repeat or self.args.ota_fail) and not self.installed
+            offer = self.image is not None and (self.orders == self.args.ota_after or
+                                                repeat and self.orders > self.args.ota_after)
+        if offer:
+            name = os.path.basename(self.args.firmware)
+            print("mock_backend: offering firmware %s, %d bytes" % (name, len(self.image)))
+            orders = {self.args.ota_key: self.args.api + "/firmware/" + name,
+                      self.args.ota_key + "_sha256": self.image_sha256}
+            if self.args.sig:
+                with open(self.args.sig) as f:
+                    orders[self.args.ota_key + "_sig"] = "".join(f.read().split())
+            if self.patch is not None:
+                orders[self.args.ota_key + "_delta"] = self.args.api + "/firmware/" + os.path.basename(self.args.patch)
+            return orders
+        return {}
+
+    def ota_sent(self, corrupt, is_patch):
+        """a firmware file was sent to its end"""
+        with self.stats.lock:
+            if corrupt and not is_patch:
+                # the patch and then the image are rejected, the orders are probed next
+                self.fails_left -= 1
+                self.check_pending = True
+                print("mock_backend: sent a corrupted image, %d more to send" % self.fails_left)
+            elif not corrupt:
+                self.installed = True
+        if not corrupt and self.args.ota_fail:
+            print("mock_backend: PASS, the upgrade was retried after %d failures" % self.args.ota_fail)
+            self.finish(0)
+
+    def check_retry(self, revalidated):
+        """the first orders request after a failed upgrade must ask for the whole body"""
+        with self.stats.lock:
+            if not self.check_pending:
+                return
+            self.check_pending = False
+        if revalidated:
+            print("mock_backend: FAIL, the orders were revalidated after a failed upgrade, the offer is hidden by a 304")
+            self.finish(1)
+        else:
+            print("mock_backend: the orders were fetched in full after the failed upgrade")
+
+    def finish(self, result):
+        self.result = result
+        threading.Thread(target=self.shutdown).start()
+
+    def push(self, order):
+        with self.push_ready:
+            self.pushed.append(order)
+            self.push_ready.notify()
+
+    def wait_push(self, timeout):
+        """the next pushed order, None if none came within timeout seconds"""
+        with self.push_ready:
+            deadline = time.time() + timeout
+            while not self.pushed and time.time() < deadline:
+                self.push_ready.wait(deadline - time.time())
+            return self.pushed.pop(0) if self.pushed else None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="http_client stand-in backend with fault injection")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--api", default="", help="server_api prefix configured on the device")
+    parser.add_argument("--connect-path", default="/orders", help="CONFIG_HTTP_CLIENT_CONNECT_PATH")
+    parser.add_argument("--poll-path", default="/orders/poll", help="CONFIG_HTTP_CLIENT_POLL_PATH")
+    parser.add_argument("--push-interval", type=int, default=0, help="seconds between orders pushed to the long-poll, 0 for none")
+    parser.add_argument("--latency", type=int, default=0, help="delay of every response, ms")
+    parser.add_argument("--jitter", type=int, default=0, help="random +/- ms added to the latency")
+    parser.add_argument("--error-rate", type=float, default=0.0, help="share of requests answered 503")
+    parser.add_argument("--disconnect-rate", type=float, default=0.0, help="share of requests dropped by closing the connection")
+    parser.add_argument("--slow-body", type=int, default=0, help="response bytes per second, 0 for no limit")
+    parser.add_argument("--firmware", help="image served under /firmware/")
+    parser.add_argument("--patch", help="delta of the firmware made by ota_delta.py, offered with it")
+    parser.add_argument("--sig", help="hex signature of the firmware, offered with it (CONFIG_OTA_SIGNATURE)")
+    parser.add_argument("--ota-after", type=int, default=1, help="the orders response offering the firmware")
+    parser.add_argument("--ota-key", default="esp", help="esp_json_key configured on the device")
+    parser.add_argument("--ota-cut", type=int, default=0, help="firmware bytes sent per request before the connection is closed")
+    parser.add_argument("--ota-repeat", action="store_true", help="offer the firmware in every orders response until it is sent whole")
+    parser.add_argument("--ota-fail", type=int, default=0, help="corrupted firmware downloads before a good one, checks the retry")
+    parser.add_argument("--faults-on-ota", action="store_true", help="inject faults into the firmware download too")
+    parser.add_argument("--cert", help="server certificate, serves https")
+    parser.add_argument("--key", help="server private key")
+    parser.add_argument("--ca", help="CA of the client certificates, requires one")
+    parser.add_argument("--stats", type=int, default=10, help="seconds between reports, 0 for none")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    server = Server(args)
+    if args.cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.cert, args.key)
+        if args.ca:
+            context.verify_mode = ssl.CERT_REQUIRED
+            context.load_verify_locations(args.ca)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+
+    if args.stats:
+        def report():
+            while True:
+                time.sleep(args.stats)
+                server.stats.report()
+        threading.Thread(target=report, daemon=True).start()
+
+    if args.push_interval:
+        def pusher():
+            number = 0
+            while True:
+                time.sleep(args.push_interval)
+                number += 1
+                server.push({"push": number, "time": int(time.time())})
+        threading.Thread(target=pusher, daemon=True).start()
+
+    print("mock_backend: listening on %s port %d" % ("https" if args.cert else "http", args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    server.stats.report()
+    return server.result
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+#
+# Compresses a firmware image for the OTA updates of ota.c (CONFIG_OTA_COMPRESSED).
+# The device recognizes the zlib stream by its header and decompresses it while
+# it is downloaded, so the compressed file is served in place of the image:
+#   {"<esp json key>": "/firmware/new.bin.z"}
+#
+# usage: ota_compress.py [--window-bits N] new.bin new.bin.z
+#
+# The window must not be larger than CONFIG_OTA_COMPRESSED_WINDOW_BITS, the
+# device allocates 2^bits bytes for it.
+#
+import argparse
+import sys
+import zlib
+
+# the inflater state besides the window, see gzip_inflate_t in include/gzip.h
+INFLATE_STATE = 1100
+
+
+def compress(image, window_bits):
+    compressor = zlib.compressobj(9, zlib.DEFLATED, window_bits, 9)
+    return compressor.compress(image) + compressor.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compressed firmware for OTA updates")
+    parser.add_argument("--window-bits", type=int, default=12, choices=range(9, 16),
+                        help="CONFIG_OTA_COMPRESSED_WINDOW_BITS of the device (default 12)")
+    parser.add_argument("image", help="firmware to install")
+    parser.add_argument("output", help="compressed image")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if image[:1] != b"\xe9":
+        raise SystemExit("ota_compress: %s is not an application image" % args.image)
+    data = compress(image, args.window_bits)
+    if zlib.decompress(data, args.window_bits) != image:
+        raise SystemExit("ota_compress: the compressed image does not match")
+    with open(args.output, "wb") as f:
+        f.write(data)
+    print("ota_compress: %s -> %s, %d of %d bytes (%.1f%%), %d bytes of RAM on the device"
+          % (args.image, args.output, len(data), len(image), 100.0 * len(data) / max(len(image), 1),
+             (1 << args.window_bits) + INFLATE_STATE))
+    if len(data) >= len(image):
+        print("ota_compress: the image does not compress, serve it as it is")
+
+
+if __name__ == "__main__":
+    sys.exit(main())
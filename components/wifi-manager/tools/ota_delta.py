@@ -0,0 +1,131 @@
+#!/usr/bin/env python
+#
+# Makes a patch from the firmware running on the device to a new one, for the
+# delta updates of ota.c (CONFIG_OTA_DELTA). The device applies it while it is
+# downloaded, copying unchanged pieces from its running partition, so only the
+# changed bytes go over the air.
+#
+# Serve the patch next to the full image and offer both in the orders:
+#   {"<esp json key>": "/firmware/new.bin", "<esp json key>_delta": "/firmware/new.patch"}
+#
+# usage: ota_delta.py old.bin new.bin new.patch
+#
+# Format, integers little endian (see include/ota_delta.h):
+#   "WMD1", old size (u32), new size (u32), SHA-256 of new (32 bytes)
+#   0x01 COPY offset (u32) length (u32) | 0x02 INSERT length (u32) bytes | 0x00 END
+#
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"WMD1"
+OP_END, OP_COPY, OP_INSERT = 0, 1, 2
+# bytes hashed to find a match in the old image
+BLOCK = 16
+# shorter matches cost more as a COPY than as literal bytes
+MIN_COPY = 32
+
+
+def index_blocks(old):
+    """offset of the first occurrence of every aligned BLOCK of old"""
+    index = {}
+    for offset in range(0, len(old) - BLOCK + 1, 4):
+        index.setdefault(old[offset:offset + BLOCK], offset)
+    return index
+
+
+def make_patch(old, new):
+    index = index_blocks(old)
+    ops = []
+    literal = bytearray()
+    pos = 0
+    while pos < len(new):
+        src = index.get(new[pos:pos + BLOCK]) if pos + BLOCK <= len(new) else None
+        length = 0
+        if src is not None:
+            # extend back into the pending literal, then forward
+            while literal and src > 0 and old[src - 1] == literal[-1]:
+                literal.pop()
+                src -= 1
+                pos -= 1
+                length += 1
+            while pos + length < len(new) and src + length < len(old) and new[pos + length] == old[src + length]:
+                length += 1
+        if length >= MIN_COPY:
+            if literal:
+                ops.append((OP_INSERT, bytes(literal)))
+                literal = bytearray()
+            ops.append((OP_COPY, src, length))
+            pos += length
+        else:
+            # a failed backward extension only moved bytes between literal and new
+            literal.extend(new[pos:pos + max(length, 1)])
+            pos += max(length, 1)
+    if literal:
+        ops.append((OP_INSERT, bytes(literal)))
+
+    out = bytearray(MAGIC + struct.pack("<II", len(old), len(new)) + hashlib.sha256(new).digest())
+    for op in ops:
+        if op[0] == OP_COPY:
+            out += struct.pack("<BII", OP_COPY, op[1], op[2])
+        else:
+            out += struct.pack("<BI", OP_INSERT, len(op[1])) + op[1]
+    out.append(OP_END)
+    return bytes(out)
+
+
+def apply_patch(old, patch):
+    """the reference of ota_delta.c, used to check the patch"""
+    if patch[:4] != MAGIC:
+        raise ValueError("not a patch")
+    old_size, new_size = struct.unpack_from("<II", patch, 4)
+    digest = patch[12:44]
+    if old_size != len(old):
+        raise ValueError("patch for another image")
+    out = bytearray()
+    pos = 44
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            offset, length = struct.unpack_from("<II", patch, pos)
+            pos += 8
+            if offset + length > old_size:
+                raise ValueError("copy out of the source")
+            out += old[offset:offset + length]
+        elif op == OP_INSERT:
+            (length,) = struct.unpack_from("<I", patch, pos)
+            pos += 4
+            out += patch[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError("unknown op %d" % op)
+    if len(out) != new_size or hashlib.sha256(out).digest() != digest:
+        raise ValueError("result does not match")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="firmware patch for delta OTA updates")
+    parser.add_argument("old", help="firmware running on the device")
+    parser.add_argument("new", help="firmware to install")
+    parser.add_argument("patch", help="output")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+    patch = make_patch(old, new)
+    apply_patch(old, patch)
+    with open(args.patch, "wb") as f:
+        f.write(patch)
+    print("ota_delta: %s -> %s, %d bytes patch for a %d bytes image (%.1f%%)"
+          % (args.old, args.new, len(patch), len(new), 100.0 * len(patch) / max(len(new), 1)))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+#
+# Builds ui/bundle/index.html: the web UI as a single page with code.js and
+# style.css minified and inlined and the favicon as a data URI, so the captive
+# portal loads with one request.
+#
+# usage: ui_bundle.py [ui directory] [output file]
+#
+import base64
+import os
+import re
+import sys
+
+
+def strip_comments(src, line_comments):
+    """removes /* */ (and // if line_comments) comments, string and template literals are kept"""
+    out = []
+    i, n = 0, len(src)
+    while i < n:
+        c = src[i]
+        if c in "\"'`":
+            j = i + 1
+            while j < n and src[j] != c:
+                j += 2 if src[j] == "\\" else 1
+            out.append(src[i:j + 1])
+            i = j + 1
+        elif src.startswith("/*", i):
+            j = src.find("*/", i + 2)
+            i = n if j < 0 else j + 2
+        elif line_comments and src.startswith("//", i) and (i == 0 or src[i - 1] in " \t\n;{}()"):
+            j = src.find("\n", i)
+            i = n if j < 0 else j
+        else:
+            out.append(c)
+            i += 1
+    return "".join(out)
+
+
+def minify_js(src):
+    # line breaks are kept, the code relies on automatic semicolon insertion
+    src = strip_comments(src, True)
+    lines = (line.strip() for line in src.split("\n"))
+    return "\n".join(line for line in lines if line)
+
+
+def minify_css(src):
+    src = strip_comments(src, False)
+    src = re.sub(r"\s+", " ", src)
+    src = re.sub(r"\s*([{}:;,>])\s*", r"\1", src)
+    return src.replace(";}", "}").strip()
+
+
+def read(path, mode="r"):
+    with open(path, mode) as f:
+        return f.read()
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ui = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, "..", "ui")
+    output = sys.argv[2] if len(sys.argv) > 2 else os.path.join(ui, "bundle", "index.html")
+
+    html = read(os.path.join(ui, "index.html"))
+    js = minify_js(read(os.path.join(ui, "code.js")))
+    css = minify_css(read(os.path.join(ui, "style.css")))
+    ico = base64.b64encode(read(os.path.join(ui, "favicon.ico"), "rb")).decode("ascii")
+
+    html, icons = re.subn(r'<link rel="icon"[^>]*>',
+                          '<link rel="icon" type="image/x-icon" href="data:image/x-icon;base64,%s">' % ico, html)
+    html, styles = re.subn(r'<link rel="stylesheet" href="style.css">', lambda m: "<style>%s</style>" % css, html)
+    html, scripts = re.subn(r'\s*<script[^>]*src="code.js"[^>]*></script>', "", html)
+    # the inlined script runs synchronously, place it after the markup as the async one did
+    html = html.replace("</body>", "<script>%s</script>\n</body>" % js, 1)
+    if icons != 1 or styles != 1 or scripts != 1:
+        sys.exit("ui_bundle: unexpected index.html layout")
+
+    html = "\n".join(line.strip() for line in html.split("\n") if line.strip()) + "\n"
+
+    if not os.path.isdir(os.path.dirname(output)):
+        os.makedirs(os.path.dirname(output))
+    with open(output, "w") as f:
+        f.write(html)
+
+    total = sum(os.path.getsize(os.path.join(ui, name)) for name in ("index.html", "code.js", "style.css", "favicon.ico"))
+    print("ui_bundle: 4 files, %d bytes -> %s, %d bytes" % (total, output, len(html)))
+
+
+if __name__ == "__main__":
+    main()
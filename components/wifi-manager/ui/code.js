@@ -335,15 +335,9 @@ async function createSetup() {
 
   const setup = await GetSetup();
 
-  let count = Object.keys(setup).length;
-
   const timeout = () => { 
-    if (count === 0) {
-      connect();
-    }else {
-      hide("loading");
-      show("setup-fail");
-    }
+    hide("loading");
+    show("setup-fail");
   };
 
   let timer = setTimeout(timeout, 5000);
@@ -368,21 +362,27 @@ async function createSetup() {
     });
   };
 
-  for (const [key, value] of Object.entries(setup)) {
-      fetch(key, {
-      method: "POST",
-      headers: {
-        'Content-Type': 'application/json;charset=utf-8'
-      },
-      body: value
-    })
-    .finally(() => {
-      --count;
-      if(count === 0) {
-        connect();
-      }
-    })
-  }
+  // all sections are saved at once, the device keeps the previous configuration on failure
+  fetch("setup", {
+    method: "POST",
+    headers: {
+      'Content-Type': 'application/json;charset=utf-8'
+    },
+    body: JSON.stringify(setup)
+  })
+  .then(function (res) {
+    if(res.status === 200) {
+      connect();
+    }else {
+      clearTimeout(timer);
+      timeout();
+    }
+  })
+  .catch (function (error) {
+    console.log('Setup error: ', error);
+    clearTimeout(timer);
+    timeout();
+  });
 }
 
 function GetHttpSetup() {
@@ -434,12 +434,12 @@ async function GetSetup() {
 
   for (const [key, value] of Object.entries(setup)){
     const file = gel(value).files[0];
-    setup[key] = JSON.stringify({[key]: (file) ? await file.text() : ''});
+    setup[key] = {[key]: (file) ? await file.text() : ''};
   }
 
-  setup["wifi_setup"] = JSON.stringify(GetWifiSetup());
-  setup["ipv4_setup"] = JSON.stringify(GetIpv4Setup());
-  setup["http_setup"] = JSON.stringify(GetHttpSetup());
+  setup["wifi_setup"] = GetWifiSetup();
+  setup["ipv4_setup"] = GetIpv4Setup();
+  setup["http_setup"] = GetHttpSetup();
 
   return setup;
 }